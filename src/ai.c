@@ -0,0 +1,1169 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "rng.h"
+#include "ai.h"
+
+#define AI_INFINITY INT32_MAX
+#define AI_WIN 1000000		/* score of a fraction whose enemies are all dead */
+
+static const uint32_t AI_TIME_CHECK_NODES = 1024;
+static const int32_t AI_ALIVE_VALUE = 200;
+static const int32_t AI_APPROACH_WEIGHT = 2;
+static const int32_t AI_APPROACH_MAX = 30;
+
+enum AiBound
+{
+	AB_EXACT,
+	AB_LOWER,
+	AB_UPPER
+};
+
+/* fields of the town around the mercs, read once per plan */
+typedef struct AiBoard
+{
+	SDL_Point origin;
+	uint32_t width;
+	uint32_t height;
+	uint8_t *open;			/* 1 where a merc could stand if no other merc did */
+} AiBoard ;
+
+typedef struct AiMerc
+{
+	Mercenary id;
+	MercFraction fraction;
+	int32_t x;				/* board coordinates */
+	int32_t y;
+	int32_t hp;				/* 0 once dead */
+	uint32_t moved;
+	bool attacked;
+} AiMerc ;
+
+/* position of the search, small enough to be copied on every move */
+typedef struct AiState
+{
+	uint32_t merc_count;
+	AiMerc mercs[MERCENARY_COUNT];
+	MercFraction side;		/* whose mercs act */
+	uint32_t next;			/* slot acting next */
+} AiState ;
+
+typedef struct AiMove
+{
+	int16_t x;
+	int16_t y;
+	uint8_t cost;			/* steps to x, y */
+	int8_t target;			/* slot attacked or -1 */
+	uint8_t weapon_slot;
+	int32_t damage;
+	int32_t order;			/* higher is searched first */
+} AiMove ;
+
+typedef struct AiEntry
+{
+	uint64_t key;			/* 0 if unused */
+	int32_t score;
+	uint8_t depth;
+	uint8_t bound;
+	int8_t best_target;
+	int16_t best_x;
+	int16_t best_y;
+} AiEntry ;
+
+typedef struct AiSearch AiSearch;
+
+/* everything a thread writes to during the search */
+typedef struct AiWorker
+{
+	AiSearch *search;
+	AiEntry *table;
+	uint32_t stamp;
+	uint32_t *stamps;		/* per board cell, visited by the current walk */
+	uint64_t nodes;
+	AiMove *moves;			/* AI_MAX_DEPTH + 1 plies of move_limit each */
+} AiWorker ;
+
+/* one depth of one action, root moves are handed out one by one */
+struct AiSearch
+{
+	const AiBoard *board;
+	AiState root;
+	MercFraction fraction;
+	uint32_t depth;
+	uint32_t deadline;		/* in SDL_GetTicks */
+
+	uint32_t move_limit;	/* most moves one merc can have */
+	uint32_t root_count;
+	AiMove *root_moves;
+	int32_t *root_scores;
+
+	SDL_atomic_t next_root;
+	SDL_atomic_t stop;
+
+	SDL_SpinLock lock;		/* guards alpha and best */
+	int32_t alpha;
+	int32_t best;
+};
+
+static bool Ai_board_open( const AiBoard *board, const int32_t x, const int32_t y )
+{
+	if (x < 0 || y < 0 || (uint32_t) x >= board->width || (uint32_t) y >= board->height)
+		return false;
+
+	return board->open[y * board->width + x];
+}
+
+static bool Ai_occupied( const AiState *state, const int32_t x, const int32_t y )
+{
+	for (uint32_t i = 0; i < state->merc_count; i++)
+	{
+		if (state->mercs[i].hp > 0 && state->mercs[i].x == x && state->mercs[i].y == y)
+			return true;
+	}
+
+	return false;
+}
+
+static uint32_t Ai_living( const AiState *state, const MercFraction fraction )
+{
+	uint32_t result = 0;
+
+	for (uint32_t i = 0; i < state->merc_count; i++)
+	{
+		if (state->mercs[i].hp > 0 && state->mercs[i].fraction == fraction)
+			result++;
+	}
+
+	return result;
+}
+
+static MercFraction Ai_enemy( const MercFraction fraction )
+{
+	return fraction == MF_GREEN ? MF_PURPLE : MF_GREEN;
+}
+
+static uint32_t Ai_first_living( const AiState *state, const MercFraction fraction, const uint32_t from )
+{
+	for (uint32_t i = from; i < state->merc_count; i++)
+	{
+		if (state->mercs[i].hp > 0 && state->mercs[i].fraction == fraction)
+			return i;
+	}
+
+	return state->merc_count;
+}
+
+/* hands the turn to the next merc of the side, or begins the round of the other side */
+static void Ai_advance( AiState *state )
+{
+	state->next = Ai_first_living(state, state->side, state->next + 1);
+
+	if (state->next < state->merc_count)
+		return;
+
+	state->side = Ai_enemy(state->side);
+
+	for (uint32_t i = 0; i < state->merc_count; i++)
+	{
+		if (state->mercs[i].fraction == state->side)
+		{
+			state->mercs[i].moved = 0;
+			state->mercs[i].attacked = false;
+		}
+	}
+
+	state->next = Ai_first_living(state, state->side, 0);
+}
+
+static uint64_t Ai_hash( const AiState *state )
+{
+	uint64_t result = Rng_derive_seed(state->side, state->next);
+
+	for (uint32_t i = 0; i < state->merc_count; i++)
+	{
+		result ^= Rng_derive_seed(i + 1,
+			(uint64_t) state->mercs[i].x |
+			((uint64_t) state->mercs[i].y << 16) |
+			((uint64_t) state->mercs[i].hp << 32) |
+			((uint64_t) state->mercs[i].moved << 48) |
+			((uint64_t) state->mercs[i].attacked << 56));
+	}
+
+	/* 0 marks unused table entries */
+	return result == 0 ? 1 : result;
+}
+
+static uint32_t Ai_nearest_enemy( const AiState *state, const AiMerc *merc, const int32_t x, const int32_t y )
+{
+	uint32_t result = UINT32_MAX;
+	uint32_t distance;
+
+	for (uint32_t i = 0; i < state->merc_count; i++)
+	{
+		if (state->mercs[i].hp <= 0 || state->mercs[i].fraction == merc->fraction)
+			continue;
+
+		distance = abs(state->mercs[i].x - x) + abs(state->mercs[i].y - y);
+
+		if (distance < result)
+			result = distance;
+	}
+
+	return result;
+}
+
+/* from the view of fraction, hp beyond the maximum is not worth anything */
+static int32_t Ai_evaluate( const AiState *state, const MercFraction fraction )
+{
+	const AiMerc *merc;
+	int32_t result = 0;
+	int32_t value;
+	uint32_t distance;
+
+	if (Ai_living(state, Ai_enemy(fraction)) == 0)
+		return AI_WIN;
+
+	if (Ai_living(state, fraction) == 0)
+		return -AI_WIN;
+
+	for (uint32_t i = 0; i < state->merc_count; i++)
+	{
+		merc = &state->mercs[i];
+
+		if (merc->hp <= 0)
+			continue;
+
+		value = AI_ALIVE_VALUE;
+
+		if ((uint32_t) merc->hp < DATA_MERCENARIES[merc->id].max_hp)
+			value += merc->hp;
+		else
+			value += DATA_MERCENARIES[merc->id].max_hp;
+
+		// attackers want to close in
+		if (DATA_MERCENARIES[merc->id].role == MR_OFFENSE)
+		{
+			distance = Ai_nearest_enemy(state, merc, merc->x, merc->y);
+
+			if (distance > (uint32_t) AI_APPROACH_MAX)
+				distance = AI_APPROACH_MAX;
+
+			value -= AI_APPROACH_WEIGHT * distance;
+		}
+
+		result += merc->fraction == fraction ? value : -value;
+	}
+
+	return result;
+}
+
+/* strongest attack from x, y on target, heals for allies, false if there is none */
+static bool Ai_best_attack(
+	const AiState *state,
+	const AiMerc *merc,
+	const int32_t x,
+	const int32_t y,
+	const uint32_t target,
+	uint8_t *weapon_slot,
+	int32_t *damage )
+{
+	const AiMerc *victim = &state->mercs[target];
+	const bool ally = victim->fraction == merc->fraction;
+	const uint_fast32_t distance = abs(victim->x - x) + abs(victim->y - y);
+	const uint32_t slots = sizeof(DATA_MERCENARIES[0].loadout) / sizeof(DATA_MERCENARIES[0].loadout[0]);
+	MercWeapon weapon;
+	int32_t value;
+	bool found = false;
+
+	// healing a healthy ally wastes the attack
+	if (ally && (uint32_t) victim->hp >= DATA_MERCENARIES[victim->id].max_hp)
+		return false;
+
+	for (uint32_t i = 0; i < slots; i++)
+	{
+		weapon = DATA_MERCENARIES[merc->id].loadout[i];
+
+		if (DATA_WEAPONS[weapon].range < distance)
+			continue;
+
+		value = Sim_weapon_damage(weapon, distance);
+
+		if ((ally && value >= 0) || (ally == false && value <= 0))
+			continue;
+
+		if (found == false || (ally ? value < *damage : value > *damage))
+		{
+			*weapon_slot = i;
+			*damage = value;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+/* a merc walks at most range fields, then stays or attacks one of the others,
+	so the moves are bounded by its reach times the merc count */
+static uint32_t Ai_move_limit( const AiState *state )
+{
+	uint32_t range = 0;
+
+	for (uint32_t i = 0; i < state->merc_count; i++)
+	{
+		if (DATA_MERCENARIES[state->mercs[i].id].range > range)
+			range = DATA_MERCENARIES[state->mercs[i].id].range;
+	}
+
+	return (2 * range * (range + 1) + 1) * state->merc_count;
+}
+
+/* every move of the merc acting next: each field it can walk to,
+	there each attack it could make or none. moves holds move_limit */
+static uint32_t Ai_generate( AiWorker *worker, const AiState *state, AiMove *moves )
+{
+	static const int32_t DIRECTIONS[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+	const AiBoard *board = worker->search->board;
+	const AiMerc *merc = &state->mercs[state->next];
+	const uint32_t range = DATA_MERCENARIES[merc->id].range;
+	const uint32_t steps = merc->moved < range ? range - merc->moved : 0;
+	uint32_t count = 0;
+	uint32_t field_count;
+	uint8_t weapon_slot;
+	int32_t damage;
+	int32_t x, y;
+	AiMove move;
+
+	// walk breadth-first, fields are listed in the move array itself
+	worker->stamp++;
+	worker->stamps[merc->y * board->width + merc->x] = worker->stamp;
+	moves[count++] = (AiMove) {.x = merc->x, .y = merc->y, .cost = 0};
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (moves[i].cost >= steps)
+			continue;
+
+		for (uint32_t d = 0; d < 4; d++)
+		{
+			x = moves[i].x + DIRECTIONS[d][0];
+			y = moves[i].y + DIRECTIONS[d][1];
+
+			if (Ai_board_open(board, x, y) == false ||
+				worker->stamps[y * board->width + x] == worker->stamp ||
+				Ai_occupied(state, x, y))
+				continue;
+
+			worker->stamps[y * board->width + x] = worker->stamp;
+			moves[count++] = (AiMove) {.x = x, .y = y, .cost = moves[i].cost + 1};
+		}
+	}
+
+	// fill in what each field offers
+	field_count = count;
+
+	for (uint32_t i = 0; i < field_count; i++)
+	{
+		moves[i].target = -1;
+		moves[i].weapon_slot = 0;
+		moves[i].damage = 0;
+		moves[i].order = -(int32_t) Ai_nearest_enemy(state, merc, moves[i].x, moves[i].y);
+
+		if (merc->attacked)
+			continue;
+
+		for (uint32_t t = 0; t < state->merc_count; t++)
+		{
+			if (t == state->next || state->mercs[t].hp <= 0)
+				continue;
+
+			if (Ai_best_attack(state, merc, moves[i].x, moves[i].y, t, &weapon_slot, &damage) == false)
+				continue;
+
+			move = moves[i];
+			move.target = t;
+			move.weapon_slot = weapon_slot;
+			move.damage = damage;
+
+			// kills first, then by damage
+			if (damage >= state->mercs[t].hp)
+				move.order = AI_WIN + state->mercs[t].hp;
+			else
+				move.order = abs(damage) * 16 + moves[i].order;
+
+			moves[count++] = move;
+		}
+	}
+
+	return count;
+}
+
+static AiState Ai_apply( const AiState *state, const AiMove *move )
+{
+	AiState result = *state;
+	AiMerc *merc = &result.mercs[result.next];
+	AiMerc *victim;
+
+	merc->x = move->x;
+	merc->y = move->y;
+	merc->moved += move->cost;
+
+	// same rule as Sim_merc_attack, negative damage heals
+	if (move->target >= 0)
+	{
+		victim = &result.mercs[move->target];
+		merc->attacked = true;
+
+		if (move->damage >= victim->hp)
+			victim->hp = 0;
+		else
+			victim->hp -= move->damage;
+	}
+
+	Ai_advance(&result);
+
+	return result;
+}
+
+static bool Ai_stopped( AiWorker *worker )
+{
+	AiSearch *search = worker->search;
+
+	// the first depth always finishes, so there is a plan
+	if (search->depth > 1 && worker->nodes % AI_TIME_CHECK_NODES == 0 &&
+		SDL_TICKS_PASSED(SDL_GetTicks(), search->deadline))
+		SDL_AtomicSet(&search->stop, 1);
+
+	return SDL_AtomicGet(&search->stop) != 0;
+}
+
+/* moves the best of moves[from..count] to from */
+static void Ai_pick( AiMove *moves, const uint32_t from, const uint32_t count )
+{
+	uint32_t best = from;
+	AiMove temp;
+
+	for (uint32_t i = from + 1; i < count; i++)
+	{
+		if (moves[i].order > moves[best].order)
+			best = i;
+	}
+
+	temp = moves[from];
+	moves[from] = moves[best];
+	moves[best] = temp;
+}
+
+/* minimax with alpha-beta from the view of the searching fraction,
+	returns nonsense once stopped */
+static int32_t Ai_search(
+	AiWorker *worker,
+	const AiState *state,
+	const uint32_t depth,
+	const uint32_t ply,
+	int32_t alpha,
+	int32_t beta )
+{
+	const MercFraction fraction = worker->search->fraction;
+	const bool maximize = state->side == fraction;
+	const int32_t alpha_in = alpha;
+	const int32_t beta_in = beta;
+	AiMove *moves = &worker->moves[ply * worker->search->move_limit];
+	AiEntry *entry;
+	AiState child;
+	uint64_t key;
+	uint32_t count;
+	uint32_t best_move = 0;
+	int32_t best;
+	int32_t score;
+
+	worker->nodes++;
+
+	if (Ai_stopped(worker))
+		return 0;
+
+	if (depth == 0 || ply >= AI_MAX_DEPTH || state->next >= state->merc_count ||
+		Ai_living(state, Ai_enemy(state->side)) == 0)
+		return Ai_evaluate(state, fraction);
+
+	key = Ai_hash(state);
+	entry = &worker->table[key & (AI_TABLE_SIZE - 1)];
+
+	if (entry->key == key && entry->depth >= depth)
+	{
+		if (entry->bound == AB_EXACT)
+			return entry->score;
+		else if (entry->bound == AB_LOWER && entry->score > alpha)
+			alpha = entry->score;
+		else if (entry->bound == AB_UPPER && entry->score < beta)
+			beta = entry->score;
+
+		if (alpha >= beta)
+			return entry->score;
+	}
+
+	count = Ai_generate(worker, state, moves);
+
+	if (entry->key == key)
+	{
+		// search the move that was best last time first
+		for (uint32_t i = 0; i < count; i++)
+		{
+			if (moves[i].x == entry->best_x && moves[i].y == entry->best_y &&
+				moves[i].target == entry->best_target)
+			{
+				moves[i].order = AI_INFINITY;
+				break;
+			}
+		}
+	}
+
+	best = maximize ? -AI_INFINITY : AI_INFINITY;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Ai_pick(moves, i, count);
+		child = Ai_apply(state, &moves[i]);
+		score = Ai_search(worker, &child, depth - 1, ply + 1, alpha, beta);
+
+		if (SDL_AtomicGet(&worker->search->stop) != 0)
+			return 0;
+
+		if (maximize ? score > best : score < best)
+		{
+			best = score;
+			best_move = i;
+		}
+
+		if (maximize && score > alpha)
+			alpha = score;
+		else if (maximize == false && score < beta)
+			beta = score;
+
+		if (alpha >= beta)
+			break;
+	}
+
+	*entry = (AiEntry) {
+		.key = key,
+		.score = best,
+		.depth = depth,
+		.bound = best <= alpha_in ? AB_UPPER : (best >= beta_in ? AB_LOWER : AB_EXACT),
+		.best_target = moves[best_move].target,
+		.best_x = moves[best_move].x,
+		.best_y = moves[best_move].y,
+	};
+
+	return best;
+}
+
+/* thread function, takes root moves until there are none left */
+static int Ai_work( void *data )
+{
+	AiWorker *worker = data;
+	AiSearch *search = worker->search;
+	AiState child;
+	int32_t alpha;
+	int32_t score;
+	int index;
+
+	while (SDL_AtomicGet(&search->stop) == 0)
+	{
+		index = SDL_AtomicAdd(&search->next_root, 1);
+
+		if ((uint32_t) index >= search->root_count)
+			break;
+
+		// whatever another thread found already bounds this move
+		SDL_AtomicLock(&search->lock);
+		alpha = search->alpha;
+		SDL_AtomicUnlock(&search->lock);
+
+		child = Ai_apply(&search->root, &search->root_moves[index]);
+		score = Ai_search(worker, &child, search->depth - 1, 1, alpha, AI_INFINITY);
+
+		if (SDL_AtomicGet(&search->stop) != 0)
+			break;
+
+		SDL_AtomicLock(&search->lock);
+		search->root_scores[index] = score;
+
+		if (score > search->alpha || search->best < 0)
+		{
+			search->alpha = score;
+			search->best = index;
+		}
+
+		SDL_AtomicUnlock(&search->lock);
+	}
+
+	return 0;
+}
+
+/* sorts root moves by the scores of the last depth, best first */
+static void Ai_sort_roots( AiSearch *search )
+{
+	AiMove move;
+	int32_t score;
+	uint32_t j;
+
+	for (uint32_t i = 1; i < search->root_count; i++)
+	{
+		move = search->root_moves[i];
+		score = search->root_scores[i];
+
+		for (j = i; j > 0 && search->root_scores[j - 1] < score; j--)
+		{
+			search->root_moves[j] = search->root_moves[j - 1];
+			search->root_scores[j] = search->root_scores[j - 1];
+		}
+
+		search->root_moves[j] = move;
+		search->root_scores[j] = score;
+	}
+}
+
+/* deepens until time is up, returns the best root move of the deepest finished depth */
+static AiMove Ai_think(
+	AiSearch *search,
+	AiWorker *workers,
+	const uint32_t worker_count,
+	uint32_t *depth )
+{
+	SDL_Thread *threads[AI_MAX_THREADS];
+	AiMove result;
+
+	search->root_count = Ai_generate(&workers[0], &search->root, search->root_moves);
+
+	for (uint32_t i = 0; i < search->root_count; i++)
+		search->root_scores[i] = search->root_moves[i].order;
+
+	Ai_sort_roots(search);
+	result = search->root_moves[0];
+
+	// a forced move needs no thought
+	*depth = search->root_count > 1 ? 0 : AI_MAX_DEPTH;
+	SDL_AtomicSet(&search->stop, 0);
+
+	for (uint32_t d = 1; d <= AI_MAX_DEPTH && search->root_count > 1; d++)
+	{
+		search->depth = d;
+		search->alpha = -AI_INFINITY;
+		search->best = -1;
+		SDL_AtomicSet(&search->next_root, 0);
+
+		for (uint32_t i = 0; i < search->root_count; i++)
+			search->root_scores[i] = -AI_INFINITY;
+
+		// the calling thread works too
+		for (uint32_t i = 1; i < worker_count; i++)
+			threads[i] = SDL_CreateThread(Ai_work, "ai", &workers[i]);
+
+		Ai_work(&workers[0]);
+
+		for (uint32_t i = 1; i < worker_count; i++)
+			SDL_WaitThread(threads[i], NULL);
+
+		// a depth cut short may not have looked at the best move yet
+		if (SDL_AtomicGet(&search->stop) != 0 || search->best < 0)
+			break;
+
+		result = search->root_moves[search->best];
+		*depth = d;
+
+		// a decided game gets no better by looking deeper
+		if (search->alpha >= AI_WIN || search->alpha <= -AI_WIN)
+			break;
+
+		Ai_sort_roots(search);
+	}
+
+	return result;
+}
+
+static bool Ai_board_read( AiBoard *board, AiState *state, Town *town, const MercFraction fraction )
+{
+	const TownMerc *merc;
+	SDL_Point min = {town->width, town->height};
+	SDL_Point max = {0, 0};
+	Field field;
+
+	// window around the living mercs
+	for (uint32_t i = 0; i < town->merc_count; i++)
+	{
+		merc = &town->mercs[i];
+
+		if (merc->hp == 0)
+			continue;
+
+		if (merc->coords.x < min.x)
+			min.x = merc->coords.x;
+		if (merc->coords.y < min.y)
+			min.y = merc->coords.y;
+		if (merc->coords.x > max.x)
+			max.x = merc->coords.x;
+		if (merc->coords.y > max.y)
+			max.y = merc->coords.y;
+	}
+
+	if (min.x > max.x)
+		return false;
+
+	min.x -= AI_BOARD_MARGIN;
+	min.y -= AI_BOARD_MARGIN;
+	max.x += AI_BOARD_MARGIN;
+	max.y += AI_BOARD_MARGIN;
+
+	if (min.x < 0)
+		min.x = 0;
+	if (min.y < 0)
+		min.y = 0;
+	if (max.x >= (int32_t) town->width)
+		max.x = town->width - 1;
+	if (max.y >= (int32_t) town->height)
+		max.y = town->height - 1;
+
+	board->origin = min;
+	board->width = max.x - min.x + 1;
+	board->height = max.y - min.y + 1;
+	board->open = malloc(board->width * board->height);
+
+	if (board->open == NULL)
+		return false;
+
+	// mercs stand on fields the search moves them off again
+	for (uint32_t y = 0; y < board->height; y++)
+	{
+		for (uint32_t x = 0; x < board->width; x++)
+		{
+			field = Town_get_field(town, (SDL_Point) {board->origin.x + x, board->origin.y + y});
+			board->open[y * board->width + x] = (field == FIELD_EMPTY || field == FIELD_MERC);
+		}
+	}
+
+	// dead mercs keep their slot, so slots match the town
+	for (uint32_t i = 0; i < town->merc_count; i++)
+	{
+		merc = &town->mercs[i];
+
+		state->mercs[i] = (AiMerc) {
+			.id = merc->id,
+			.fraction = merc->fraction,
+			.x = merc->coords.x - board->origin.x,
+			.y = merc->coords.y - board->origin.y,
+			.hp = merc->hp,
+			.moved = merc->moved,
+			.attacked = merc->attacked,
+		};
+	}
+
+	state->merc_count = town->merc_count;
+	state->side = fraction;
+	state->next = Ai_first_living(state, fraction, 0);
+
+	return true;
+}
+
+AiPlan Ai_plan(
+	Town *town,
+	const MercFraction fraction,
+	const uint32_t budget_ms,
+	const uint32_t max_threads )
+{
+	AiPlan result = {
+		.invalid = false,
+		.action_count = 0,
+		.depth = AI_MAX_DEPTH,
+		.nodes = 0,
+		.threads = 1,
+	};
+	const uint32_t start = SDL_GetTicks();
+	AiWorker *workers;
+	AiSearch *search;
+	AiBoard board;
+	AiMove move;
+	uint32_t depth;
+	uint32_t left;
+	uint32_t elapsed;
+
+	// the window is read once, its chunks stay cached in town for the next turn
+	search = malloc(sizeof(AiSearch));
+
+	if (search == NULL || Ai_board_read(&board, &search->root, town, fraction) == false)
+	{
+		free(search);
+		result.invalid = search == NULL;
+		result.depth = 0;
+		return result;
+	}
+
+	search->move_limit = Ai_move_limit(&search->root);
+	search->root_moves = malloc(search->move_limit * sizeof(AiMove));
+	search->root_scores = malloc(search->move_limit * sizeof(int32_t));
+
+	if (search->root_moves == NULL || search->root_scores == NULL)
+		result.invalid = true;
+
+	if (SDL_GetCPUCount() > AI_MAX_THREADS)
+		result.threads = AI_MAX_THREADS;
+	else if (SDL_GetCPUCount() > 1)
+		result.threads = SDL_GetCPUCount();
+
+	if (max_threads > 0 && result.threads > max_threads)
+		result.threads = max_threads;
+
+	workers = calloc(result.threads, sizeof(AiWorker));
+
+	if (workers == NULL)
+		result.invalid = true;
+
+	for (uint32_t i = 0; i < result.threads && result.invalid == false; i++)
+	{
+		workers[i].search = search;
+		workers[i].table = calloc(AI_TABLE_SIZE, sizeof(AiEntry));
+		workers[i].stamps = calloc(board.width * board.height, sizeof(uint32_t));
+		workers[i].moves = malloc((AI_MAX_DEPTH + 1) * search->move_limit * sizeof(AiMove));
+
+		if (workers[i].table == NULL || workers[i].stamps == NULL || workers[i].moves == NULL)
+			result.invalid = true;
+	}
+
+	search->board = &board;
+	search->fraction = fraction;
+	search->lock = 0;
+
+	// each merc of the fraction acts in turn, sharing what is left of the budget
+	while (result.invalid == false &&
+		search->root.side == fraction &&
+		search->root.next < search->root.merc_count &&
+		Ai_living(&search->root, Ai_enemy(fraction)) > 0)
+	{
+		elapsed = SDL_GetTicks() - start;
+		left = 0;
+
+		for (uint32_t i = search->root.next; i < search->root.merc_count; i++)
+		{
+			if (search->root.mercs[i].hp > 0 && search->root.mercs[i].fraction == fraction)
+				left++;
+		}
+
+		search->deadline = start + elapsed + (elapsed < budget_ms ? (budget_ms - elapsed) / left : 0);
+		move = Ai_think(search, workers, result.threads, &depth);
+
+		if (depth < result.depth)
+			result.depth = depth;
+		result.actions[result.action_count++] = (AiAction) {
+			.src = {
+				search->root.mercs[search->root.next].x + board.origin.x,
+				search->root.mercs[search->root.next].y + board.origin.y},
+			.dest = {move.x + board.origin.x, move.y + board.origin.y},
+			.attack = move.target >= 0,
+			.weapon_slot = move.weapon_slot,
+			.target = {
+				move.target >= 0 ? search->root.mercs[move.target].x + board.origin.x : 0,
+				move.target >= 0 ? search->root.mercs[move.target].y + board.origin.y : 0},
+		};
+
+		search->root = Ai_apply(&search->root, &move);
+	}
+
+	if (result.action_count == 0)
+		result.depth = 0;
+
+	for (uint32_t i = 0; workers != NULL && i < result.threads; i++)
+	{
+		result.nodes += workers[i].nodes;
+		free(workers[i].table);
+		free(workers[i].stamps);
+		free(workers[i].moves);
+	}
+
+	free(workers);
+	free(board.open);
+	free(search->root_moves);
+	free(search->root_scores);
+	free(search);
+
+	return result;
+}
+
+uint32_t Ai_play( Sim *sim, const AiPlan *plan )
+{
+	const AiAction *action;
+	uint32_t result = 0;
+
+	for (uint32_t i = 0; i < plan->action_count; i++)
+	{
+		action = &plan->actions[i];
+
+		if ((action->dest.x != action->src.x || action->dest.y != action->src.y) &&
+			Sim_move_merc(sim, action->src, action->dest) == false)
+			continue;
+
+		// attacks are never without effect, 0 means refused
+		if (action->attack &&
+			Sim_merc_attack(sim, action->dest, action->weapon_slot, action->target) == 0)
+			continue;
+
+		result++;
+	}
+
+	return result;
+}
+
+/* what the rollouts of one thread came to */
+typedef struct AiTally
+{
+	uint32_t wins;
+	uint32_t losses;
+	uint64_t hp[2];
+	uint64_t kill_rounds[2];
+	uint32_t kills[2];
+} AiTally ;
+
+typedef struct AiRollouts
+{
+	AiWorker worker;
+	Rng rng;
+	const AiState *start;
+	uint32_t slots[2];		/* attacker and defender */
+	uint32_t count;
+	AiTally tally;
+} AiRollouts ;
+
+/* mostly the strongest move, now and then any, ties are broken at random */
+static uint32_t Ai_rollout_pick( const AiMove *moves, const uint32_t count, Rng *rng )
+{
+	uint32_t result = 0;
+	uint32_t ties = 0;
+
+	if (Rng_range(rng, AI_ESTIMATE_WILD) == 0)
+		return Rng_range(rng, count);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (moves[i].order > moves[result].order)
+		{
+			result = i;
+			ties = 1;
+		}
+		else if (moves[i].order == moves[result].order && Rng_range(rng, ++ties) == 0)
+		{
+			result = i;
+		}
+	}
+
+	return result;
+}
+
+static int Ai_estimate_work( void *data )
+{
+	AiRollouts *rollouts = data;
+	AiMove *moves = rollouts->worker.moves;
+	const MercFraction first = rollouts->start->side;
+	const AiMerc *fighters[2];
+	MercFraction side;
+	AiState state;
+	uint32_t round;
+	uint32_t count;
+
+	for (uint32_t r = 0; r < rollouts->count; r++)
+	{
+		state = *rollouts->start;
+		fighters[0] = &state.mercs[rollouts->slots[0]];
+		fighters[1] = &state.mercs[rollouts->slots[1]];
+		round = 1;
+
+		while (round <= AI_ESTIMATE_ROUNDS && fighters[0]->hp > 0 && fighters[1]->hp > 0)
+		{
+			count = Ai_generate(&rollouts->worker, &state, moves);
+			side = state.side;
+			state = Ai_apply(&state, &moves[Ai_rollout_pick(moves, count, &rollouts->rng)]);
+
+			// a round ends once the defender acted
+			if (side != first && state.side == first && fighters[0]->hp > 0)
+				round++;
+		}
+
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			rollouts->tally.hp[i] += fighters[i]->hp;
+
+			if (fighters[1 - i]->hp <= 0)
+			{
+				rollouts->tally.kills[i]++;
+				rollouts->tally.kill_rounds[i] += round;
+			}
+		}
+
+		if (fighters[1]->hp <= 0)
+			rollouts->tally.wins++;
+		else if (fighters[0]->hp <= 0)
+			rollouts->tally.losses++;
+	}
+
+	return 0;
+}
+
+AiEstimate Ai_estimate(
+	Town *town,
+	const SDL_Point attacker,
+	const SDL_Point defender,
+	const uint32_t rollouts )
+{
+	AiEstimate result = {
+		.invalid = false,
+		.rollouts = rollouts,
+		.threads = 1,
+	};
+	const uint32_t start_ticks = SDL_GetTicks();
+	const uint32_t slots[2] = {Town_merc_at(town, attacker), Town_merc_at(town, defender)};
+	SDL_Thread *threads[AI_MAX_THREADS];
+	AiRollouts *work = NULL;
+	AiSearch *search;
+	AiBoard board;
+	AiTally tally = {0};
+	AiMerc *merc;
+
+	if (slots[0] == COORDMAP_NONE || slots[1] == COORDMAP_NONE || slots[0] == slots[1] ||
+		town->mercs[slots[0]].fraction == town->mercs[slots[1]].fraction ||
+		rollouts == 0 || rollouts > AI_MAX_ESTIMATE_ROLLOUTS)
+	{
+		result.invalid = true;
+		return result;
+	}
+
+	search = malloc(sizeof(AiSearch));
+
+	if (search == NULL ||
+		Ai_board_read(&board, &search->root, town, town->mercs[slots[0]].fraction) == false)
+	{
+		free(search);
+		result.invalid = true;
+		return result;
+	}
+
+	search->board = &board;
+	search->move_limit = Ai_move_limit(&search->root);
+
+	// bystanders only stand in the way
+	for (uint32_t i = 0; i < search->root.merc_count; i++)
+	{
+		merc = &search->root.mercs[i];
+
+		if (i == slots[0] || i == slots[1] || merc->hp <= 0)
+			continue;
+
+		board.open[merc->y * board.width + merc->x] = 0;
+		merc->hp = 0;
+	}
+
+	search->root.next = slots[0];
+
+	if (SDL_GetCPUCount() > AI_MAX_THREADS)
+		result.threads = AI_MAX_THREADS;
+	else if (SDL_GetCPUCount() > 1)
+		result.threads = SDL_GetCPUCount();
+
+	// not worth a thread below a few hundred rollouts each
+	if (result.threads > rollouts / AI_ESTIMATE_MIN_PER_THREAD + 1)
+		result.threads = rollouts / AI_ESTIMATE_MIN_PER_THREAD + 1;
+
+	work = calloc(result.threads, sizeof(AiRollouts));
+
+	for (uint32_t i = 0; work != NULL && i < result.threads; i++)
+	{
+		work[i].worker.search = search;
+		work[i].worker.stamps = calloc(board.width * board.height, sizeof(uint32_t));
+		work[i].worker.moves = malloc(search->move_limit * sizeof(AiMove));
+		work[i].rng = Rng_new(Rng_derive_seed(town->seed ^ town->round, i));
+		work[i].start = &search->root;
+		work[i].slots[0] = slots[0];
+		work[i].slots[1] = slots[1];
+		work[i].count = rollouts / result.threads + (i < rollouts % result.threads);
+
+		if (work[i].worker.stamps == NULL || work[i].worker.moves == NULL)
+			result.invalid = true;
+	}
+
+	if (work == NULL)
+		result.invalid = true;
+
+	if (result.invalid == false)
+	{
+		// the calling thread takes the first share
+		for (uint32_t i = 1; i < result.threads; i++)
+		{
+			threads[i] = SDL_CreateThread(Ai_estimate_work, "estimate", &work[i]);
+
+			// a thread that did not start leaves its share to the caller
+			if (threads[i] == NULL)
+			{
+				work[0].count += work[i].count;
+				work[i].count = 0;
+			}
+		}
+
+		Ai_estimate_work(&work[0]);
+
+		for (uint32_t i = 1; i < result.threads; i++)
+		{
+			if (threads[i] != NULL)
+				SDL_WaitThread(threads[i], NULL);
+		}
+
+		for (uint32_t i = 0; i < result.threads; i++)
+		{
+			tally.wins += work[i].tally.wins;
+			tally.losses += work[i].tally.losses;
+
+			for (uint32_t j = 0; j < 2; j++)
+			{
+				tally.hp[j] += work[i].tally.hp[j];
+				tally.kill_rounds[j] += work[i].tally.kill_rounds[j];
+				tally.kills[j] += work[i].tally.kills[j];
+			}
+		}
+
+		result.win = (float) tally.wins / rollouts;
+		result.loss = (float) tally.losses / rollouts;
+
+		for (uint32_t j = 0; j < 2; j++)
+		{
+			result.hp[j] = (float) tally.hp[j] / rollouts;
+
+			if (tally.kills[j] > 0)
+				result.kill_rounds[j] = (float) tally.kill_rounds[j] / tally.kills[j];
+		}
+	}
+
+	for (uint32_t i = 0; work != NULL && i < result.threads; i++)
+	{
+		free(work[i].worker.stamps);
+		free(work[i].worker.moves);
+	}
+
+	free(work);
+	free(board.open);
+	free(search);
+
+	result.seconds = (SDL_GetTicks() - start_ticks) / 1000.0f;
+
+	return result;
+}
@@ -0,0 +1,103 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef AI_H
+#define AI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+#include "mercs.h"
+#include "town.h"
+#include "sim.h"
+
+#define AI_MAX_THREADS 16
+#define AI_MAX_DEPTH 16		/* merc actions looked ahead */
+
+static const uint32_t AI_TABLE_SIZE = 1 << 16;	/* transposition entries per thread */
+static const uint32_t AI_BOARD_MARGIN = 12;		/* fields searched around the mercs */
+
+static const uint32_t AI_ESTIMATE_ROLLOUTS = 20000;
+static const uint32_t AI_MAX_ESTIMATE_ROLLOUTS = 10000000;
+static const uint32_t AI_ESTIMATE_ROUNDS = 10;			/* a fight lasts at most */
+static const uint32_t AI_ESTIMATE_WILD = 4;				/* one in this many moves is random */
+static const uint32_t AI_ESTIMATE_MIN_PER_THREAD = 256;
+
+/* what one merc does in its turn, it moves first and then attacks */
+typedef struct AiAction
+{
+	SDL_Point src;
+	SDL_Point dest;			/* src if the merc stays */
+	bool attack;
+	uint8_t weapon_slot;
+	SDL_Point target;
+} AiAction ;
+
+typedef struct AiPlan
+{
+	bool invalid;
+	uint32_t action_count;
+	AiAction actions[MERCENARY_COUNT];	/* in the order they are played */
+
+	/* statistics of the search */
+	uint32_t depth;			/* least completed depth of all actions */
+	uint64_t nodes;
+	uint32_t threads;
+} AiPlan ;
+
+/* plans the turn of fraction by alpha-beta search on a board read from town,
+	which may page in chunks, so call it from the thread that owns town.
+	The search never touches town itself. The root moves are shared among all cores,
+	each with its own transposition table, and the search deepens
+	until budget_ms ran out. At most max_threads cores are used, 0 for all. */
+AiPlan Ai_plan(
+	Town *town,
+	const MercFraction fraction,
+	const uint32_t budget_ms,
+	const uint32_t max_threads );
+
+/* plays plan through the rules of sim, returns how many actions were accepted */
+uint32_t Ai_play( Sim *sim, const AiPlan *plan );
+
+/* outcomes of many randomized fights between two mercs */
+typedef struct AiEstimate
+{
+	bool invalid;
+	uint32_t rollouts;
+	uint32_t threads;
+	float seconds;
+
+	/* index 0 is the attacker, 1 the defender */
+	float win;					/* chance the defender dies */
+	float loss;					/* chance the attacker dies */
+	float hp[2];				/* expected hp left */
+	float kill_rounds[2];		/* expected rounds to kill the other, of the fights it did, else 0 */
+} AiEstimate ;
+
+/* plays rollouts fights of at most AI_ESTIMATE_ROUNDS rounds between the mercs
+	at attacker and defender on a board read from town like Ai_plan does, spread over all cores.
+	The attacker acts first, both sides mostly pick their strongest move and
+	now and then any. Other mercs only block fields.
+	Sets invalid if there is no pair of enemies at the coords. */
+AiEstimate Ai_estimate(
+	Town *town,
+	const SDL_Point attacker,
+	const SDL_Point defender,
+	const uint32_t rollouts );
+
+#endif /* AI_H */
@@ -0,0 +1,594 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <SM_string.h>
+#include "path.h"
+#include "buffer.h"
+#include "checksum.h"
+#include "backup.h"
+
+typedef struct ManifestEntry
+{
+	uint8_t file;
+	uint64_t hash;
+	uint32_t len;
+} ManifestEntry ;
+
+typedef struct Manifest
+{
+	BackupInfo info;
+	uint32_t entry_count;
+	ManifestEntry *entries;
+} Manifest ;
+
+static bool has_suffix( const char *name, const char *filetype )
+{
+	const size_t name_len = strlen(name);
+	const size_t type_len = strlen(filetype);
+
+	return name_len > type_len + 1 &&
+		name[name_len - type_len - 1] == '.' &&
+		strcmp(&name[name_len - type_len], filetype) == 0;
+}
+
+static void manifest_path( SM_String *out, const SM_String *dir, const uint32_t seq )
+{
+	char name[32];
+
+	sprintf(name, "%010" PRIu32 ".%s", seq, FILETYPE_BACKUP_MANIFEST);
+	SM_String_copy(out, dir);
+	SM_String_append_cstr(out, name);
+}
+
+static void chunk_path( SM_String *out, const SM_String *dir, const uint64_t hash )
+{
+	char name[32];
+
+	sprintf(name, "%016" PRIx64 ".%s", hash, FILETYPE_BACKUP_CHUNK);
+	SM_String_copy(out, dir);
+	SM_String_append_cstr(out, name);
+}
+
+static void Manifest_clear( Manifest *manifest )
+{
+	free(manifest->entries);
+	manifest->entries = NULL;
+	manifest->entry_count = 0;
+}
+
+/* version 1 manifests only list pieces of the town file */
+static bool Manifest_read( Manifest *manifest, const char *filepath )
+{
+	Buffer buf = Buffer_from_file(filepath);
+	const uint8_t *magic;
+	uint16_t version = 0;
+
+	manifest->entry_count = 0;
+	manifest->entries = NULL;
+
+	/* trailing checksum */
+	if (buf.invalid ||
+		buf.len < BACKUP_MANIFEST_HEADER_SIZE + sizeof(uint32_t) ||
+		Buffer_get_u32(&buf.data[buf.len - sizeof(uint32_t)]) !=
+		crc32c(buf.data, buf.len - sizeof(uint32_t)))
+	{
+		Buffer_clear(&buf);
+		return false;
+	}
+
+	buf.len -= sizeof(uint32_t);
+	magic = Buffer_view(&buf, sizeof(BACKUP_MANIFEST_MAGIC));
+
+	if (magic != NULL)
+		version = Buffer_read_u16(&buf);
+
+	if (magic == NULL ||
+		memcmp(magic, BACKUP_MANIFEST_MAGIC, sizeof(BACKUP_MANIFEST_MAGIC)) != 0 ||
+		version < 1 || version > BACKUP_MANIFEST_VERSION)
+	{
+		Buffer_clear(&buf);
+		return false;
+	}
+
+	manifest->info.invalid = false;
+	manifest->info.seq = Buffer_read_u32(&buf);
+	manifest->info.generation = Buffer_read_u32(&buf);
+	manifest->info.round = Buffer_read_u32(&buf);
+	manifest->info.money = Buffer_read_u32(&buf);
+	manifest->entry_count = (version == 1) ? Buffer_read_u16(&buf) : Buffer_read_u32(&buf);
+
+	if (buf.invalid ||
+		(buf.len - buf.pos) != (size_t) manifest->entry_count *
+		((version == 1) ? BACKUP_MANIFEST_ENTRY_SIZE : BACKUP_MANIFEST_ENTRY_SIZE_V2))
+	{
+		buf.invalid = true;
+	}
+	else if (manifest->entry_count > 0)
+	{
+		manifest->entries = malloc(manifest->entry_count * sizeof(ManifestEntry));
+		buf.invalid = (manifest->entries == NULL);
+	}
+
+	for (uint32_t i = 0; i < manifest->entry_count && buf.invalid == false; i++)
+	{
+		manifest->entries[i].file = (version == 1) ? BF_TOWN : Buffer_read_u8(&buf);
+		manifest->entries[i].hash = Buffer_read_u64(&buf);
+		manifest->entries[i].len = Buffer_read_u32(&buf);
+
+		if (manifest->entries[i].file > BF_LAST)
+			buf.invalid = true;
+	}
+
+	if (buf.pos != buf.len)
+		buf.invalid = true;
+
+	manifest->info.invalid = buf.invalid;
+	Buffer_clear(&buf);
+
+	if (manifest->info.invalid)
+		Manifest_clear(manifest);
+
+	return (manifest->info.invalid == false);
+}
+
+static bool Manifest_write( const Manifest *manifest, const char *filepath )
+{
+	Buffer buf = Buffer_new(BACKUP_MANIFEST_HEADER_SIZE_V2 +
+		manifest->entry_count * BACKUP_MANIFEST_ENTRY_SIZE_V2 + sizeof(uint32_t));
+	SM_String filepath_tmp = SM_String_from(filepath);
+	bool result;
+
+	SM_String_append_cstr(&filepath_tmp, ".");
+	SM_String_append_cstr(&filepath_tmp, FILETYPE_TEMP);
+
+	Buffer_write(&buf, BACKUP_MANIFEST_MAGIC, sizeof(BACKUP_MANIFEST_MAGIC));
+	Buffer_write_u16(&buf, BACKUP_MANIFEST_VERSION);
+	Buffer_write_u32(&buf, manifest->info.seq);
+	Buffer_write_u32(&buf, manifest->info.generation);
+	Buffer_write_u32(&buf, manifest->info.round);
+	Buffer_write_u32(&buf, manifest->info.money);
+	Buffer_write_u32(&buf, manifest->entry_count);
+
+	for (uint32_t i = 0; i < manifest->entry_count; i++)
+	{
+		Buffer_write_u8(&buf, manifest->entries[i].file);
+		Buffer_write_u64(&buf, manifest->entries[i].hash);
+		Buffer_write_u32(&buf, manifest->entries[i].len);
+	}
+
+	Buffer_write_u32(&buf, crc32c(buf.data, buf.len));
+
+	result = (buf.invalid == false) && Buffer_to_file(&buf, filepath, filepath_tmp.str);
+
+	Buffer_clear(&buf);
+	SM_String_clear(&filepath_tmp);
+
+	return result;
+}
+
+static int compare_seq( const void *a, const void *b )
+{
+	const BackupInfo *info_a = a;
+	const BackupInfo *info_b = b;
+
+	return (info_a->seq > info_b->seq) - (info_a->seq < info_b->seq);
+}
+
+/* reads all manifests in dir, sorted by ascending seq */
+static uint32_t list_manifests( const SM_String *dir, BackupInfo *out, const uint32_t max )
+{
+	DIR *d = opendir(dir->str);
+	struct dirent *d_ent;
+	SM_String filepath = SM_String_new(16);
+	Manifest manifest;
+	uint32_t count = 0;
+
+	if (d == NULL)
+	{
+		SM_String_clear(&filepath);
+		return 0;
+	}
+
+	while ((d_ent = readdir(d)) != NULL && count < max)
+	{
+		if (has_suffix(d_ent->d_name, FILETYPE_BACKUP_MANIFEST) == false)
+			continue;
+
+		SM_String_copy(&filepath, dir);
+		SM_String_append_cstr(&filepath, d_ent->d_name);
+
+		if (Manifest_read(&manifest, filepath.str))
+		{
+			out[count] = manifest.info;
+			count++;
+			Manifest_clear(&manifest);
+		}
+	}
+
+	closedir(d);
+	SM_String_clear(&filepath);
+
+	qsort(out, count, sizeof(BackupInfo), compare_seq);
+
+	return count;
+}
+
+/* removes every chunk no remaining manifest refers to */
+static void collect_garbage( const SM_String *dir, const BackupInfo *infos, const uint32_t count )
+{
+	SM_String filepath = SM_String_new(16);
+	Manifest manifest;
+	uint64_t *used = NULL;
+	uint64_t *grown;
+	uint32_t used_count = 0;
+	DIR *d;
+	struct dirent *d_ent;
+	uint64_t hash;
+	bool referenced;
+
+	/* mark */
+	for (uint32_t i = 0; i < count; i++)
+	{
+		manifest_path(&filepath, dir, infos[i].seq);
+
+		/* if unsure what is used, keep everything */
+		if (Manifest_read(&manifest, filepath.str) == false)
+			goto collect_garbage_clear;
+
+		grown = realloc(used, (used_count + manifest.entry_count) * sizeof(uint64_t) + 1);
+
+		if (grown == NULL)
+		{
+			Manifest_clear(&manifest);
+			goto collect_garbage_clear;
+		}
+
+		used = grown;
+
+		for (uint32_t j = 0; j < manifest.entry_count; j++)
+		{
+			used[used_count] = manifest.entries[j].hash;
+			used_count++;
+		}
+
+		Manifest_clear(&manifest);
+	}
+
+	/* sweep */
+	d = opendir(dir->str);
+
+	if (d == NULL)
+		goto collect_garbage_clear;
+
+	while ((d_ent = readdir(d)) != NULL)
+	{
+		if (has_suffix(d_ent->d_name, FILETYPE_BACKUP_CHUNK) == false)
+			continue;
+
+		hash = strtoull(d_ent->d_name, NULL, 16);
+		referenced = false;
+
+		for (uint32_t i = 0; i < used_count; i++)
+		{
+			if (used[i] == hash)
+			{
+				referenced = true;
+				break;
+			}
+		}
+
+		if (referenced)
+			continue;
+
+		SM_String_copy(&filepath, dir);
+		SM_String_append_cstr(&filepath, d_ent->d_name);
+		remove(filepath.str);
+	}
+
+	closedir(d);
+
+	collect_garbage_clear:
+
+	free(used);
+	SM_String_clear(&filepath);
+}
+
+bool Backup_store(
+	const char *town_name,
+	const BackupPiece *pieces,
+	const uint32_t piece_count,
+	BackupFetch fetch,
+	void *ctx,
+	BackupInfo info,
+	const uint32_t keep )
+{
+	SM_String dir = SM_String_new(16);
+	SM_String filepath = SM_String_new(16);
+	SM_String filepath_tmp = SM_String_new(16);
+	BackupInfo *infos = malloc(BACKUP_MAX_LISTED * sizeof(BackupInfo));
+	Manifest manifest = {
+		.entry_count = 0,
+		.entries = NULL,
+	};
+	Buffer piece;
+	FILE *f;
+	uint32_t count;
+	uint32_t excess;
+	bool result = true;
+
+	if (infos == NULL || get_town_backup_path(&dir, town_name) != 0)
+	{
+		result = false;
+		goto backup_store_clear;
+	}
+
+	count = list_manifests(&dir, infos, BACKUP_MAX_LISTED);
+
+	if (keep > 0)
+	{
+		manifest.entries = malloc(piece_count * sizeof(ManifestEntry) + 1);
+
+		if (manifest.entries == NULL)
+		{
+			result = false;
+			goto backup_store_clear;
+		}
+
+		/* store pieces not yet known */
+		manifest.entry_count = piece_count;
+
+		for (uint32_t i = 0; i < piece_count; i++)
+		{
+			manifest.entries[i].file = pieces[i].file;
+			manifest.entries[i].hash = pieces[i].hash;
+			manifest.entries[i].len = pieces[i].len;
+			chunk_path(&filepath, &dir, pieces[i].hash);
+
+			f = fopen(filepath.str, "rb");
+
+			if (f != NULL)
+			{
+				fclose(f);
+				continue;
+			}
+
+			/* view on the caller's data, or a fetched copy */
+			if (pieces[i].data != NULL)
+			{
+				piece = Buffer_new(0);
+				piece.data = (uint8_t*) pieces[i].data;
+				piece.len = pieces[i].len;
+				piece.size = pieces[i].len;
+			}
+			else if (fetch(ctx, &pieces[i], &piece) == false)
+			{
+				result = false;
+				goto backup_store_clear;
+			}
+
+			SM_String_copy(&filepath_tmp, &filepath);
+			SM_String_append_cstr(&filepath_tmp, ".");
+			SM_String_append_cstr(&filepath_tmp, FILETYPE_TEMP);
+
+			result = (piece.len == pieces[i].len) &&
+				Buffer_to_file(&piece, filepath.str, filepath_tmp.str);
+
+			if (pieces[i].data == NULL)
+				Buffer_clear(&piece);
+
+			if (result == false)
+				goto backup_store_clear;
+		}
+
+		/* manifest goes last, so it never points to missing pieces */
+		info.seq = (count > 0) ? infos[count - 1].seq + 1 : 0;
+		manifest.info = info;
+		manifest_path(&filepath, &dir, info.seq);
+
+		if (Manifest_write(&manifest, filepath.str) == false)
+		{
+			result = false;
+			goto backup_store_clear;
+		}
+
+		if (count < BACKUP_MAX_LISTED)
+		{
+			infos[count] = info;
+			count++;
+		}
+	}
+
+	/* drop oldest backups beyond ring size */
+	if (count <= keep)
+		goto backup_store_clear;
+
+	excess = count - keep;
+
+	for (uint32_t i = 0; i < excess; i++)
+	{
+		manifest_path(&filepath, &dir, infos[i].seq);
+		remove(filepath.str);
+	}
+
+	collect_garbage(&dir, &infos[excess], keep);
+
+	backup_store_clear:
+
+	Manifest_clear(&manifest);
+	free(infos);
+	SM_String_clear(&dir);
+	SM_String_clear(&filepath);
+	SM_String_clear(&filepath_tmp);
+
+	return result;
+}
+
+uint32_t Backup_list( const char *town_name, BackupInfo *out, const uint32_t max )
+{
+	SM_String dir = SM_String_new(16);
+	uint32_t result = 0;
+
+	if (get_town_backup_path(&dir, town_name) == 0)
+		result = list_manifests(&dir, out, max);
+
+	SM_String_clear(&dir);
+
+	return result;
+}
+
+bool Backup_restore( const char *town_name, const uint32_t seq )
+{
+	static const char *const FILETYPES[BF_LAST + 1] = {
+		[BF_TOWN] = FILETYPE_TOWN,
+		[BF_CHUNKS] = FILETYPE_CHUNKS,
+	};
+	SM_String dir = SM_String_new(16);
+	SM_String filepath = SM_String_new(16);
+	SM_String filepath_tmp = SM_String_new(16);
+	Manifest manifest = {
+		.entry_count = 0,
+		.entries = NULL,
+	};
+	Buffer images[BF_LAST + 1];
+	Buffer chunk;
+	bool result = false;
+
+	for (uint32_t i = 0; i <= BF_LAST; i++)
+		images[i] = Buffer_new(0);
+
+	if (get_town_backup_path(&dir, town_name) != 0)
+		goto backup_restore_clear;
+
+	manifest_path(&filepath, &dir, seq);
+
+	if (Manifest_read(&manifest, filepath.str) == false)
+		goto backup_restore_clear;
+
+	/* reassemble files, every piece must match its name */
+	for (uint32_t i = 0; i < manifest.entry_count; i++)
+	{
+		chunk_path(&filepath, &dir, manifest.entries[i].hash);
+		chunk = Buffer_from_file(filepath.str);
+
+		if (chunk.invalid ||
+			chunk.len != manifest.entries[i].len ||
+			fnv1a64(chunk.data, chunk.len) != manifest.entries[i].hash)
+		{
+			Buffer_clear(&chunk);
+			goto backup_restore_clear;
+		}
+
+		Buffer_write(&images[manifest.entries[i].file], chunk.data, chunk.len);
+		Buffer_clear(&chunk);
+	}
+
+	if (images[BF_TOWN].len == 0)
+		goto backup_restore_clear;
+
+	/* town file last, it refers to the others */
+	for (int32_t i = BF_LAST; i >= 0; i--)
+	{
+		SM_String_copy_cstr(&filepath, "");
+
+		if (images[i].invalid ||
+			get_town_file_path(&filepath, town_name, FILETYPES[i]) != 0)
+		{
+			goto backup_restore_clear;
+		}
+
+		/* backups of older saves lack some files */
+		if (images[i].len == 0)
+		{
+			remove(filepath.str);
+			continue;
+		}
+
+		SM_String_copy(&filepath_tmp, &filepath);
+		SM_String_append_cstr(&filepath_tmp, ".");
+		SM_String_append_cstr(&filepath_tmp, FILETYPE_TEMP);
+
+		if (Buffer_to_file(&images[i], filepath.str, filepath_tmp.str) == false)
+			goto backup_restore_clear;
+	}
+
+	/* the journal continues the replaced save, not this one */
+	SM_String_copy_cstr(&filepath, "");
+
+	if (get_town_file_path(&filepath, town_name, FILETYPE_JOURNAL) == 0)
+		remove(filepath.str);
+
+	result = true;
+
+	backup_restore_clear:
+
+	for (uint32_t i = 0; i <= BF_LAST; i++)
+		Buffer_clear(&images[i]);
+
+	Manifest_clear(&manifest);
+	SM_String_clear(&dir);
+	SM_String_clear(&filepath);
+	SM_String_clear(&filepath_tmp);
+
+	return result;
+}
+
+bool Backup_delete_all( const char *town_name )
+{
+	SM_String dir = SM_String_new(16);
+	SM_String filepath = SM_String_new(16);
+	DIR *d;
+	struct dirent *d_ent;
+	bool result = false;
+
+	if (get_town_backup_path(&dir, town_name) != 0)
+		goto backup_delete_all_clear;
+
+	d = opendir(dir.str);
+
+	if (d == NULL)
+		goto backup_delete_all_clear;
+
+	while ((d_ent = readdir(d)) != NULL)
+	{
+		if (strcmp(d_ent->d_name, ".") == 0 || strcmp(d_ent->d_name, "..") == 0)
+			continue;
+
+		SM_String_copy(&filepath, &dir);
+		SM_String_append_cstr(&filepath, d_ent->d_name);
+		remove(filepath.str);
+	}
+
+	closedir(d);
+
+	result = (rmdir(dir.str) == 0);
+
+	backup_delete_all_clear:
+
+	SM_String_clear(&dir);
+	SM_String_clear(&filepath);
+
+	return result;
+}
@@ -0,0 +1,81 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "buffer.h"
+
+/* every backup is a manifest listing pieces of the town's files,
+	pieces are named by their content and shared between backups */
+static const char BACKUP_MANIFEST_MAGIC[4] = {'R', 'C', 'B', 'M'};
+static const uint16_t BACKUP_MANIFEST_VERSION = 2;
+#define BACKUP_MANIFEST_HEADER_SIZE		24
+#define BACKUP_MANIFEST_HEADER_SIZE_V2	26
+#define BACKUP_MANIFEST_ENTRY_SIZE		12
+#define BACKUP_MANIFEST_ENTRY_SIZE_V2	13
+#define BACKUP_MAX_LISTED				256
+
+/* files a piece belongs to, never reorder */
+typedef enum BackupFile
+{
+	BF_TOWN,
+	BF_CHUNKS,
+	BF_LAST = BF_CHUNKS
+} BackupFile ;
+
+/* data may be NULL, then it is fetched only if no backup has the piece yet */
+typedef struct BackupPiece
+{
+	uint8_t file;
+	uint64_t hash;
+	uint32_t len;
+	const uint8_t *data;
+	uint32_t tag;			/* passed on to fetch */
+} BackupPiece ;
+
+typedef bool (*BackupFetch)( void *ctx, const BackupPiece *piece, Buffer *out );
+
+typedef struct BackupInfo
+{
+	bool invalid;
+	uint32_t seq;			/* ascending, names the manifest */
+	uint32_t generation;
+	uint32_t round;
+	uint32_t money;
+} BackupInfo ;
+
+bool Backup_store(
+	const char *town_name,
+	const BackupPiece *pieces,
+	const uint32_t piece_count,
+	BackupFetch fetch,
+	void *ctx,
+	BackupInfo info,
+	const uint32_t keep );
+
+uint32_t Backup_list( const char *town_name, BackupInfo *out, const uint32_t max );
+
+bool Backup_restore( const char *town_name, const uint32_t seq );
+
+bool Backup_delete_all( const char *town_name );
+
+#endif /* BACKUP_H */
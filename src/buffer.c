@@ -0,0 +1,439 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "buffer.h"
+
+Buffer Buffer_new( const size_t size )
+{
+	Buffer result = {
+		.invalid = false,
+		.len = 0,
+		.size = size,
+		.pos = 0,
+		.mapped = false,
+	};
+
+	if (size > 0)
+	{
+		result.data = malloc(size);
+
+		if (result.data == NULL)
+			result.invalid = true;
+	}
+	else
+	{
+		result.data = NULL;
+	}
+
+	return result;
+}
+
+Buffer Buffer_from_file( const char *filepath )
+{
+	Buffer result = Buffer_new(0);
+	FILE *f;
+	long file_len;
+
+	f = fopen(filepath, "rb");
+
+	if (f == NULL)
+	{
+		result.invalid = true;
+		return result;
+	}
+
+	/* get size */
+	if (fseek(f, 0, SEEK_END) != 0 ||
+		(file_len = ftell(f)) < 0 ||
+		fseek(f, 0, SEEK_SET) != 0)
+	{
+		result.invalid = true;
+		fclose(f);
+		return result;
+	}
+
+	/* read whole file at once */
+	result.data = malloc(file_len > 0 ? file_len : 1);
+	result.size = file_len;
+
+	if (result.data == NULL ||
+		fread(result.data, 1, file_len, f) != (size_t) file_len)
+	{
+		result.invalid = true;
+	}
+	else
+	{
+		result.len = file_len;
+	}
+
+	fclose(f);
+	return result;
+}
+
+Buffer Buffer_map_file( const char *filepath )
+{
+#ifdef _WIN32
+	return Buffer_from_file(filepath);
+#else
+	Buffer result = Buffer_new(0);
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(filepath, O_RDONLY);
+
+	if (fd < 0)
+	{
+		result.invalid = true;
+		return result;
+	}
+
+	if (fstat(fd, &st) != 0)
+	{
+		result.invalid = true;
+		close(fd);
+		return result;
+	}
+
+	/* empty files can not be mapped, but are a valid (empty) view */
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return result;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+	{
+		result.invalid = true;
+		return result;
+	}
+
+	result.data = map;
+	result.len = st.st_size;
+	result.size = st.st_size;
+	result.mapped = true;
+
+	return result;
+#endif /* _WIN32 */
+}
+
+void Buffer_write( Buffer *buf, const void *data, const size_t len )
+{
+	uint8_t *new_data;
+	size_t new_size;
+
+	if (buf->invalid)
+		return;
+
+	/* grow */
+	if (buf->len + len > buf->size)
+	{
+		new_size = (buf->size > 0) ? buf->size : 64;
+
+		while (new_size < buf->len + len)
+			new_size *= 2;
+
+		new_data = realloc(buf->data, new_size);
+
+		if (new_data == NULL)
+		{
+			buf->invalid = true;
+			return;
+		}
+
+		buf->data = new_data;
+		buf->size = new_size;
+	}
+
+	memcpy(&buf->data[buf->len], data, len);
+	buf->len += len;
+}
+
+/* fixed width values are always stored little-endian */
+
+void Buffer_write_u8( Buffer *buf, const uint8_t val )
+{
+	Buffer_write(buf, &val, sizeof(val));
+}
+
+void Buffer_write_u16( Buffer *buf, const uint16_t val )
+{
+	const uint8_t bytes[2] = {
+		val & 0xFF,
+		(val >> 8) & 0xFF,
+	};
+
+	Buffer_write(buf, bytes, sizeof(bytes));
+}
+
+void Buffer_write_u32( Buffer *buf, const uint32_t val )
+{
+	const uint8_t bytes[4] = {
+		val & 0xFF,
+		(val >> 8) & 0xFF,
+		(val >> 16) & 0xFF,
+		(val >> 24) & 0xFF,
+	};
+
+	Buffer_write(buf, bytes, sizeof(bytes));
+}
+
+void Buffer_write_u64( Buffer *buf, const uint64_t val )
+{
+	Buffer_write_u32(buf, val & 0xFFFFFFFF);
+	Buffer_write_u32(buf, val >> 32);
+}
+
+void Buffer_patch_u16( Buffer *buf, const size_t pos, const uint16_t val )
+{
+	if (buf->invalid || pos + 2 > buf->len)
+	{
+		buf->invalid = true;
+		return;
+	}
+
+	buf->data[pos] = val & 0xFF;
+	buf->data[pos + 1] = (val >> 8) & 0xFF;
+}
+
+void Buffer_patch_u32( Buffer *buf, const size_t pos, const uint32_t val )
+{
+	if (buf->invalid || pos + 4 > buf->len)
+	{
+		buf->invalid = true;
+		return;
+	}
+
+	buf->data[pos] = val & 0xFF;
+	buf->data[pos + 1] = (val >> 8) & 0xFF;
+	buf->data[pos + 2] = (val >> 16) & 0xFF;
+	buf->data[pos + 3] = (val >> 24) & 0xFF;
+}
+
+/* a slice is a read-only view on buf and does not own its data,
+	never clear it */
+Buffer Buffer_slice( const Buffer *buf, const size_t offset, const size_t len )
+{
+	Buffer result = Buffer_new(0);
+
+	if (buf->invalid || offset > buf->len || len > buf->len - offset)
+	{
+		result.invalid = true;
+		return result;
+	}
+
+	result.data = &buf->data[offset];
+	result.len = len;
+	result.size = len;
+
+	return result;
+}
+
+void Buffer_read( Buffer *buf, void *out, const size_t len )
+{
+	const uint8_t *data = Buffer_view(buf, len);
+
+	/* on failure leave out untouched */
+	if (data != NULL)
+		memcpy(out, data, len);
+}
+
+const uint8_t* Buffer_view( Buffer *buf, const size_t len )
+{
+	const uint8_t *result;
+
+	/* bounds check, on failure return NULL */
+	if (buf->invalid || buf->pos > buf->len || len > buf->len - buf->pos)
+	{
+		buf->invalid = true;
+		return NULL;
+	}
+
+	result = &buf->data[buf->pos];
+	buf->pos += len;
+
+	return result;
+}
+
+uint8_t Buffer_read_u8( Buffer *buf )
+{
+	const uint8_t *bytes = Buffer_view(buf, 1);
+
+	if (bytes == NULL)
+		return 0;
+
+	return bytes[0];
+}
+
+uint16_t Buffer_read_u16( Buffer *buf )
+{
+	const uint8_t *bytes = Buffer_view(buf, 2);
+
+	if (bytes == NULL)
+		return 0;
+
+	return Buffer_get_u16(bytes);
+}
+
+uint32_t Buffer_read_u32( Buffer *buf )
+{
+	const uint8_t *bytes = Buffer_view(buf, 4);
+
+	if (bytes == NULL)
+		return 0;
+
+	return Buffer_get_u32(bytes);
+}
+
+uint64_t Buffer_read_u64( Buffer *buf )
+{
+	const uint64_t low = Buffer_read_u32(buf);
+
+	return low | ((uint64_t) Buffer_read_u32(buf) << 32);
+}
+
+uint16_t Buffer_get_u16( const uint8_t *data )
+{
+	return (uint16_t) (data[0] | (data[1] << 8));
+}
+
+uint32_t Buffer_get_u32( const uint8_t *data )
+{
+	return (uint32_t) data[0] |
+		((uint32_t) data[1] << 8) |
+		((uint32_t) data[2] << 16) |
+		((uint32_t) data[3] << 24);
+}
+
+static void sync_parent_dir( const char *filepath )
+{
+#ifndef _WIN32
+	char *dirpath = strdup(filepath);
+	char *slash;
+	int fd;
+
+	if (dirpath == NULL)
+		return;
+
+	slash = strrchr(dirpath, '/');
+
+	if (slash != NULL)
+	{
+		slash[1] = '\0';
+		fd = open(dirpath, O_RDONLY);
+
+		if (fd >= 0)
+		{
+			fsync(fd);
+			close(fd);
+		}
+	}
+
+	free(dirpath);
+#else
+	(void) filepath;
+#endif
+}
+
+bool Buffer_to_file( const Buffer *buf, const char *filepath, const char *filepath_tmp )
+{
+	FILE *f;
+	bool success;
+
+	if (buf->invalid)
+		return false;
+
+	/* write everything into temp file with a single call */
+	f = fopen(filepath_tmp, "wb");
+
+	if (f == NULL)
+		return false;
+
+	success = (fwrite(buf->data, 1, buf->len, f) == buf->len);
+	success = success && (fflush(f) == 0);
+
+	/* make sure data is on disk, before it replaces the old file */
+#ifdef _WIN32
+	success = success && (_commit(_fileno(f)) == 0);
+#else
+	success = success && (fsync(fileno(f)) == 0);
+#endif
+
+	if (fclose(f) != 0)
+		success = false;
+
+	if (success == false)
+	{
+		remove(filepath_tmp);
+		return false;
+	}
+
+	/* atomically replace */
+#ifdef _WIN32
+	remove(filepath);
+#endif
+
+	if (rename(filepath_tmp, filepath) != 0)
+	{
+		remove(filepath_tmp);
+		return false;
+	}
+
+	sync_parent_dir(filepath);
+
+	return true;
+}
+
+void Buffer_clear( Buffer *buf )
+{
+#ifndef _WIN32
+	if (buf->mapped)
+		munmap(buf->data, buf->size);
+	else
+		free(buf->data);
+#else
+	free(buf->data);
+#endif
+
+	buf->mapped = false;
+	buf->data = NULL;
+	buf->len = 0;
+	buf->size = 0;
+	buf->pos = 0;
+}
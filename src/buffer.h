@@ -0,0 +1,78 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct Buffer
+{
+	bool invalid;
+	uint8_t *data;
+	size_t len;
+	size_t size;
+	size_t pos;		/* read cursor */
+	bool mapped;	/* data is a read-only file mapping */
+} Buffer ;
+
+Buffer Buffer_new( const size_t size );
+
+Buffer Buffer_from_file( const char *filepath );
+
+Buffer Buffer_map_file( const char *filepath );
+
+void Buffer_write( Buffer *buf, const void *data, const size_t len );
+
+void Buffer_write_u8( Buffer *buf, const uint8_t val );
+
+void Buffer_write_u16( Buffer *buf, const uint16_t val );
+
+void Buffer_write_u32( Buffer *buf, const uint32_t val );
+
+void Buffer_write_u64( Buffer *buf, const uint64_t val );
+
+void Buffer_patch_u16( Buffer *buf, const size_t pos, const uint16_t val );
+
+void Buffer_patch_u32( Buffer *buf, const size_t pos, const uint32_t val );
+
+Buffer Buffer_slice( const Buffer *buf, const size_t offset, const size_t len );
+
+void Buffer_read( Buffer *buf, void *out, const size_t len );
+
+const uint8_t* Buffer_view( Buffer *buf, const size_t len );
+
+uint8_t Buffer_read_u8( Buffer *buf );
+
+uint16_t Buffer_read_u16( Buffer *buf );
+
+uint32_t Buffer_read_u32( Buffer *buf );
+
+uint64_t Buffer_read_u64( Buffer *buf );
+
+uint16_t Buffer_get_u16( const uint8_t *data );
+
+uint32_t Buffer_get_u32( const uint8_t *data );
+
+bool Buffer_to_file( const Buffer *buf, const char *filepath, const char *filepath_tmp );
+
+void Buffer_clear( Buffer *buf );
+
+#endif /* BUFFER_H */
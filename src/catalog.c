@@ -0,0 +1,552 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <SDL.h>
+#include <SM_string.h>
+#include "admins.h"
+#include "path.h"
+#include "buffer.h"
+#include "checksum.h"
+#include "town.h"
+#include "catalog.h"
+
+static const char *CATALOG_SORT_NAMES[] = {
+	"name",
+	"admin",
+	"round",
+	"money",
+	"mercs",
+};
+
+/* appends from several threads of this process must not interleave */
+static SDL_SpinLock catalog_lock = 0;
+
+typedef struct CatalogJob
+{
+	CatalogEntry **stale;
+	int count;
+	SDL_atomic_t next;
+} CatalogJob ;
+
+bool str_to_catalog_sort( const char *str, CatalogSort *sort )
+{
+	for (uint_fast32_t i = 0; i <= CS_LAST; i++)
+	{
+		if (strcmp(str, CATALOG_SORT_NAMES[i]) == 0)
+		{
+			*sort = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool stat_town( const char *town_name, int64_t *mtime, uint32_t *size )
+{
+	SM_String filepath = SM_String_new(16);
+	struct stat st;
+	bool result = false;
+
+	if (get_town_file_path(&filepath, town_name, FILETYPE_TOWN) == 0 &&
+		stat(filepath.str, &st) == 0)
+	{
+		*mtime = st.st_mtime;
+		*size = st.st_size;
+		result = true;
+	}
+
+	SM_String_clear(&filepath);
+
+	return result;
+}
+
+static void Catalog_write_entry( Buffer *buf, const CatalogEntry *entry )
+{
+	const size_t begin = buf->len;
+	const size_t name_len = strlen(entry->name);
+
+	Buffer_write_u8(buf, name_len);
+	Buffer_write(buf, entry->name, name_len);
+	Buffer_write_u8(buf, entry->header.invalid);
+	Buffer_write_u8(buf, entry->header.admin_id);
+	Buffer_write_u32(buf, entry->header.round);
+	Buffer_write_u32(buf, entry->header.money);
+	Buffer_write_u8(buf, entry->header.merc_count);
+	Buffer_write_u32(buf, entry->header.generation);
+	Buffer_write_u16(buf, entry->header.width);
+	Buffer_write_u16(buf, entry->header.height);
+	Buffer_write_u64(buf, entry->mtime);
+	Buffer_write_u32(buf, entry->size);
+
+	if (buf->invalid == false)
+		Buffer_write_u32(buf, crc32c(&buf->data[begin], buf->len - begin));
+}
+
+/* returns false at the end or at a torn record */
+static bool Catalog_read_entry( Buffer *buf, CatalogEntry *entry )
+{
+	const size_t begin = buf->pos;
+	const uint8_t *name;
+	uint8_t name_len;
+
+	name_len = Buffer_read_u8(buf);
+	name = Buffer_view(buf, name_len);
+
+	if (name == NULL)
+		return false;
+
+	memcpy(entry->name, name, name_len);
+	entry->name[name_len] = '\0';
+
+	entry->header.invalid = Buffer_read_u8(buf);
+	entry->header.admin_id = Buffer_read_u8(buf);
+	entry->header.round = Buffer_read_u32(buf);
+	entry->header.money = Buffer_read_u32(buf);
+	entry->header.merc_count = Buffer_read_u8(buf);
+	entry->header.generation = Buffer_read_u32(buf);
+	entry->header.width = Buffer_read_u16(buf);
+	entry->header.height = Buffer_read_u16(buf);
+	entry->mtime = Buffer_read_u64(buf);
+	entry->size = Buffer_read_u32(buf);
+
+	if (buf->invalid ||
+		Buffer_read_u32(buf) != crc32c(&buf->data[begin], buf->pos - 4 - begin) ||
+		buf->invalid)
+	{
+		return false;
+	}
+
+	if (entry->header.admin_id >= (sizeof(DATA_ADMINS) / sizeof(DATA_ADMINS[0])))
+		entry->header.invalid = true;
+
+	return true;
+}
+
+static void Catalog_add( Catalog *catalog, const CatalogEntry *entry )
+{
+	CatalogEntry *new_entries;
+	size_t new_size;
+
+	if (catalog->invalid)
+		return;
+
+	if (catalog->count == catalog->size)
+	{
+		new_size = (catalog->size > 0) ? catalog->size * 2 : 64;
+		new_entries = realloc(catalog->entries, new_size * sizeof(CatalogEntry));
+
+		if (new_entries == NULL)
+		{
+			catalog->invalid = true;
+			return;
+		}
+
+		catalog->entries = new_entries;
+		catalog->size = new_size;
+	}
+
+	catalog->entries[catalog->count] = *entry;
+	catalog->count++;
+}
+
+static int compare_name_seq( const void *a, const void *b )
+{
+	const CatalogEntry *entry_a = a;
+	const CatalogEntry *entry_b = b;
+	const int rc = strcmp(entry_a->name, entry_b->name);
+
+	if (rc != 0)
+		return rc;
+
+	return (entry_a->seq > entry_b->seq) - (entry_a->seq < entry_b->seq);
+}
+
+static int compare_name( const void *a, const void *b )
+{
+	return strcmp(((const CatalogEntry*) a)->name, ((const CatalogEntry*) b)->name);
+}
+
+Catalog Catalog_load( void )
+{
+	Catalog result = {
+		.invalid = false,
+		.entries = NULL,
+		.count = 0,
+		.size = 0,
+		.records = 0,
+	};
+	SM_String filepath = SM_String_new(16);
+	Buffer buf;
+	const uint8_t *magic;
+	CatalogEntry entry;
+	size_t live = 0;
+
+	if (get_catalog_path(&filepath) != 0)
+	{
+		result.invalid = true;
+		SM_String_clear(&filepath);
+		return result;
+	}
+
+	/* a missing or foreign catalog is just empty */
+	buf = Buffer_from_file(filepath.str);
+	SM_String_clear(&filepath);
+
+	magic = Buffer_view(&buf, sizeof(CATALOG_MAGIC));
+
+	if (magic == NULL ||
+		memcmp(magic, CATALOG_MAGIC, sizeof(CATALOG_MAGIC)) != 0 ||
+		Buffer_read_u16(&buf) != CATALOG_VERSION)
+	{
+		Buffer_clear(&buf);
+		return result;
+	}
+
+	while (buf.pos < buf.len && Catalog_read_entry(&buf, &entry))
+	{
+		entry.seq = result.records;
+		result.records++;
+		Catalog_add(&result, &entry);
+	}
+
+	Buffer_clear(&buf);
+
+	/* keep only the newest record per town */
+	qsort(result.entries, result.count, sizeof(CatalogEntry), compare_name_seq);
+
+	for (size_t i = 0; i < result.count; i++)
+	{
+		if (i + 1 < result.count &&
+			strcmp(result.entries[i].name, result.entries[i + 1].name) == 0)
+		{
+			continue;
+		}
+
+		result.entries[live] = result.entries[i];
+		live++;
+	}
+
+	result.count = live;
+
+	return result;
+}
+
+static int Catalog_read_headers( void *data )
+{
+	CatalogJob *job = data;
+	int i;
+
+	while ((i = SDL_AtomicAdd(&job->next, 1)) < job->count)
+	{
+		job->stale[i]->header = Town_load_header(job->stale[i]->name);
+	}
+
+	return 0;
+}
+
+/* rewrites the catalog with one record per town */
+static void Catalog_write( const Catalog *catalog )
+{
+	SM_String filepath = SM_String_new(16);
+	SM_String filepath_tmp = SM_String_new(16);
+	Buffer buf = Buffer_new(CATALOG_HEADER_SIZE + catalog->count * 64);
+
+	if (get_catalog_path(&filepath) != 0)
+		goto catalog_write_clear;
+
+	SM_String_copy(&filepath_tmp, &filepath);
+	SM_String_append_cstr(&filepath_tmp, ".");
+	SM_String_append_cstr(&filepath_tmp, FILETYPE_TEMP);
+
+	Buffer_write(&buf, CATALOG_MAGIC, sizeof(CATALOG_MAGIC));
+	Buffer_write_u16(&buf, CATALOG_VERSION);
+
+	for (size_t i = 0; i < catalog->count; i++)
+	{
+		Catalog_write_entry(&buf, &catalog->entries[i]);
+	}
+
+	/* only an index, failing to write it costs time on the next listing */
+	if (buf.invalid == false)
+		Buffer_to_file(&buf, filepath.str, filepath_tmp.str);
+
+	catalog_write_clear:
+
+	Buffer_clear(&buf);
+	SM_String_clear(&filepath);
+	SM_String_clear(&filepath_tmp);
+}
+
+void Catalog_refresh( Catalog *catalog )
+{
+	Catalog fresh = {
+		.invalid = false,
+		.entries = NULL,
+		.count = 0,
+		.size = 0,
+		.records = 0,
+	};
+	SM_String dirpath = SM_String_new(16);
+	DIR *dir;
+	struct dirent *d_ent;
+	size_t name_len;
+	const size_t suffix_len = strlen(FILETYPE_TOWN) + 1;
+	CatalogEntry entry;
+	const CatalogEntry *known;
+	CatalogJob job;
+	SDL_Thread *threads[CATALOG_MAX_THREADS];
+	int thread_count;
+	bool changed;
+
+	if (catalog->invalid || get_town_path(&dirpath) != 0)
+	{
+		catalog->invalid = true;
+		SM_String_clear(&dirpath);
+		return;
+	}
+
+	dir = opendir(dirpath.str);
+	SM_String_clear(&dirpath);
+
+	if (dir == NULL)
+	{
+		catalog->invalid = true;
+		return;
+	}
+
+	/* take over known towns whose file did not change */
+	while ((d_ent = readdir(dir)) != NULL)
+	{
+		/* see if name ends with ".twn" */
+		name_len = strlen(d_ent->d_name);
+
+		if (name_len <= suffix_len ||
+			name_len - suffix_len >= CATALOG_NAME_MAX ||
+			d_ent->d_name[name_len - suffix_len] != '.' ||
+			strcmp(&d_ent->d_name[name_len - suffix_len + 1], FILETYPE_TOWN) != 0)
+		{
+			continue;
+		}
+
+		memcpy(entry.name, d_ent->d_name, name_len - suffix_len);
+		entry.name[name_len - suffix_len] = '\0';
+
+		if (stat_town(entry.name, &entry.mtime, &entry.size) == false)
+			continue;
+
+		known = bsearch(&entry, catalog->entries, catalog->count, sizeof(CatalogEntry), compare_name);
+
+		if (known != NULL && known->mtime == entry.mtime && known->size == entry.size)
+		{
+			Catalog_add(&fresh, known);
+		}
+		else
+		{
+			/* mark stale */
+			entry.seq = UINT32_MAX;
+			Catalog_add(&fresh, &entry);
+		}
+	}
+
+	closedir(dir);
+
+	if (fresh.invalid)
+	{
+		free(fresh.entries);
+		catalog->invalid = true;
+		return;
+	}
+
+	/* gather stale entries */
+	job.stale = malloc(fresh.count * sizeof(CatalogEntry*));
+	job.count = 0;
+	SDL_AtomicSet(&job.next, 0);
+
+	for (size_t i = 0; i < fresh.count && job.stale != NULL; i++)
+	{
+		if (fresh.entries[i].seq == UINT32_MAX)
+		{
+			job.stale[job.count] = &fresh.entries[i];
+			job.count++;
+		}
+	}
+
+	/* read their headers in parallel, this thread helps out */
+	thread_count = SDL_GetCPUCount() - 1;
+
+	if (thread_count > CATALOG_MAX_THREADS)
+		thread_count = CATALOG_MAX_THREADS;
+
+	if (thread_count > job.count - 1)
+		thread_count = job.count - 1;
+
+	for (int i = 0; i < thread_count; i++)
+	{
+		threads[i] = SDL_CreateThread(Catalog_read_headers, "catalog", &job);
+	}
+
+	Catalog_read_headers(&job);
+
+	for (int i = 0; i < thread_count; i++)
+	{
+		if (threads[i] != NULL)
+			SDL_WaitThread(threads[i], NULL);
+	}
+
+	free(job.stale);
+
+	/* write back if anything differs from the file */
+	changed = (job.count > 0) ||
+		(fresh.count != catalog->count) ||
+		(catalog->records != catalog->count);
+
+	for (size_t i = 0; i < fresh.count; i++)
+	{
+		fresh.entries[i].seq = i;
+	}
+
+	qsort(fresh.entries, fresh.count, sizeof(CatalogEntry), compare_name);
+
+	free(catalog->entries);
+	*catalog = fresh;
+	catalog->records = catalog->count;
+
+	if (changed)
+		Catalog_write(catalog);
+}
+
+/* appends a record for a town that was just written */
+void Catalog_record( const char *town_name, const TownHeader *header )
+{
+	SM_String filepath = SM_String_new(16);
+	CatalogEntry entry;
+	Buffer buf = Buffer_new(64 + CATALOG_NAME_MAX);
+	FILE *f;
+
+	if (strlen(town_name) >= CATALOG_NAME_MAX ||
+		stat_town(town_name, &entry.mtime, &entry.size) == false ||
+		get_catalog_path(&filepath) != 0)
+	{
+		goto catalog_record_clear;
+	}
+
+	strcpy(entry.name, town_name);
+	entry.header = *header;
+
+	SDL_AtomicLock(&catalog_lock);
+	f = fopen(filepath.str, "ab");
+
+	if (f == NULL)
+	{
+		SDL_AtomicUnlock(&catalog_lock);
+		goto catalog_record_clear;
+	}
+
+	/* new catalog */
+	fseek(f, 0, SEEK_END);
+
+	if (ftell(f) == 0)
+	{
+		Buffer_write(&buf, CATALOG_MAGIC, sizeof(CATALOG_MAGIC));
+		Buffer_write_u16(&buf, CATALOG_VERSION);
+	}
+
+	/* one write per record, a torn one ends the catalog on reading */
+	Catalog_write_entry(&buf, &entry);
+
+	if (buf.invalid == false)
+		fwrite(buf.data, 1, buf.len, f);
+
+	fclose(f);
+	SDL_AtomicUnlock(&catalog_lock);
+
+	catalog_record_clear:
+
+	Buffer_clear(&buf);
+	SM_String_clear(&filepath);
+}
+
+static int compare_admin( const void *a, const void *b )
+{
+	const CatalogEntry *entry_a = a;
+	const CatalogEntry *entry_b = b;
+	const int rc = (entry_a->header.admin_id > entry_b->header.admin_id) -
+		(entry_a->header.admin_id < entry_b->header.admin_id);
+
+	return (rc != 0) ? rc : compare_name(a, b);
+}
+
+static int compare_round( const void *a, const void *b )
+{
+	const CatalogEntry *entry_a = a;
+	const CatalogEntry *entry_b = b;
+	const int rc = (entry_a->header.round < entry_b->header.round) -
+		(entry_a->header.round > entry_b->header.round);
+
+	return (rc != 0) ? rc : compare_name(a, b);
+}
+
+static int compare_money( const void *a, const void *b )
+{
+	const CatalogEntry *entry_a = a;
+	const CatalogEntry *entry_b = b;
+	const int rc = (entry_a->header.money < entry_b->header.money) -
+		(entry_a->header.money > entry_b->header.money);
+
+	return (rc != 0) ? rc : compare_name(a, b);
+}
+
+static int compare_mercs( const void *a, const void *b )
+{
+	const CatalogEntry *entry_a = a;
+	const CatalogEntry *entry_b = b;
+	const int rc = (entry_a->header.merc_count < entry_b->header.merc_count) -
+		(entry_a->header.merc_count > entry_b->header.merc_count);
+
+	return (rc != 0) ? rc : compare_name(a, b);
+}
+
+/* names ascending, numbers descending */
+void Catalog_sort( Catalog *catalog, const CatalogSort sort )
+{
+	static int (*const COMPARE[])( const void*, const void* ) = {
+		compare_name,
+		compare_admin,
+		compare_round,
+		compare_money,
+		compare_mercs,
+	};
+
+	qsort(catalog->entries, catalog->count, sizeof(CatalogEntry), COMPARE[sort]);
+}
+
+void Catalog_clear( Catalog *catalog )
+{
+	free(catalog->entries);
+	catalog->entries = NULL;
+	catalog->count = 0;
+	catalog->size = 0;
+}
@@ -0,0 +1,77 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "town.h"
+
+/* append-only index of town summaries in the towns directory,
+	later records of a town supersede earlier ones */
+static const char CATALOG_MAGIC[4] = {'R', 'C', 'C', 'T'};
+static const uint16_t CATALOG_VERSION = 2;
+#define CATALOG_HEADER_SIZE		6
+#define CATALOG_NAME_MAX		256
+#define CATALOG_MAX_THREADS		16
+
+typedef enum CatalogSort
+{
+	CS_NAME,
+	CS_ADMIN,
+	CS_ROUND,
+	CS_MONEY,
+	CS_MERCS,
+
+	CS_FIRST = CS_NAME,
+	CS_LAST = CS_MERCS
+} CatalogSort ;
+
+typedef struct CatalogEntry
+{
+	char name[CATALOG_NAME_MAX];
+	TownHeader header;
+	int64_t mtime;		/* of the town file when the header was read */
+	uint32_t size;
+	uint32_t seq;		/* record order in the catalog file */
+} CatalogEntry ;
+
+typedef struct Catalog
+{
+	bool invalid;
+	CatalogEntry *entries;
+	size_t count;
+	size_t size;
+	size_t records;		/* including superseded ones */
+} Catalog ;
+
+bool str_to_catalog_sort( const char *str, CatalogSort *sort );
+
+Catalog Catalog_load( void );
+
+void Catalog_refresh( Catalog *catalog );
+
+void Catalog_record( const char *town_name, const TownHeader *header );
+
+void Catalog_sort( Catalog *catalog, const CatalogSort sort );
+
+void Catalog_clear( Catalog *catalog );
+
+#endif /* CATALOG_H */
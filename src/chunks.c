@@ -0,0 +1,950 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <SM_string.h>
+#include "path.h"
+#include "buffer.h"
+#include "checksum.h"
+#include "chunks.h"
+
+/* largest record, fields stored as nibbles */
+#define CHUNK_RECORD_MAX_SIZE (CHUNK_RECORD_MIN_SIZE + (CHUNK_FIELDS / 8) + 1 + (CHUNK_FIELDS / 2))
+
+void pack_bits( const bool *cells, const uint32_t count, Buffer *buf )
+{
+	uint8_t byte = 0;
+
+	/* one bit per cell, lowest bit first */
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (cells[i])
+			byte |= 1 << (i % 8);
+
+		if (i % 8 == 7)
+		{
+			Buffer_write_u8(buf, byte);
+			byte = 0;
+		}
+	}
+
+	if (count % 8 != 0)
+		Buffer_write_u8(buf, byte);
+}
+
+void unpack_bits( bool *cells, const uint32_t count, Buffer *buf )
+{
+	const uint8_t *bits = Buffer_view(buf, (count + 7) / 8);
+
+	if (bits == NULL)
+		return;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		cells[i] = (bits[i / 8] >> (i % 8)) & 1;
+	}
+}
+
+/* number of bytes needed to store cells as runs */
+static uint32_t count_field_runs( const uint8_t *cells, const uint32_t count )
+{
+	uint32_t result = 0;
+	uint32_t run = 0;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		run++;
+
+		if (run == FIELD_RUN_MAX || i + 1 == count || cells[i + 1] != cells[i])
+		{
+			result++;
+			run = 0;
+		}
+	}
+
+	return result;
+}
+
+void pack_fields( const uint8_t *cells, const uint32_t count, Buffer *buf )
+{
+	uint32_t run = 0;
+	uint8_t byte = 0;
+
+	/* fields fit a nibble, pick whichever encoding is smaller */
+	if (count_field_runs(cells, count) < (count + 1) / 2)
+	{
+		Buffer_write_u8(buf, FE_RUNS);
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			run++;
+
+			if (run == FIELD_RUN_MAX || i + 1 == count || cells[i + 1] != cells[i])
+			{
+				Buffer_write_u8(buf, ((run - 1) << 4) | cells[i]);
+				run = 0;
+			}
+		}
+	}
+	else
+	{
+		Buffer_write_u8(buf, FE_NIBBLES);
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			if (i % 2 == 0)
+			{
+				byte = cells[i];
+			}
+			else
+			{
+				Buffer_write_u8(buf, byte | (cells[i] << 4));
+			}
+		}
+
+		if (count % 2 != 0)
+			Buffer_write_u8(buf, byte);
+	}
+}
+
+void unpack_fields( uint8_t *cells, const uint32_t count, const uint8_t max, Buffer *buf )
+{
+	const uint8_t *grid;
+	uint32_t i = 0;
+	uint32_t run;
+	uint8_t value;
+
+	switch (Buffer_read_u8(buf))
+	{
+	case FE_NIBBLES:
+		grid = Buffer_view(buf, (count + 1) / 2);
+
+		if (grid == NULL)
+			return;
+
+		for (i = 0; i < count; i++)
+		{
+			value = (grid[i / 2] >> ((i % 2) * 4)) & 0x0F;
+
+			if (value > max)
+			{
+				buf->invalid = true;
+				return;
+			}
+
+			cells[i] = value;
+		}
+		break;
+
+	case FE_RUNS:
+		while (i < count && buf->invalid == false)
+		{
+			value = Buffer_read_u8(buf);
+			run = (value >> 4) + 1;
+			value &= 0x0F;
+
+			if (value > max || i + run > count)
+			{
+				buf->invalid = true;
+				return;
+			}
+
+			for (; run > 0; run--, i++)
+			{
+				cells[i] = value;
+			}
+		}
+		break;
+
+	default:
+		buf->invalid = true;
+		return;
+	}
+}
+
+static uint32_t ChunkStore_chunk_count( const ChunkStore *store )
+{
+	return store->chunks_w * store->chunks_h;
+}
+
+static void ChunkStore_sync( FILE *file )
+{
+#ifdef _WIN32
+	_commit(_fileno(file));
+#else
+	fsync(fileno(file));
+#endif
+}
+
+void ChunkStore_log_header( uint8_t *out )
+{
+	memcpy(out, CHUNK_LOG_MAGIC, sizeof(CHUNK_LOG_MAGIC));
+	out[4] = CHUNK_LOG_VERSION & 0xFF;
+	out[5] = (CHUNK_LOG_VERSION >> 8) & 0xFF;
+}
+
+static bool write_log_header( FILE *file )
+{
+	uint8_t header[CHUNK_LOG_HEADER_SIZE];
+
+	ChunkStore_log_header(header);
+
+	return fwrite(header, 1, CHUNK_LOG_HEADER_SIZE, file) == CHUNK_LOG_HEADER_SIZE;
+}
+
+/* opens the log on first use, creates it if missing */
+static bool ChunkStore_open_log( ChunkStore *store )
+{
+	uint8_t header[CHUNK_LOG_HEADER_SIZE];
+	long len;
+
+	if (store->log != NULL)
+		return true;
+
+	if (store->bound == false)
+		return false;
+
+	store->log = fopen(store->log_path.str, "r+b");
+
+	if (store->log == NULL)
+		store->log = fopen(store->log_path.str, "w+b");
+
+	if (store->log == NULL || fseek(store->log, 0, SEEK_END) != 0)
+		goto open_log_fail;
+
+	len = ftell(store->log);
+
+	/* never write into a file that is not ours */
+	if (len >= CHUNK_LOG_HEADER_SIZE)
+	{
+		rewind(store->log);
+
+		if (fread(header, 1, CHUNK_LOG_HEADER_SIZE, store->log) != CHUNK_LOG_HEADER_SIZE ||
+			memcmp(header, CHUNK_LOG_MAGIC, sizeof(CHUNK_LOG_MAGIC)) != 0 ||
+			Buffer_get_u16(&header[4]) != CHUNK_LOG_VERSION)
+		{
+			goto open_log_fail;
+		}
+
+		store->log_len = len;
+	}
+	else if (len == 0)
+	{
+		if (write_log_header(store->log) == false)
+			goto open_log_fail;
+
+		store->log_len = CHUNK_LOG_HEADER_SIZE;
+	}
+	else
+	{
+		goto open_log_fail;
+	}
+
+	return true;
+
+	open_log_fail:
+
+	if (store->log != NULL)
+		fclose(store->log);
+
+	store->log = NULL;
+	store->invalid = true;
+	return false;
+}
+
+static void Chunk_encode( const Chunk *chunk, Buffer *buf )
+{
+	buf->len = 0;
+
+	Buffer_write_u32(buf, chunk->index);
+	Buffer_write_u32(buf, 0);	/* payload length, patched below */
+	pack_bits(chunk->hidden, CHUNK_FIELDS, buf);
+	pack_fields(chunk->field, CHUNK_FIELDS, buf);
+	Buffer_patch_u32(buf, 4, buf->len - CHUNK_RECORD_HEADER_SIZE);
+	Buffer_write_u32(buf, crc32c(buf->data, buf->len));
+}
+
+/* checks framing and checksum of the record at the start of data */
+static uint32_t record_len( const uint8_t *data, const uint64_t avail )
+{
+	uint32_t payload_len;
+	uint32_t len;
+
+	if (avail < CHUNK_RECORD_MIN_SIZE)
+		return 0;
+
+	payload_len = Buffer_get_u32(&data[4]);
+
+	if (payload_len > CHUNK_RECORD_MAX_SIZE)
+		return 0;
+
+	len = CHUNK_RECORD_MIN_SIZE + payload_len;
+
+	if (len > avail ||
+		Buffer_get_u32(&data[len - sizeof(uint32_t)]) !=
+		crc32c(data, len - sizeof(uint32_t)))
+	{
+		return 0;
+	}
+
+	return len;
+}
+
+static bool ChunkStore_append(
+	ChunkStore *store,
+	const uint32_t index,
+	const uint8_t *record,
+	const uint32_t len,
+	const uint64_t hash )
+{
+	ChunkRef *ref = &store->refs[index];
+	long offset;
+
+	if (ChunkStore_open_log(store) == false)
+		return false;
+
+	/* a failed append may have left a partial record, never reuse its space */
+	if (fseek(store->log, 0, SEEK_END) != 0 ||
+		(offset = ftell(store->log)) < 0 ||
+		fwrite(record, 1, len, store->log) != len)
+	{
+		store->invalid = true;
+		return false;
+	}
+
+	store->live_len = store->live_len - ref->len + len;
+	store->log_len = offset + len;
+	ref->offset = offset;
+	ref->len = len;
+	ref->hash = hash;
+
+	return true;
+}
+
+/* appends chunk unless its record in the log is already the same */
+static bool ChunkStore_write_chunk( ChunkStore *store, const Chunk *chunk )
+{
+	Buffer record = Buffer_new(CHUNK_RECORD_MAX_SIZE);
+	uint64_t hash;
+	bool result = false;
+
+	Chunk_encode(chunk, &record);
+
+	if (record.invalid == false)
+	{
+		hash = fnv1a64(record.data, record.len);
+
+		if (store->refs[chunk->index].len == record.len &&
+			store->refs[chunk->index].hash == hash)
+		{
+			result = true;
+		}
+		else
+		{
+			result = ChunkStore_append(store, chunk->index, record.data, record.len, hash);
+		}
+	}
+
+	Buffer_clear(&record);
+	return result;
+}
+
+/* after compaction or a restored backup the directory may point to
+	old offsets, look every chunk up in the log by index and content */
+static void ChunkStore_scan( ChunkStore *store )
+{
+	Buffer log;
+	uint32_t len;
+	uint32_t index;
+	uint64_t hash;
+
+	store->scanned = true;
+
+	if (store->log != NULL)
+		fflush(store->log);
+
+	log = Buffer_from_file(store->log_path.str);
+
+	/* past a damaged record, resume at the next byte that starts a valid one */
+	for (uint64_t pos = CHUNK_LOG_HEADER_SIZE; log.invalid == false && pos < log.len; pos += len)
+	{
+		len = 1;
+		index = (log.len - pos >= CHUNK_RECORD_MIN_SIZE) ? Buffer_get_u32(&log.data[pos]) : UINT32_MAX;
+
+		if (index >= ChunkStore_chunk_count(store) || store->refs[index].len == 0)
+			continue;
+
+		len = record_len(&log.data[pos], log.len - pos);
+
+		if (len == 0)
+		{
+			len = 1;
+			continue;
+		}
+
+		hash = fnv1a64(&log.data[pos], len);
+
+		if (store->refs[index].len == len && store->refs[index].hash == hash)
+			store->refs[index].offset = pos;
+	}
+
+	Buffer_clear(&log);
+}
+
+static bool ChunkStore_read_at( ChunkStore *store, const ChunkRef *ref, Buffer *out )
+{
+	*out = Buffer_new(ref->len);
+
+	if (out->invalid ||
+		ChunkStore_open_log(store) == false ||
+		fseek(store->log, ref->offset, SEEK_SET) != 0 ||
+		fread(out->data, 1, ref->len, store->log) != ref->len)
+	{
+		Buffer_clear(out);
+		return false;
+	}
+
+	out->len = ref->len;
+
+	if (fnv1a64(out->data, out->len) != ref->hash)
+	{
+		Buffer_clear(out);
+		return false;
+	}
+
+	return true;
+}
+
+bool ChunkStore_read_record( ChunkStore *store, const uint32_t index, Buffer *out )
+{
+	const ChunkRef *ref = &store->refs[index];
+
+	if (ref->len == 0)
+		return false;
+
+	if (ChunkStore_read_at(store, ref, out))
+		return true;
+
+	if (store->scanned || store->bound == false)
+		return false;
+
+	ChunkStore_scan(store);
+
+	return ChunkStore_read_at(store, ref, out);
+}
+
+static bool ChunkStore_page_in( ChunkStore *store, Chunk *chunk )
+{
+	Buffer record;
+
+	/* never written, empty and exposed */
+	if (store->refs[chunk->index].len == 0)
+	{
+		memset(chunk->field, 0, sizeof(chunk->field));
+		memset(chunk->hidden, 0, sizeof(chunk->hidden));
+		return true;
+	}
+
+	if (ChunkStore_read_record(store, chunk->index, &record) == false)
+		return false;
+
+	if (record_len(record.data, record.len) != record.len ||
+		Buffer_read_u32(&record) != chunk->index)
+	{
+		record.invalid = true;
+	}
+
+	Buffer_read_u32(&record);
+	record.len -= sizeof(uint32_t);
+	unpack_bits(chunk->hidden, CHUNK_FIELDS, &record);
+	unpack_fields(chunk->field, CHUNK_FIELDS, store->field_max, &record);
+
+	if (record.pos != record.len)
+		record.invalid = true;
+
+	if (record.invalid)
+	{
+		Buffer_clear(&record);
+		return false;
+	}
+
+	Buffer_clear(&record);
+	return true;
+}
+
+static void ChunkStore_unlink( ChunkStore *store, Chunk *chunk )
+{
+	if (chunk->newer != NULL)
+		chunk->newer->older = chunk->older;
+	else
+		store->newest = chunk->older;
+
+	if (chunk->older != NULL)
+		chunk->older->newer = chunk->newer;
+	else
+		store->oldest = chunk->newer;
+}
+
+static void ChunkStore_push( ChunkStore *store, Chunk *chunk )
+{
+	chunk->newer = NULL;
+	chunk->older = store->newest;
+
+	if (store->newest != NULL)
+		store->newest->newer = chunk;
+	else
+		store->oldest = chunk;
+
+	store->newest = chunk;
+}
+
+/* evicts least recently used chunks down to the budget,
+	the newest one is kept since its caller still holds it */
+static void ChunkStore_trim( ChunkStore *store )
+{
+	Chunk *chunk;
+
+	while (store->bound &&
+		store->resident > store->budget &&
+		store->oldest != store->newest)
+	{
+		chunk = store->oldest;
+
+		/* keep it while it can not be written back */
+		if (chunk->dirty && ChunkStore_write_chunk(store, chunk) == false)
+			return;
+
+		ChunkStore_unlink(store, chunk);
+		store->refs[chunk->index].chunk = NULL;
+		store->resident--;
+		free(chunk);
+	}
+}
+
+ChunkStore ChunkStore_new( const uint32_t width, const uint32_t height, const uint8_t field_max )
+{
+	ChunkStore result = {
+		.invalid = false,
+		.width = width,
+		.height = height,
+		.chunks_w = (width + CHUNK_SIZE - 1) >> CHUNK_SHIFT,
+		.chunks_h = (height + CHUNK_SIZE - 1) >> CHUNK_SHIFT,
+		.refs = NULL,
+		.newest = NULL,
+		.oldest = NULL,
+		.resident = 0,
+		.field_max = field_max,
+		.bound = false,
+		.log = NULL,
+		.log_len = 0,
+		.live_len = 0,
+		.scanned = false,
+	};
+
+	ChunkStore_set_budget(&result, CHUNK_DEFAULT_BUDGET_MB);
+	memset(&result.fallback, 0, sizeof(result.fallback));
+	result.town_name = SM_String_new(16);
+	result.log_path = SM_String_new(16);
+
+	if (ChunkStore_chunk_count(&result) > 0)
+	{
+		result.refs = calloc(ChunkStore_chunk_count(&result), sizeof(ChunkRef));
+
+		if (result.refs == NULL)
+			result.invalid = true;
+	}
+
+	return result;
+}
+
+ChunkStore ChunkStore_copy( const ChunkStore *store )
+{
+	ChunkStore result = ChunkStore_new(store->width, store->height, store->field_max);
+	Chunk *chunk;
+
+	if (result.invalid)
+		return result;
+
+	result.invalid = store->invalid;
+	result.budget = store->budget;
+	result.bound = store->bound;
+	result.log_len = store->log_len;
+	result.live_len = store->live_len;
+	result.scanned = store->scanned;
+	SM_String_copy(&result.town_name, &store->town_name);
+	SM_String_copy(&result.log_path, &store->log_path);
+
+	for (uint32_t i = 0; i < ChunkStore_chunk_count(store); i++)
+	{
+		result.refs[i] = store->refs[i];
+		result.refs[i].chunk = NULL;
+	}
+
+	/* clean chunks can be paged in again, dirty ones only exist here */
+	for (const Chunk *cur = store->oldest; cur != NULL; cur = cur->newer)
+	{
+		if (cur->dirty == false)
+			continue;
+
+		chunk = malloc(sizeof(Chunk));
+
+		if (chunk == NULL)
+		{
+			result.invalid = true;
+			break;
+		}
+
+		*chunk = *cur;
+		ChunkStore_push(&result, chunk);
+		result.refs[chunk->index].chunk = chunk;
+		result.resident++;
+	}
+
+	return result;
+}
+
+void ChunkStore_bind( ChunkStore *store, const char *town_name )
+{
+	if (store->log != NULL)
+		fclose(store->log);
+
+	store->log = NULL;
+	store->log_len = 0;
+	store->scanned = false;
+	SM_String_copy_cstr(&store->town_name, town_name);
+	SM_String_copy_cstr(&store->log_path, "");
+
+	store->bound = (get_town_file_path(&store->log_path, town_name, FILETYPE_CHUNKS) == 0);
+
+	if (store->bound == false)
+		store->invalid = true;
+}
+
+bool ChunkStore_is_bound_to( const ChunkStore *store, const char *town_name )
+{
+	return store->bound && strcmp(store->town_name.str, town_name) == 0;
+}
+
+void ChunkStore_set_budget( ChunkStore *store, const uint32_t megabytes )
+{
+	const uint64_t budget = (uint64_t) megabytes * 1024 * 1024 / sizeof(Chunk);
+
+	store->budget = (budget < 1) ? 1 : ((budget > UINT32_MAX) ? UINT32_MAX : budget);
+	ChunkStore_trim(store);
+}
+
+Chunk* ChunkStore_fetch( ChunkStore *store, const uint32_t x, const uint32_t y )
+{
+	const uint32_t index = (y >> CHUNK_SHIFT) * store->chunks_w + (x >> CHUNK_SHIFT);
+	Chunk *chunk = store->refs[index].chunk;
+
+	/* most accesses hit the chunk touched last */
+	if (chunk != NULL && chunk == store->newest)
+		return chunk;
+
+	if (chunk != NULL)
+	{
+		ChunkStore_unlink(store, chunk);
+		ChunkStore_push(store, chunk);
+		return chunk;
+	}
+
+	chunk = malloc(sizeof(Chunk));
+
+	if (chunk == NULL)
+		goto fetch_fail;
+
+	chunk->index = index;
+	chunk->dirty = false;
+
+	if (ChunkStore_page_in(store, chunk) == false)
+	{
+		free(chunk);
+		goto fetch_fail;
+	}
+
+	ChunkStore_push(store, chunk);
+	store->refs[index].chunk = chunk;
+	store->resident++;
+	ChunkStore_trim(store);
+
+	return chunk;
+
+	fetch_fail:
+
+	/* keep going on an empty chunk, the store refuses to be saved now */
+	store->invalid = true;
+	memset(&store->fallback, 0, sizeof(store->fallback));
+	return &store->fallback;
+}
+
+bool ChunkStore_flush( ChunkStore *store )
+{
+	if (store->bound == false)
+		return false;
+
+	for (Chunk *chunk = store->newest; chunk != NULL; chunk = chunk->older)
+	{
+		if (chunk->dirty == false)
+			continue;
+
+		if (ChunkStore_write_chunk(store, chunk) == false)
+			return false;
+
+		chunk->dirty = false;
+	}
+
+	if (store->log != NULL)
+	{
+		if (fflush(store->log) != 0)
+		{
+			store->invalid = true;
+			return false;
+		}
+
+		ChunkStore_sync(store->log);
+	}
+
+	ChunkStore_trim(store);
+
+	return (store->invalid == false);
+}
+
+ChunkStore ChunkStore_export( ChunkStore *store, const char *town_name )
+{
+	ChunkStore result = ChunkStore_new(store->width, store->height, store->field_max);
+	const ChunkRef *ref;
+	Buffer record;
+
+	if (result.invalid)
+		return result;
+
+	result.invalid = store->invalid;
+	result.budget = store->budget;
+	ChunkStore_bind(&result, town_name);
+
+	/* appended to whatever log the target has, so its last save stays intact */
+	for (uint32_t i = 0; i < ChunkStore_chunk_count(store) && result.invalid == false; i++)
+	{
+		ref = &store->refs[i];
+
+		if (ref->chunk != NULL)
+		{
+			ChunkStore_write_chunk(&result, ref->chunk);
+		}
+		else if (ref->len > 0)
+		{
+			if (ChunkStore_read_record(store, i, &record) == false)
+			{
+				result.invalid = true;
+				break;
+			}
+
+			ChunkStore_append(&result, i, record.data, record.len, ref->hash);
+			Buffer_clear(&record);
+		}
+	}
+
+	if (result.invalid == false)
+		ChunkStore_flush(&result);
+
+	return result;
+}
+
+bool ChunkStore_compact( ChunkStore *store )
+{
+	const uint32_t count = ChunkStore_chunk_count(store);
+	SM_String filepath_tmp;
+	uint64_t *offsets;
+	FILE *f;
+	Buffer record;
+	long pos;
+	bool result = false;
+
+	if (store->bound == false || store->invalid ||
+		ChunkStore_open_log(store) == false ||
+		store->log_len < CHUNK_COMPACT_MIN_SIZE ||
+		store->log_len < 2 * store->live_len + CHUNK_LOG_HEADER_SIZE)
+	{
+		return false;
+	}
+
+	offsets = malloc(count * sizeof(uint64_t));
+
+	if (offsets == NULL)
+		return false;
+
+	filepath_tmp = SM_String_from(store->log_path.str);
+	SM_String_append_cstr(&filepath_tmp, ".");
+	SM_String_append_cstr(&filepath_tmp, FILETYPE_TEMP);
+
+	f = fopen(filepath_tmp.str, "wb");
+
+	if (f == NULL || write_log_header(f) == false)
+		goto compact_fail;
+
+	/* copy every live record, in chunk order */
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (store->refs[i].len == 0)
+			continue;
+
+		if (ChunkStore_read_record(store, i, &record) == false)
+			goto compact_fail;
+
+		pos = ftell(f);
+		offsets[i] = pos;
+
+		if (pos < 0 || fwrite(record.data, 1, record.len, f) != record.len)
+		{
+			Buffer_clear(&record);
+			goto compact_fail;
+		}
+
+		Buffer_clear(&record);
+	}
+
+	if (fflush(f) != 0)
+		goto compact_fail;
+
+	ChunkStore_sync(f);
+	pos = ftell(f);
+	fclose(f);
+	f = NULL;
+
+	fclose(store->log);
+	store->log = NULL;
+
+#ifdef _WIN32
+	remove(store->log_path.str);
+#endif
+
+	if (rename(filepath_tmp.str, store->log_path.str) != 0)
+		goto compact_fail;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (store->refs[i].len > 0)
+			store->refs[i].offset = offsets[i];
+	}
+
+	store->log_len = pos;
+	store->scanned = false;
+	result = true;
+
+	compact_fail:
+
+	if (f != NULL)
+		fclose(f);
+
+	if (result == false)
+		remove(filepath_tmp.str);
+
+	free(offsets);
+	SM_String_clear(&filepath_tmp);
+
+	return result;
+}
+
+void ChunkStore_write_dir( const ChunkStore *store, Buffer *buf )
+{
+	Buffer_write_u16(buf, CHUNK_SIZE);
+	Buffer_write_u32(buf, ChunkStore_chunk_count(store));
+
+	for (uint32_t i = 0; i < ChunkStore_chunk_count(store); i++)
+	{
+		Buffer_write_u64(buf, store->refs[i].offset);
+		Buffer_write_u32(buf, store->refs[i].len);
+		Buffer_write_u64(buf, store->refs[i].hash);
+	}
+}
+
+void ChunkStore_read_dir( ChunkStore *store, Buffer *buf )
+{
+	ChunkRef *ref;
+
+	if (Buffer_read_u16(buf) != CHUNK_SIZE ||
+		Buffer_read_u32(buf) != ChunkStore_chunk_count(store))
+	{
+		buf->invalid = true;
+		return;
+	}
+
+	store->live_len = 0;
+
+	for (uint32_t i = 0; i < ChunkStore_chunk_count(store) && buf->invalid == false; i++)
+	{
+		ref = &store->refs[i];
+		ref->offset = Buffer_read_u64(buf);
+		ref->len = Buffer_read_u32(buf);
+		ref->hash = Buffer_read_u64(buf);
+
+		if (ref->len != 0 &&
+			(ref->len < CHUNK_RECORD_MIN_SIZE || ref->len > CHUNK_RECORD_MAX_SIZE ||
+			ref->offset < CHUNK_LOG_HEADER_SIZE))
+		{
+			buf->invalid = true;
+		}
+
+		store->live_len += ref->len;
+	}
+
+	/* nothing may follow */
+	if (buf->pos != buf->len)
+		buf->invalid = true;
+}
+
+void ChunkStore_clear( ChunkStore *store )
+{
+	Chunk *chunk;
+
+	while (store->newest != NULL)
+	{
+		chunk = store->newest;
+		store->newest = chunk->older;
+		free(chunk);
+	}
+
+	if (store->log != NULL)
+		fclose(store->log);
+
+	free(store->refs);
+	SM_String_clear(&store->town_name);
+	SM_String_clear(&store->log_path);
+
+	store->refs = NULL;
+	store->oldest = NULL;
+	store->resident = 0;
+	store->log = NULL;
+	store->bound = false;
+}
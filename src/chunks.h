@@ -0,0 +1,139 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHUNKS_H
+#define CHUNKS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <SM_string.h>
+#include "buffer.h"
+
+/* town grids are split into square chunks, which live as records in an
+	append-only log next to the town file and get paged in when touched */
+#define CHUNK_SHIFT		5
+#define CHUNK_SIZE		(1 << CHUNK_SHIFT)		/* fields per side */
+#define CHUNK_FIELDS	(CHUNK_SIZE * CHUNK_SIZE)
+
+static const char CHUNK_LOG_MAGIC[4] = {'R', 'C', 'C', 'K'};
+static const uint16_t CHUNK_LOG_VERSION = 1;
+#define CHUNK_LOG_HEADER_SIZE		6
+#define CHUNK_RECORD_HEADER_SIZE	8	/* chunk index, payload length */
+#define CHUNK_RECORD_MIN_SIZE		(CHUNK_RECORD_HEADER_SIZE + sizeof(uint32_t))
+#define CHUNK_DIR_ENTRY_SIZE		20	/* offset, record length, record hash */
+
+static const uint32_t CHUNK_DEFAULT_BUDGET_MB =	64;		/* of resident chunks */
+static const uint64_t CHUNK_COMPACT_MIN_SIZE =	65536;	/* log bytes before compacting */
+
+/* encodings of packed field grids */
+typedef enum FieldEncoding
+{
+	FE_NIBBLES,		/* two fields per byte */
+	FE_RUNS,		/* one byte per run, field in low nibble, length - 1 in high nibble */
+} FieldEncoding ;
+#define FIELD_RUN_MAX 16
+
+typedef struct Chunk
+{
+	uint32_t index;			/* row-major in the grid of chunks */
+	bool dirty;				/* differs from its record in the log */
+	struct Chunk *newer;
+	struct Chunk *older;
+	uint8_t field[CHUNK_FIELDS];
+	bool hidden[CHUNK_FIELDS];
+} Chunk ;
+
+/* directory entry, where the newest record of a chunk is */
+typedef struct ChunkRef
+{
+	uint64_t offset;
+	uint32_t len;			/* 0 if never written, chunk is empty and exposed */
+	uint64_t hash;			/* of the whole record */
+	Chunk *chunk;			/* resident copy or NULL */
+} ChunkRef ;
+
+typedef struct ChunkStore
+{
+	bool invalid;			/* a chunk could not be read or written */
+	uint32_t width;			/* in fields */
+	uint32_t height;
+	uint32_t chunks_w;		/* in chunks */
+	uint32_t chunks_h;
+	ChunkRef *refs;
+
+	/* resident chunks, least recently used last */
+	Chunk *newest;
+	Chunk *oldest;
+	uint32_t resident;
+	uint32_t budget;		/* resident chunks, not enforced until bound to a log */
+
+	uint8_t field_max;		/* highest valid field value */
+
+	bool bound;
+	SM_String town_name;
+	SM_String log_path;
+	FILE *log;
+	uint64_t log_len;
+	uint64_t live_len;		/* bytes of records the directory refers to */
+	bool scanned;			/* directory was repaired from the log once */
+
+	Chunk fallback;			/* handed out if a chunk can not be paged in */
+} ChunkStore ;
+
+ChunkStore ChunkStore_new( const uint32_t width, const uint32_t height, const uint8_t field_max );
+
+/* copies share the log, only one of them may write to it at a time */
+ChunkStore ChunkStore_copy( const ChunkStore *store );
+
+void ChunkStore_bind( ChunkStore *store, const char *town_name );
+
+bool ChunkStore_is_bound_to( const ChunkStore *store, const char *town_name );
+
+void ChunkStore_set_budget( ChunkStore *store, const uint32_t megabytes );
+
+Chunk* ChunkStore_fetch( ChunkStore *store, const uint32_t x, const uint32_t y );
+
+bool ChunkStore_flush( ChunkStore *store );
+
+ChunkStore ChunkStore_export( ChunkStore *store, const char *town_name );
+
+/* only right after a successful save, records the town file
+	on disk refers to but the directory does not are dropped */
+bool ChunkStore_compact( ChunkStore *store );
+
+/* writes the CHUNK_LOG_HEADER_SIZE bytes every log starts with */
+void ChunkStore_log_header( uint8_t *out );
+
+bool ChunkStore_read_record( ChunkStore *store, const uint32_t index, Buffer *out );
+
+void ChunkStore_write_dir( const ChunkStore *store, Buffer *buf );
+
+void ChunkStore_read_dir( ChunkStore *store, Buffer *buf );
+
+void ChunkStore_clear( ChunkStore *store );
+
+void pack_bits( const bool *cells, const uint32_t count, Buffer *buf );
+
+void unpack_bits( bool *cells, const uint32_t count, Buffer *buf );
+
+void pack_fields( const uint8_t *cells, const uint32_t count, Buffer *buf );
+
+void unpack_fields( uint8_t *cells, const uint32_t count, const uint8_t max, Buffer *buf );
+
+#endif /* CHUNKS_H */
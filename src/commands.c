@@ -18,10 +18,10 @@
 
 #include <stdio.h>
 #include <stdint.h>
-#include <time.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
+#include <time.h>
+#include <signal.h>
 #include <SDL.h>
 #include <SM_string.h>
 #include "admins.h"
@@ -30,7 +30,13 @@
 #include "town.h"
 #include "config.h"
 #include "path.h"
+#include "backup.h"
+#include "catalog.h"
+#include "rng.h"
 #include "game.h"
+#include "record.h"
+#include "lease.h"
+#include "daemon.h"
 #include "commands.h"
 
 void print_cmd_help( const Command cmd )
@@ -95,21 +101,30 @@ void cmd_list_admins( void )
 	}
 }
 
-void cmd_hire_admin( const int32_t admin_id, const char *town_name )
+void cmd_hire_admin(
+	const int32_t admin_id,
+	const char *town_name,
+	const uint64_t seed,
+	const uint32_t width,
+	const uint32_t height )
 {
-	Town new_town = Town_new();
-	uint32_t tree_chance;
-	uint32_t tree_variance;
+	Town new_town;
 	SM_String filepath = SM_String_new(16);
 	FILE *f;
 	char confirmation;
 
-	// init random gen
-	srand(time(NULL));
+	/* check given size */
+	if (width < TOWN_MIN_SIZE || width > TOWN_MAX_SIZE ||
+		height < TOWN_MIN_SIZE || height > TOWN_MAX_SIZE)
+	{
+		SM_String_clear(&filepath);
+		printf(MSG_ERR_TOWN_SIZE, TOWN_MIN_SIZE, TOWN_MAX_SIZE);
+		return;
+	}
 
 	/* check given admin id */
 	if (admin_id < 0 ||
-		(uint32_t) admin_id > (sizeof(DATA_ADMINS) / sizeof(DATA_ADMINS[0])))
+		(uint32_t) admin_id >= (sizeof(DATA_ADMINS) / sizeof(DATA_ADMINS[0])))
 	{
 		SM_String_clear(&filepath);
 		printf(MSG_ERR_ADMIN_ID, DATA_CMDS[CMD_LIST_ADMINS].desc);
@@ -147,122 +162,316 @@ void cmd_hire_admin( const int32_t admin_id, const char *town_name )
 	}
 
 	/* set values */
+	new_town = Town_new(width, height);
 	new_town.admin_id = admin_id;
 
-	/* hide fields, generate trees */
-	for (uint32_t x = 0; x < TOWN_WIDTH; x++)
+	/* generate map */
+	if (new_town.invalid == false)
+		Town_generate(&new_town, seed);
+
+	if (new_town.invalid)
 	{
-		for (uint32_t y = 0; y < TOWN_HEIGHT; y++)
-		{
-			tree_chance = rand() % 100;
-
-			/* chance to generate tree */
-			if (tree_chance > TOWN_GEN_TREE_THRESHOLD)
-			{
-				/* chance for species */
-				tree_variance = rand() % FIELD_TREE_COUNT;
-				new_town.field[x][y] = (FIELD_TREE_0 + tree_variance);
-			}
-			else
-			{
-				new_town.field[x][y] = FIELD_EMPTY;
-			}
-
-			/* hide field */
-			new_town.hidden[x][y] = true;
-		}
+		printf(MSG_ERR_TOWN_GENERATE);
+		Town_clear(&new_town);
+		SM_String_clear(&filepath);
+		return;
 	}
 
-	/* expose starting area */
-	for (uint32_t x = TOWN_EXPOSURE_AREA_BEGIN_X; x < TOWN_EXPOSURE_AREA_END_X; x++)
+	/* save town to file */
+	Town_save(&new_town, town_name);
+
+	if(new_town.invalid == false)
+		printf(MSG_FILE_TOWN_CREATE, seed);
+
+	// clear
+	Town_clear(&new_town);
+	SM_String_clear(&filepath);
+}
+
+typedef struct BatchJob
+{
+	uint32_t count;
+	const char *prefix;
+	uint64_t seed;
+	uint32_t width;
+	uint32_t height;
+	int32_t digits;
+	SDL_atomic_t next;
+	SDL_atomic_t created;
+	SDL_atomic_t skipped;
+	SDL_atomic_t failed;
+} BatchJob ;
+
+static int hire_admin_batch_worker( void *data )
+{
+	BatchJob *job = data;
+	SM_String town_name = SM_String_new(16);
+	SM_String filepath = SM_String_new(16);
+	char suffix[16];
+	uint64_t town_seed;
+	Rng rng;
+	Town town;
+	FILE *f;
+	uint32_t i;
+
+	while ((i = SDL_AtomicAdd(&job->next, 1)) < job->count)
 	{
-		for (uint32_t y = TOWN_EXPOSURE_AREA_BEGIN_Y; y < TOWN_EXPOSURE_AREA_END_Y; y++)
+		sprintf(suffix, "%0*u", job->digits, i);
+		SM_String_copy_cstr(&town_name, job->prefix);
+		SM_String_append_cstr(&town_name, suffix);
+
+		/* never overwrite, there is nobody to ask */
+		SM_String_copy_cstr(&filepath, "");
+
+		if (get_town_file_path(&filepath, town_name.str, FILETYPE_TOWN) != 0)
 		{
-			new_town.hidden[x][y] = false;
+			SDL_AtomicAdd(&job->failed, 1);
+			continue;
 		}
-	}
 
-	/* clear tree-free zone from trees */
-	for (uint32_t x = TOWN_TREEFREE_AREA_BEGIN_X; x < TOWN_TREEFREE_AREA_END_X; x++)
-	{
-		for (uint32_t y = TOWN_TREEFREE_AREA_BEGIN_Y; y < TOWN_TREEFREE_AREA_END_Y; y++)
+		f = fopen(filepath.str, "r");
+
+		if (f != NULL)
 		{
-			new_town.field[x][y] = FIELD_EMPTY;
+			fclose(f);
+			SDL_AtomicAdd(&job->skipped, 1);
+			continue;
 		}
-	}
 
-	/* set headquarter */
-	new_town.field[TOWN_HQ_SPAWN_X][TOWN_HQ_SPAWN_Y] = FIELD_ADMINISTRATION;
+		/* admin and map both follow from the derived seed */
+		town_seed = Rng_derive_seed(job->seed, i);
+		rng = Rng_new(town_seed);
 
-	/* save town to file */
-	Town_save(&new_town, town_name);
+		town = Town_new(job->width, job->height);
+		town.admin_id = Rng_range(&rng, sizeof(DATA_ADMINS) / sizeof(DATA_ADMINS[0]));
 
-	if(new_town.invalid == false)
-		printf(MSG_FILE_TOWN_CREATE);
+		if (town.invalid == false)
+			Town_generate(&town, town_seed);
 
-	// clear
+		if (town.invalid == false)
+			Town_save(&town, town_name.str);
+
+		SDL_AtomicAdd(town.invalid ? &job->failed : &job->created, 1);
+		Town_clear(&town);
+	}
+
+	SM_String_clear(&town_name);
 	SM_String_clear(&filepath);
+
+	return 0;
 }
 
-void cmd_list_towns( void )
+void cmd_hire_admin_batch(
+	const uint32_t count,
+	const char *prefix,
+	const uint64_t seed,
+	const uint32_t width,
+	const uint32_t height )
 {
-	SM_String filepath = SM_String_new(16);
-	DIR *dir;
-	struct dirent *d_ent;
-	char *substr = NULL;
+	BatchJob job = {
+		.count = count,
+		.prefix = prefix,
+		.seed = seed,
+		.width = width,
+		.height = height,
+		.digits = 1,
+	};
+	SDL_Thread *threads[BATCH_MAX_THREADS];
+	SM_String path;
+	int thread_count;
+	uint64_t ts_begin;
+	double seconds;
+
+	/* check given size, else every town would fail alike */
+	if (width < TOWN_MIN_SIZE || width > TOWN_MAX_SIZE ||
+		height < TOWN_MIN_SIZE || height > TOWN_MAX_SIZE)
+	{
+		printf(MSG_ERR_TOWN_SIZE, TOWN_MIN_SIZE, TOWN_MAX_SIZE);
+		return;
+	}
 
-	/* open town dir */
-	if (get_town_path(&filepath) != 0)
+	path = SM_String_new(16);
+
+	SDL_AtomicSet(&job.next, 0);
+	SDL_AtomicSet(&job.created, 0);
+	SDL_AtomicSet(&job.skipped, 0);
+	SDL_AtomicSet(&job.failed, 0);
+
+	/* equal width numbers keep names sorted */
+	for (uint32_t i = count; i >= 10; i /= 10)
+		job.digits++;
+
+	/* make sure directories exist before workers race for them */
+	get_town_path(&path);
+	SM_String_clear(&path);
+
+	/* saves mostly wait for the disk, so use more workers than cores */
+	thread_count = SDL_GetCPUCount() * 2;
+
+	if (thread_count > BATCH_MAX_THREADS)
+		thread_count = BATCH_MAX_THREADS;
+
+	if ((uint32_t) thread_count > count)
+		thread_count = count;
+
+	ts_begin = SDL_GetPerformanceCounter();
+
+	for (int i = 0; i < thread_count; i++)
 	{
-		SM_String_clear(&filepath);
+		threads[i] = SDL_CreateThread(hire_admin_batch_worker, "hire-admin-batch", &job);
+	}
+
+	/* this thread helps out, so the batch finishes even without workers */
+	hire_admin_batch_worker(&job);
+
+	for (int i = 0; i < thread_count; i++)
+	{
+		if (threads[i] != NULL)
+			SDL_WaitThread(threads[i], NULL);
+	}
+
+	seconds = (double) (SDL_GetPerformanceCounter() - ts_begin) / SDL_GetPerformanceFrequency();
+
+	printf(MSG_BATCH_DONE,
+		SDL_AtomicGet(&job.created),
+		SDL_AtomicGet(&job.skipped),
+		SDL_AtomicGet(&job.failed),
+		seconds,
+		(seconds > 0.0) ? SDL_AtomicGet(&job.created) / seconds : 0.0);
+}
+
+void cmd_list_towns( const char *sort_by )
+{
+	Catalog catalog;
+	CatalogSort sort = CS_NAME;
+	const CatalogEntry *entry;
+
+	/* parse sort key */
+	if (sort_by != NULL && str_to_catalog_sort(sort_by, &sort) == false)
+	{
+		printf(MSG_ERR_CATALOG_SORT, sort_by);
 		return;
 	}
 
-	dir = opendir(filepath.str);
+	/* read index, catch up with changed town files */
+	catalog = Catalog_load();
+	Catalog_refresh(&catalog);
 
-	if (dir == NULL)
+	if (catalog.invalid)
 	{
 		printf(MSG_ERR_DIR_TOWNS);
+		Catalog_clear(&catalog);
+		return;
 	}
 
-	/* for all dirents */
-	while ((d_ent = readdir(dir)) != NULL)
+	Catalog_sort(&catalog, sort);
+
+	for (size_t i = 0; i < catalog.count; i++)
 	{
-		/* see if name contains filetype */
-		substr = strstr(d_ent->d_name, FILETYPE_TOWN);
+		entry = &catalog.entries[i];
 
-		/* if so, print and reset substr */
-		if (substr != NULL)
+		if (entry->header.invalid)
 		{
-			printf("%s\n", d_ent->d_name);
-			substr = NULL;
+			printf(MSG_TOWN_SUMMARY_INVALID, entry->name);
+			continue;
 		}
+
+		printf(MSG_TOWN_SUMMARY,
+			entry->name,
+			DATA_ADMINS[entry->header.admin_id].last_name,
+			entry->header.round / 24,
+			entry->header.round % 24,
+			entry->header.money,
+			entry->header.merc_count);
 	}
 	printf("\n");
 
-	closedir(dir);
-	SM_String_clear(&filepath);
+	Catalog_clear(&catalog);
 }
 
 void cmd_connect( const char *town_name )
 {
-	Town town = Town_new();
+	Town town = Town_new(TOWN_DEFAULT_WIDTH, TOWN_DEFAULT_HEIGHT);
 	Config cfg = Config_new();
 	Game game = {
 		.town_name = town_name,
 		.town = &town,
 		.cfg = &cfg,
+		.sim = Sim_new(&town),
+		.replaying = false,
+		.ai_turns = 0,
+		.ai_pass_ms = 0,
+		.ai_threads = 0,
+		.defer_checkpoints = false,
+		.checkpoint_due = false,
 		.game_state = GS_ACTIVE
 	};
+	Recorder recorder;
+	Lease lease;
+
+	// a lease would leave a lock file behind for a mistyped name
+	if (Town_exists(town_name) == false)
+	{
+		printf(MSG_ERR_FILE_LOAD);
+		Sim_clear(&game.sim);
+		Town_clear(&town);
+		return;
+	}
+
+	// keep the daemon and other connections off the town, a daemon tick ends soon
+	lease = Lease_take(town_name, 0);
+
+	if (lease.busy)
+	{
+		printf(MSG_TOWN_BUSY_WAIT);
+		lease = Lease_take(town_name, LEASE_CONNECT_WAIT_MS);
+	}
+
+	if (lease.invalid)
+	{
+		printf(lease.busy ? MSG_ERR_TOWN_BUSY : MSG_ERR_TOWN_LEASE);
+		Sim_clear(&game.sim);
+		Town_clear(&town);
+		return;
+	}
 
 	// load game
 	Town_load(&town, town_name);
 
 	if (town.invalid)
+	{
+		Lease_release(&lease);
+		Sim_clear(&game.sim);
+		Town_clear(&town);
 		return;
+	}
+
+	// open journal of actions since last full save
+	game.journal = Journal_open(town_name);
+
+	if (game.journal.invalid)
+		printf(MSG_WARN_FILE_JOURNAL);
+
+	// journal every action of the simulation
+	Sim_subscribe(&game.sim, Game_on_event, &game);
+
+	// record the session from the town as loaded
+	recorder = Recorder_open(town_name, &town);
+
+	if (recorder.invalid)
+		printf(MSG_WARN_FILE_RECORD);
+	else
+		Sim_subscribe(&game.sim, Recorder_on_event, &recorder);
+
+	// start background saves
+	Saver_new(&game.saver, town_name);
+
+	if (game.saver.invalid)
+		printf(MSG_WARN_SAVER_THREAD);
 
 	// read config
 	Config_load(&cfg);
+	ChunkStore_set_budget(&town.chunks, cfg.chunk_cache_mb);
 
 	/* start game part */
 	Game_main(&game);
@@ -280,17 +489,44 @@ void cmd_connect( const char *town_name )
 		break;
 	}
 
+	// wait for outstanding saves
+	Recorder_close(&recorder);
+	Saver_clear(&game.saver);
+	Journal_close(&game.journal);
+	Sim_clear(&game.sim);
+	Town_clear(&town);
+	Lease_release(&lease);
+
 	/* end print */
 	printf(MSG_CONNECTION_CLOSED);
 }
 
 void cmd_delete( const char *town_name )
 {
-	SM_String filepath = SM_String_new(16);
+	SM_String filepath;
+	Lease lease;
+
+	// a lease would leave a lock file behind for a mistyped name
+	if (Town_exists(town_name) == false)
+	{
+		printf(MSG_ERR_FILE_TOWN_DELETE);
+		return;
+	}
+
+	lease = Lease_take(town_name, 0);
+
+	if (lease.invalid)
+	{
+		printf(lease.busy ? MSG_ERR_TOWN_BUSY : MSG_ERR_TOWN_LEASE);
+		return;
+	}
+
+	filepath = SM_String_new(16);
 
 	// get path
 	if (get_town_path(&filepath) != 0)
 	{
+		Lease_release(&lease);
 		SM_String_clear(&filepath);
 		return;
 	}
@@ -302,9 +538,199 @@ void cmd_delete( const char *town_name )
 
 	// delete and check
 	if (remove(filepath.str) != 0)
+	{
 		printf(MSG_ERR_FILE_TOWN_DELETE);
+	}
 	else
+	{
+		// journal, chunk log, recordings and backups go with the town
+		SM_String_copy_cstr(&filepath, "");
+
+		if (get_town_file_path(&filepath, town_name, FILETYPE_JOURNAL) == 0)
+			remove(filepath.str);
+
+		SM_String_copy_cstr(&filepath, "");
+
+		if (get_town_file_path(&filepath, town_name, FILETYPE_CHUNKS) == 0)
+			remove(filepath.str);
+
+		Record_delete_all(town_name);
+		Backup_delete_all(town_name);
+
+		/* the lock file stays, someone waiting for the lease holds it open
+			and a new file of that name would be a second lock */
 		printf(MSG_FILE_TOWN_DELETE);
+	}
 
+	Lease_release(&lease);
 	SM_String_clear(&filepath);
 }
+
+void cmd_list_backups( const char *town_name )
+{
+	BackupInfo *infos = malloc(BACKUP_MAX_LISTED * sizeof(BackupInfo));
+	uint32_t count;
+
+	if (infos == NULL)
+		return;
+
+	count = Backup_list(town_name, infos, BACKUP_MAX_LISTED);
+
+	if (count == 0)
+		printf(MSG_BACKUP_NONE);
+
+	// newest first
+	for (uint32_t i = count; i > 0; i--)
+	{
+		printf(MSG_BACKUP_SUMMARY,
+			infos[i - 1].seq,
+			infos[i - 1].generation,
+			infos[i - 1].round / 24,
+			infos[i - 1].round % 24,
+			infos[i - 1].money);
+	}
+
+	free(infos);
+}
+
+void cmd_restore_backup( const char *town_name, const uint32_t seq )
+{
+	Lease lease = Lease_take(town_name, 0);
+	bool restored;
+
+	if (lease.invalid)
+	{
+		printf(lease.busy ? MSG_ERR_TOWN_BUSY : MSG_ERR_TOWN_LEASE);
+		return;
+	}
+
+	restored = Backup_restore(town_name, seq);
+	Lease_release(&lease);
+
+	if (restored == false)
+	{
+		printf(MSG_ERR_BACKUP_RESTORE);
+		return;
+	}
+
+	printf(MSG_BACKUP_RESTORE, seq);
+}
+
+void cmd_replay( const char *filepath )
+{
+	const clock_t start = clock();
+	ReplayResult result = Record_replay(filepath);
+	double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	if (result.invalid)
+	{
+		printf(MSG_ERR_FILE_RECORD);
+		return;
+	}
+
+	if (result.diverged)
+		printf(MSG_ERR_REPLAY_DIVERGED, result.round / 24, result.round % 24);
+
+	else if (result.complete == false)
+		printf(MSG_REPLAY_INCOMPLETE);
+
+	printf(MSG_REPLAY_RESULT,
+		result.actions,
+		result.rounds,
+		seconds,
+		(seconds > 0.0) ? result.rounds / seconds : 0.0,
+		result.round / 24,
+		result.round % 24,
+		result.hash);
+}
+
+static volatile sig_atomic_t daemon_quit = 0;
+
+static void daemon_on_signal( int signal_number )
+{
+	(void) signal_number;
+	daemon_quit = 1;
+}
+
+void cmd_daemon( const uint32_t round_seconds )
+{
+	const uint32_t period = round_seconds * 1000;
+	Config cfg = Config_new();
+	Catalog catalog;
+	const char **names;
+	DaemonTick tick;
+	uint32_t ts_last;
+	uint32_t rounds;
+	uint32_t count;
+
+	if (round_seconds == 0 || round_seconds > DAEMON_MAX_ROUND_SECONDS)
+	{
+		printf(MSG_ERR_DAEMON_SECONDS, DAEMON_MAX_ROUND_SECONDS);
+		return;
+	}
+
+	Config_load(&cfg);
+
+	/* end between ticks, never in the middle of one */
+	signal(SIGINT, daemon_on_signal);
+	signal(SIGTERM, daemon_on_signal);
+
+	printf(MSG_DAEMON_START, round_seconds);
+	ts_last = SDL_GetTicks();
+
+	while (daemon_quit == 0)
+	{
+		SDL_Delay(DAEMON_POLL_MS);
+
+		if (SDL_GetTicks() - ts_last < period)
+			continue;
+
+		// a late tick, like after a suspend, catches up on the rounds it missed
+		rounds = (SDL_GetTicks() - ts_last) / period;
+
+		if (rounds > GAME_PASS_MAX_ROUNDS)
+			rounds = GAME_PASS_MAX_ROUNDS;
+
+		ts_last += rounds * period;
+
+		// towns may come and go between ticks
+		catalog = Catalog_load();
+		Catalog_refresh(&catalog);
+
+		if (catalog.invalid)
+		{
+			printf(MSG_ERR_DIR_TOWNS);
+			Catalog_clear(&catalog);
+			continue;
+		}
+
+		names = malloc(catalog.count * sizeof(char *));
+		count = 0;
+
+		for (size_t i = 0; names != NULL && i < catalog.count; i++)
+		{
+			if (catalog.entries[i].header.invalid == false)
+				names[count++] = catalog.entries[i].name;
+		}
+
+		if (count > 0)
+		{
+			tick = Daemon_tick(names, count, rounds, &cfg);
+
+			printf(MSG_DAEMON_TICK,
+				count,
+				tick.advanced,
+				rounds,
+				tick.busy,
+				tick.stalled,
+				tick.failed,
+				tick.saved,
+				tick.seconds);
+		}
+
+		free(names);
+		Catalog_clear(&catalog);
+	}
+
+	printf(MSG_DAEMON_STOP);
+}
@@ -22,6 +22,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define BATCH_MAX_THREADS 32
+
 typedef struct CommandData
 {
 	char *name;
@@ -37,12 +39,17 @@ typedef enum Command
 	CMD_HELP,
 	CMD_LIST_ADMINS,
 	CMD_HIRE_ADMIN,
+	CMD_HIRE_ADMIN_BATCH,
 	CMD_LIST_TOWNS,
 	CMD_CONNECT,
 	CMD_DELETE_TOWN,
+	CMD_LIST_BACKUPS,
+	CMD_RESTORE_BACKUP,
+	CMD_REPLAY,
+	CMD_DAEMON,
 
 	CMD_FIRST = CMD_HELP,
-	CMD_LAST = CMD_DELETE_TOWN,
+	CMD_LAST = CMD_DAEMON,
 } Command ;
 
 typedef enum CommandDJB2
@@ -53,20 +60,34 @@ typedef enum CommandDJB2
     DJB2_LIST_ADMINS_ABBR = 6224205,
     DJB2_HIRE_ADMIN = 1600892068,
     DJB2_HIRE_ADMIN_ABBR = 6224069,
+    DJB2_HIRE_ADMIN_BATCH = 4138345638,
+    DJB2_HIRE_ADMIN_BATCH_ABBR = 211618444,
     DJB2_LIST_TOWNS = 468110531,
     DJB2_LIST_TOWNS_ABBR = 6224224,
     DJB2_CONNECT = 1335798814,
     DJB2_CONNECT_ABBR = 183053,
     DJB2_DELETE = 2218755409,
+    DJB2_LIST_BACKUPS = 1565251791,
+    DJB2_LIST_BACKUPS_ABBR = 6224206,
+    DJB2_RESTORE_BACKUP = 719999694,
+    DJB2_RESTORE_BACKUP_ABBR = 6224410,
+    DJB2_REPLAY = 2855016027,
+    DJB2_REPLAY_ABBR = 6224424,
+    DJB2_DAEMON = 2213144024,
 } CommandDJB2 ;
 
 static const CommandData DATA_CMDS[] = {
 	{"help", true, "h", "shows this message", false, ""},
 	{"list-admins", true, "la", "list all available administrators and their attributes", false, ""},
-	{"hire-admin", true, "ha", "hire an admin to watch over another place", true, "ADMIN_ID TOWN_NAME"},
-	{"list-towns", true, "lt", "list towns that are already controlled by you", false, ""},
+	{"hire-admin", true, "ha", "hire an admin to watch over another place, the same seed and size yield the same town", true, "ADMIN_ID TOWN_NAME [SEED [WIDTH HEIGHT]]"},
+	{"hire-admin-batch", true, "hab", "hire admins for many new towns at once, existing towns are skipped", true, "COUNT PREFIX SEED [WIDTH HEIGHT]"},
+	{"list-towns", true, "lt", "list towns that are already controlled by you, sorted by name, admin, round, money or mercs", true, "[SORT_BY]"},
 	{"connect", true, "c", "connect to a towns administrator and get to work", true, "TOWN_NAME"},
 	{"delete", false, "", "delete all files of a given town", true, "TOWN_NAME"},
+	{"list-backups", true, "lb", "list the kept backups of a town", true, "TOWN_NAME"},
+	{"restore-backup", true, "rb", "replace a town with one of its backups", true, "TOWN_NAME BACKUP"},
+	{"replay", true, "rp", "re-run a recorded session without display and check it plays out the same", true, "RECORD_FILE"},
+	{"daemon", false, "", "advance all towns without display, one round every SECONDS (default 60), connecting still works", true, "[SECONDS]"},
 };
 
 void cmd_help_menu( void );
@@ -75,12 +96,32 @@ void cmd_help_full( void );
 
 void cmd_list_admins( void );
 
-void cmd_hire_admin( const int32_t admin_id, const char *town_name );
+void cmd_hire_admin(
+	const int32_t admin_id,
+	const char *town_name,
+	const uint64_t seed,
+	const uint32_t width,
+	const uint32_t height );
+
+void cmd_hire_admin_batch(
+	const uint32_t count,
+	const char *prefix,
+	const uint64_t seed,
+	const uint32_t width,
+	const uint32_t height );
 
-void cmd_list_towns( void );
+void cmd_list_towns( const char *sort_by );
 
 void cmd_connect( const char *town_name );
 
 void cmd_delete( const char *town_name );
 
+void cmd_list_backups( const char *town_name );
+
+void cmd_restore_backup( const char *town_name, const uint32_t seq );
+
+void cmd_replay( const char *filepath );
+
+void cmd_daemon( const uint32_t round_seconds );
+
 #endif /* COMMANDS_H */
@@ -46,6 +46,8 @@ Config Config_new( void )
 		.field_border_green = CFG_STD_FIELD_BORDER_GREEN,
 		.field_border_blue = CFG_STD_FIELD_BORDER_BLUE,
 		.field_border_alpha = CFG_STD_FIELD_BORDER_ALPHA,
+		.chunk_cache_mb = CFG_STD_CHUNK_CACHE_MB,
+		.ai_turn_ms = CFG_STD_AI_TURN_MS,
 	};
 
 	strncpy(cfg.path_font, CFG_STD_PATH_FONT, CFG_SETTING_PATH_FONT_MAX_LEN);
@@ -134,6 +136,14 @@ void Config_load( Config *cfg )
 		else if (SM_strequal(dict.data[i].key.str, CFG_SETTING_FIELD_BORDER_ALPHA))
 			cfg->field_border_alpha = strtoul(dict.data[i].value.str, NULL, 10);
 
+		// memory
+		else if (SM_strequal(dict.data[i].key.str, CFG_SETTING_CHUNK_CACHE_MB))
+			cfg->chunk_cache_mb = strtoul(dict.data[i].value.str, NULL, 10);
+
+		// opponent
+		else if (SM_strequal(dict.data[i].key.str, CFG_SETTING_AI_TURN_MS))
+			cfg->ai_turn_ms = strtoul(dict.data[i].value.str, NULL, 10);
+
 		// unknown option
 		else
 			printf(MSG_WARN_UNKNOWN_SETTING, dict.data[i].key.str);
@@ -197,6 +207,12 @@ void Config_save( Config *cfg )
 	sprintf(temp, "%u", cfg->field_border_alpha);
 	SM_Dict_add(&dict, CFG_SETTING_FIELD_BORDER_ALPHA, temp);
 
+	sprintf(temp, "%u", cfg->chunk_cache_mb);
+	SM_Dict_add(&dict, CFG_SETTING_CHUNK_CACHE_MB, temp);
+
+	sprintf(temp, "%u", cfg->ai_turn_ms);
+	SM_Dict_add(&dict, CFG_SETTING_AI_TURN_MS, temp);
+
 	// save
 	if (!SM_Dict_write(&dict, filepath.str))
 		cfg->invalid = true;
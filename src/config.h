@@ -44,6 +44,8 @@ static const char CFG_SETTING_FIELD_BORDER_RED[] =		"field_border_red";
 static const char CFG_SETTING_FIELD_BORDER_GREEN[] =	"field_border_green";
 static const char CFG_SETTING_FIELD_BORDER_BLUE[] =		"field_border_blue";
 static const char CFG_SETTING_FIELD_BORDER_ALPHA[] =	"field_border_alpha";
+static const char CFG_SETTING_CHUNK_CACHE_MB[] =		"chunk_cache_mb";
+static const char CFG_SETTING_AI_TURN_MS[] =			"ai_turn_ms";
 
 #ifdef _WIN32
 	static const char CFG_STD_PATH_FONT[] =	"C:\\Windows\\Fonts\\Arial.ttf";
@@ -67,6 +69,8 @@ static const uint8_t CFG_STD_FIELD_BORDER_RED =		100;
 static const uint8_t CFG_STD_FIELD_BORDER_GREEN =	100;
 static const uint8_t CFG_STD_FIELD_BORDER_BLUE	=	255;
 static const uint8_t CFG_STD_FIELD_BORDER_ALPHA =	50;
+static const uint32_t CFG_STD_CHUNK_CACHE_MB =		64;		/* of resident town chunks */
+static const uint32_t CFG_STD_AI_TURN_MS =			500;	/* thinking time of the ai per turn, 0 disables it */
 
 typedef struct Config
 {
@@ -88,6 +92,8 @@ typedef struct Config
 	uint8_t field_border_green;
 	uint8_t field_border_blue;
 	uint8_t field_border_alpha;
+	uint32_t chunk_cache_mb;
+	uint32_t ai_turn_ms;
 } Config ;
 
 Config Config_new( void );
@@ -0,0 +1,228 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+#include "coordmap.h"
+
+static const uint32_t COORDMAP_MIN_SIZE = 16;
+
+/* coordinates are below 65536 per side */
+static uint32_t pack_coords( const SDL_Point coords )
+{
+	return ((uint32_t) coords.y << 16) | (uint32_t) coords.x;
+}
+
+static uint32_t CoordMap_home( const CoordMap *map, const uint32_t key )
+{
+	/* fibonacci hashing, only the high bits of the product depend on
+		all bits of key, the low ones would only see x */
+	return (key * 2654435769u) >> map->shift;
+}
+
+/* linear probing, returns slot holding key or the free slot ending its run */
+static uint32_t CoordMap_probe( const CoordMap *map, const uint32_t key )
+{
+	uint32_t i = CoordMap_home(map, key);
+
+	while (map->entries[i].key != key && map->entries[i].key != COORDMAP_NONE)
+		i = (i + 1) & (map->size - 1);
+
+	return i;
+}
+
+static bool CoordMap_grow( CoordMap *map )
+{
+	const uint32_t old_size = map->size;
+	CoordMapEntry *old = map->entries;
+	uint32_t slot;
+
+	map->size = (old_size == 0) ? COORDMAP_MIN_SIZE : old_size * 2;
+	map->entries = malloc(map->size * sizeof(CoordMapEntry));
+
+	if (map->entries == NULL)
+	{
+		map->entries = old;
+		map->size = old_size;
+		return false;
+	}
+
+	map->shift = 32;
+
+	for (uint32_t i = map->size; i > 1; i >>= 1)
+		map->shift--;
+
+	for (uint32_t i = 0; i < map->size; i++)
+		map->entries[i].key = COORDMAP_NONE;
+
+	for (uint32_t i = 0; i < old_size; i++)
+	{
+		if (old[i].key == COORDMAP_NONE)
+			continue;
+
+		slot = CoordMap_probe(map, old[i].key);
+		map->entries[slot] = old[i];
+	}
+
+	free(old);
+	return true;
+}
+
+CoordMap CoordMap_new( void )
+{
+	CoordMap result = {
+		.invalid = false,
+		.count = 0,
+		.size = 0,
+		.shift = 32,
+		.entries = NULL,
+	};
+
+	return result;
+}
+
+CoordMap CoordMap_copy( const CoordMap *map )
+{
+	CoordMap result = *map;
+
+	if (map->size == 0)
+		return result;
+
+	result.entries = malloc(map->size * sizeof(CoordMapEntry));
+
+	if (result.entries == NULL)
+	{
+		result = CoordMap_new();
+		result.invalid = true;
+		return result;
+	}
+
+	memcpy(result.entries, map->entries, map->size * sizeof(CoordMapEntry));
+
+	return result;
+}
+
+uint32_t CoordMap_get( const CoordMap *map, const SDL_Point coords )
+{
+	const uint32_t key = pack_coords(coords);
+	uint32_t slot;
+
+	if (map->count == 0)
+		return COORDMAP_NONE;
+
+	slot = CoordMap_probe(map, key);
+
+	return (map->entries[slot].key == key) ? map->entries[slot].value : COORDMAP_NONE;
+}
+
+bool CoordMap_set( CoordMap *map, const SDL_Point coords, const uint32_t value )
+{
+	const uint32_t key = pack_coords(coords);
+	uint32_t slot;
+
+	if (map->count > 0)
+	{
+		slot = CoordMap_probe(map, key);
+
+		if (map->entries[slot].key == key)
+		{
+			map->entries[slot].value = value;
+			return true;
+		}
+	}
+
+	/* keep load at or below one half */
+	if ((map->count + 1) * 2 > map->size && CoordMap_grow(map) == false)
+		return false;
+
+	slot = CoordMap_probe(map, key);
+	map->entries[slot].key = key;
+	map->entries[slot].value = value;
+	map->count++;
+
+	return true;
+}
+
+void CoordMap_remove( CoordMap *map, const SDL_Point coords )
+{
+	const uint32_t key = pack_coords(coords);
+	uint32_t slot;
+	uint32_t next;
+	uint32_t home;
+
+	if (map->count == 0)
+		return;
+
+	slot = CoordMap_probe(map, key);
+
+	if (map->entries[slot].key != key)
+		return;
+
+	/* shift later members of the run back, so no tombstones are needed */
+	next = slot;
+
+	while (true)
+	{
+		next = (next + 1) & (map->size - 1);
+
+		if (map->entries[next].key == COORDMAP_NONE)
+			break;
+
+		home = CoordMap_home(map, map->entries[next].key);
+
+		/* entry may move into slot only if slot lies between its home and next */
+		if (((next - home) & (map->size - 1)) >= ((next - slot) & (map->size - 1)))
+		{
+			map->entries[slot] = map->entries[next];
+			slot = next;
+		}
+	}
+
+	map->entries[slot].key = COORDMAP_NONE;
+	map->count--;
+}
+
+void CoordMap_clear( CoordMap *map )
+{
+	free(map->entries);
+
+	map->entries = NULL;
+	map->count = 0;
+	map->size = 0;
+	map->shift = 32;
+}
+
+#ifdef _DEBUG
+uint64_t CoordMap_displacement( const CoordMap *map )
+{
+	uint64_t result = 0;
+
+	for (uint32_t i = 0; i < map->size; i++)
+	{
+		if (map->entries[i].key == COORDMAP_NONE)
+			continue;
+
+		result += (i - CoordMap_home(map, map->entries[i].key)) & (map->size - 1);
+	}
+
+	return result;
+}
+#endif
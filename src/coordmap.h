@@ -0,0 +1,65 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COORDMAP_H
+#define COORDMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+
+/* hash map from field coordinates to a slot number, for indices that
+	stay small while the grid they refer to grows,
+	coordinates must lie within 0 to 65535 */
+#define COORDMAP_NONE UINT32_MAX
+
+typedef struct CoordMapEntry
+{
+	uint32_t key;			/* packed coordinates, COORDMAP_NONE if free */
+	uint32_t value;
+} CoordMapEntry ;
+
+typedef struct CoordMap
+{
+	bool invalid;
+	uint32_t count;
+	uint32_t size;			/* power of two, 0 until first use */
+	uint32_t shift;			/* 32 - log2(size) */
+	CoordMapEntry *entries;
+} CoordMap ;
+
+CoordMap CoordMap_new( void );
+
+CoordMap CoordMap_copy( const CoordMap *map );
+
+/* returns COORDMAP_NONE if coords are not mapped */
+uint32_t CoordMap_get( const CoordMap *map, const SDL_Point coords );
+
+/* adds or replaces, returns false if out of memory */
+bool CoordMap_set( CoordMap *map, const SDL_Point coords, const uint32_t value );
+
+void CoordMap_remove( CoordMap *map, const SDL_Point coords );
+
+void CoordMap_clear( CoordMap *map );
+
+#ifdef _DEBUG
+/* sum over all entries of how far they lie from their home slot */
+uint64_t CoordMap_displacement( const CoordMap *map );
+#endif
+
+#endif /* COORDMAP_H */
@@ -0,0 +1,298 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <SDL.h>
+#include "config.h"
+#include "lease.h"
+#include "journal.h"
+#include "saver.h"
+#include "sim.h"
+#include "town.h"
+#include "game.h"
+#include "daemon.h"
+
+typedef enum DaemonResult
+{
+	DR_ADVANCED,
+	DR_BUSY,
+	DR_STALLED,
+	DR_FAILED
+} DaemonResult ;
+
+/* what outlives a town between advancing and committing */
+typedef struct DaemonTown
+{
+	const char *name;
+	Lease lease;
+	Journal journal;
+	bool has_journal;
+	bool saved;
+	DaemonResult result;
+} DaemonTown ;
+
+typedef struct DaemonJob
+{
+	DaemonTown *towns;
+	uint32_t count;
+	uint32_t rounds;
+	uint32_t chunk_cache_mb;	/* per town, all workers share the configured cache */
+	Config cfg;
+	bool commit;				/* second pass */
+	SDL_atomic_t next;
+} DaemonJob ;
+
+static void Daemon_advance( DaemonJob *job, DaemonTown *dt )
+{
+	Town town;
+	Game game;
+	uint32_t passed;
+
+	// deleted since it was listed, taking the lease would leave a lock file behind
+	if (Town_exists(dt->name) == false)
+	{
+		dt->result = DR_FAILED;
+		return;
+	}
+
+	// a connected player keeps the town to itself
+	dt->lease = Lease_take(dt->name, 0);
+
+	if (dt->lease.invalid)
+	{
+		dt->result = dt->lease.busy ? DR_BUSY : DR_FAILED;
+		return;
+	}
+
+	town = Town_new(TOWN_DEFAULT_WIDTH, TOWN_DEFAULT_HEIGHT);
+	Town_load(&town, dt->name);
+
+	if (town.invalid)
+	{
+		Town_clear(&town);
+		Lease_release(&dt->lease);
+		dt->result = DR_FAILED;
+		return;
+	}
+
+	ChunkStore_set_budget(&town.chunks, job->chunk_cache_mb);
+
+	// the same way cmd_connect sets up a game, without display or recording,
+	// the workers already fill the cores so the ai gets one and barely any time
+	game = (Game) {
+		.town_name = dt->name,
+		.town = &town,
+		.cfg = &job->cfg,
+		.sim = Sim_new(&town),
+		.replaying = false,
+		.ai_turns = 0,
+		.ai_pass_ms = DAEMON_AI_PASS_MS,
+		.ai_threads = 1,
+		.defer_checkpoints = true,
+		.checkpoint_due = false,
+		.game_state = GS_ACTIVE
+	};
+	game.journal = Journal_open(dt->name);
+	game.journal.batched = true;
+
+	// rounds without a journal would be lost until the next checkpoint
+	if (game.journal.invalid)
+	{
+		Journal_close(&game.journal);
+		Sim_clear(&game.sim);
+		Town_clear(&town);
+		Lease_release(&dt->lease);
+		dt->result = DR_FAILED;
+		return;
+	}
+
+	Saver_new_inline(&game.saver, dt->name);
+	Sim_subscribe(&game.sim, Game_on_event, &game);
+	Sim_rebuild_fog(&game.sim);
+	// a full save every tick would wear out the backups, that waits for a checkpoint
+	Game_resume_journal(&game);
+
+	if (Game_pass(&game, job->rounds, SS_ROUNDS, 0, &passed) == SS_BANKRUPT)
+		dt->result = DR_STALLED;
+	else
+		dt->result = DR_ADVANCED;
+
+	// one save after the rounds of a day, so no record after it is cut off,
+	// its fresh journal is committed with the batch
+	if (game.checkpoint_due)
+		dt->saved = Game_save(&game);
+
+	dt->journal = game.journal;
+	dt->has_journal = true;
+
+	Saver_clear(&game.saver);
+	Sim_clear(&game.sim);
+	Town_clear(&town);
+}
+
+static void Daemon_commit( DaemonTown *dt )
+{
+	if (dt->has_journal)
+	{
+		Journal_commit(&dt->journal);
+
+		if (dt->journal.invalid)
+			dt->result = DR_FAILED;
+
+		Journal_close(&dt->journal);
+		dt->has_journal = false;
+	}
+
+	// only now someone else may load what was written
+	if (dt->lease.invalid == false)
+		Lease_release(&dt->lease);
+}
+
+static int Daemon_work( void *data )
+{
+	DaemonJob *job = data;
+	uint32_t i;
+
+	while ((i = SDL_AtomicAdd(&job->next, 1)) < job->count)
+	{
+		if (job->commit)
+			Daemon_commit(&job->towns[i]);
+		else
+			Daemon_advance(job, &job->towns[i]);
+	}
+
+	return 0;
+}
+
+/* runs one pass of job over its towns */
+static void Daemon_run( DaemonJob *job, const int thread_count )
+{
+	SDL_Thread *threads[DAEMON_MAX_THREADS];
+
+	SDL_AtomicSet(&job->next, 0);
+
+	for (int i = 0; i < thread_count; i++)
+		threads[i] = SDL_CreateThread(Daemon_work, "daemon", job);
+
+	/* this thread helps out, so the pass finishes even without workers */
+	Daemon_work(job);
+
+	for (int i = 0; i < thread_count; i++)
+	{
+		if (threads[i] != NULL)
+			SDL_WaitThread(threads[i], NULL);
+	}
+}
+
+DaemonTick Daemon_tick(
+	const char **town_names,
+	const uint32_t count,
+	const uint32_t rounds,
+	const Config *cfg )
+{
+	DaemonTick result = {0};
+	DaemonJob job = {
+		.rounds = rounds,
+		.cfg = *cfg,
+	};
+	const uint64_t ts_begin = SDL_GetPerformanceCounter();
+	DaemonTown *towns;
+	int thread_count;
+
+	towns = calloc(count, sizeof(DaemonTown));
+
+	if (towns == NULL)
+	{
+		result.failed = count;
+		return result;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		towns[i].name = town_names[i];
+		towns[i].lease.invalid = true;
+		towns[i].lease.fd = -1;
+	}
+
+	/* loading and saving mostly wait for the disk, so use more workers than cores */
+	thread_count = SDL_GetCPUCount() * 2;
+
+	if (thread_count > DAEMON_MAX_THREADS)
+		thread_count = DAEMON_MAX_THREADS;
+
+	if ((uint32_t) thread_count > count)
+		thread_count = count;
+
+	if ((uint32_t) thread_count > DAEMON_BATCH_TOWNS)
+		thread_count = DAEMON_BATCH_TOWNS;
+
+	job.chunk_cache_mb = cfg->chunk_cache_mb / (thread_count + 1);
+
+	if (job.chunk_cache_mb == 0)
+		job.chunk_cache_mb = 1;
+
+	// a bounded batch keeps descriptors and leases few, whatever the number of towns
+	for (uint32_t first = 0; first < count; first += DAEMON_BATCH_TOWNS)
+	{
+		job.towns = &towns[first];
+		job.count = count - first;
+
+		if (job.count > DAEMON_BATCH_TOWNS)
+			job.count = DAEMON_BATCH_TOWNS;
+
+		job.commit = false;
+		Daemon_run(&job, thread_count);
+
+		// group commit, every journal of the batch goes to disk in the same pass
+		job.commit = true;
+		Daemon_run(&job, thread_count);
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		switch (towns[i].result)
+		{
+		case DR_ADVANCED:
+			result.advanced++;
+			break;
+
+		case DR_BUSY:
+			result.busy++;
+			break;
+
+		case DR_STALLED:
+			result.stalled++;
+			break;
+
+		case DR_FAILED:
+			result.failed++;
+			break;
+		}
+
+		if (towns[i].saved)
+			result.saved++;
+	}
+
+	free(towns);
+
+	result.seconds = (double) (SDL_GetPerformanceCounter() - ts_begin) / SDL_GetPerformanceFrequency();
+
+	return result;
+}
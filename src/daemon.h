@@ -0,0 +1,58 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DAEMON_MAX_THREADS 32
+
+static const uint32_t DAEMON_STD_ROUND_SECONDS = 60;	/* real time per round */
+static const uint32_t DAEMON_MAX_ROUND_SECONDS = 24 * 60 * 60;
+static const uint32_t DAEMON_POLL_MS = 250;				/* how soon a signal is noticed */
+static const uint32_t DAEMON_BATCH_TOWNS = 64;			/* in flight at once, each holds a lease and a journal */
+static const uint32_t DAEMON_AI_PASS_MS = 10;			/* ai thinking per town and tick, on one core */
+
+typedef struct Config Config;
+
+/* what one tick did to the towns */
+typedef struct DaemonTick
+{
+	uint32_t advanced;
+	uint32_t busy;			/* held by a connection, left alone */
+	uint32_t stalled;		/* could not pay the running cost */
+	uint32_t failed;
+	uint32_t saved;			/* reached a checkpoint and got a full save */
+	double seconds;
+} DaemonTick ;
+
+/* advances each town by rounds on a pool of workers, like a connection passing them would.
+	Each town is leased while it is worked on, towns whose lease is taken are skipped.
+	Towns go in batches of DAEMON_BATCH_TOWNS, journals of a batch are only
+	flushed while its towns advance and committed to disk together
+	before its leases are released. A town only gets a full save
+	once a day passed in it. */
+DaemonTick Daemon_tick(
+	const char **town_names,
+	const uint32_t count,
+	const uint32_t rounds,
+	const Config *cfg );
+
+#endif /* DAEMON_H */
@@ -0,0 +1,370 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+#include "town.h"
+#include "fog.h"
+
+/* transforms of the eight octants */
+static const int8_t FOG_OCTANTS[8][4] = {
+	{1, 0, 0, 1},
+	{0, 1, 1, 0},
+	{0, -1, 1, 0},
+	{-1, 0, 0, 1},
+	{-1, 0, 0, -1},
+	{0, -1, -1, 0},
+	{0, 1, -1, 0},
+	{1, 0, 0, -1},
+};
+
+/* state of one shadowcasting pass */
+typedef struct FogCast
+{
+	Town *town;
+	FogViewer *viewer;
+	int32_t radius;
+	bool seen[FOG_WINDOW * FOG_WINDOW];	/* octants share their edges */
+} FogCast ;
+
+static bool blocks_sight( const Field field )
+{
+	return field != FIELD_EMPTY && field != FIELD_MERC;
+}
+
+Fog Fog_new( void )
+{
+	Fog result = {
+		.invalid = false,
+		.changed_count = 0,
+		.changed_size = 0,
+		.changed = NULL,
+		.spare_cells = NULL,
+	};
+
+	for (uint32_t i = 0; i < FOG_FRACTION_COUNT; i++)
+		result.visible[i] = CoordMap_new();
+
+	for (uint32_t i = 0; i < FOG_VIEWER_COUNT; i++)
+	{
+		result.viewers[i].active = false;
+		result.viewers[i].cell_count = 0;
+		result.viewers[i].cells = NULL;
+	}
+
+	return result;
+}
+
+static void Fog_record_change( Fog *fog, const SDL_Point coords )
+{
+	SDL_Point *changed;
+	uint32_t size;
+
+	if (fog->changed_count == fog->changed_size)
+	{
+		size = (fog->changed_size == 0) ? 64 : fog->changed_size * 2;
+		changed = realloc(fog->changed, size * sizeof(SDL_Point));
+
+		if (changed == NULL)
+		{
+			fog->invalid = true;
+			return;
+		}
+
+		fog->changed = changed;
+		fog->changed_size = size;
+	}
+
+	fog->changed[fog->changed_count] = coords;
+	fog->changed_count++;
+}
+
+static void Fog_add_sight( Fog *fog, const MercFraction fraction, const SDL_Point coords )
+{
+	const uint32_t count = CoordMap_get(&fog->visible[fraction], coords);
+
+	if (count == COORDMAP_NONE)
+	{
+		if (CoordMap_set(&fog->visible[fraction], coords, 1) == false)
+		{
+			fog->invalid = true;
+			return;
+		}
+
+		if (fraction == FOG_PLAYER_FRACTION)
+			Fog_record_change(fog, coords);
+	}
+	else
+	{
+		CoordMap_set(&fog->visible[fraction], coords, count + 1);
+	}
+}
+
+static void Fog_remove_sight( Fog *fog, const MercFraction fraction, const SDL_Point coords )
+{
+	const uint32_t count = CoordMap_get(&fog->visible[fraction], coords);
+
+	if (count == COORDMAP_NONE)
+		return;
+
+	if (count > 1)
+	{
+		CoordMap_set(&fog->visible[fraction], coords, count - 1);
+		return;
+	}
+
+	CoordMap_remove(&fog->visible[fraction], coords);
+
+	if (fraction == FOG_PLAYER_FRACTION)
+		Fog_record_change(fog, coords);
+}
+
+static void FogCast_see( FogCast *cast, const SDL_Point coords )
+{
+	const FogViewer *viewer = cast->viewer;
+	const uint32_t i = (coords.y - viewer->coords.y + FOG_MAX_RADIUS) * FOG_WINDOW +
+		(coords.x - viewer->coords.x + FOG_MAX_RADIUS);
+
+	if (cast->seen[i])
+		return;
+
+	cast->seen[i] = true;
+	cast->viewer->cells[cast->viewer->cell_count] = coords;
+	cast->viewer->cell_count++;
+}
+
+/* recursive shadowcasting of one octant, rows from row on, between two slopes */
+static void FogCast_octant(
+	FogCast *cast,
+	const int32_t row,
+	float start,
+	const float end,
+	const int8_t *octant )
+{
+	const SDL_Point origin = cast->viewer->coords;
+	const int32_t radius_sq = cast->radius * cast->radius + cast->radius;
+	float next_start = start;
+	float slope_l, slope_r;
+	bool blocked = false;
+	bool opaque;
+	SDL_Point coords;
+
+	if (start < end)
+		return;
+
+	for (int32_t distance = row; distance <= cast->radius && blocked == false; distance++)
+	{
+		const int32_t dy = -distance;
+
+		for (int32_t dx = -distance; dx <= 0; dx++)
+		{
+			slope_l = (dx - 0.5f) / (dy + 0.5f);
+			slope_r = (dx + 0.5f) / (dy - 0.5f);
+
+			if (start < slope_r)
+				continue;
+			else if (end > slope_l)
+				break;
+
+			coords.x = origin.x + dx * octant[0] + dy * octant[1];
+			coords.y = origin.y + dx * octant[2] + dy * octant[3];
+
+			/* outside the town counts as wall */
+			if (Town_coords_valid(cast->town, coords.x, coords.y) == false)
+			{
+				opaque = true;
+			}
+			else
+			{
+				if (dx * dx + dy * dy <= radius_sq)
+					FogCast_see(cast, coords);
+
+				opaque = blocks_sight(Town_get_field(cast->town, coords));
+			}
+
+			if (blocked)
+			{
+				if (opaque)
+				{
+					next_start = slope_r;
+					continue;
+				}
+
+				blocked = false;
+				start = next_start;
+			}
+			else if (opaque && distance < cast->radius)
+			{
+				blocked = true;
+				FogCast_octant(cast, distance + 1, start, slope_l, octant);
+				next_start = slope_r;
+			}
+		}
+	}
+}
+
+static void FogViewer_compute( FogViewer *viewer, Town *town )
+{
+	FogCast cast = {
+		.town = town,
+		.viewer = viewer,
+		.radius = viewer->radius,
+	};
+
+	memset(cast.seen, 0, sizeof(cast.seen));
+	viewer->cell_count = 0;
+	FogCast_see(&cast, viewer->coords);
+
+	for (uint32_t i = 0; i < 8; i++)
+		FogCast_octant(&cast, 1, 1.0f, 0.0f, FOG_OCTANTS[i]);
+}
+
+void Fog_set_viewer(
+	Fog *fog,
+	Town *town,
+	const uint32_t slot,
+	const MercFraction fraction,
+	const SDL_Point coords,
+	const uint32_t radius )
+{
+	FogViewer *viewer = &fog->viewers[slot];
+	FogViewer old = *viewer;
+	SDL_Point *cells;
+
+	/* compute into other cells, so old sight can be dropped afterwards */
+	cells = fog->spare_cells;
+	fog->spare_cells = NULL;
+
+	if (cells == NULL)
+		cells = malloc(FOG_WINDOW * FOG_WINDOW * sizeof(SDL_Point));
+
+	if (cells == NULL || Town_coords_valid(town, coords.x, coords.y) == false)
+	{
+		free(cells);
+		fog->invalid |= (cells == NULL);
+		Fog_remove_viewer(fog, slot);
+		return;
+	}
+
+	viewer->active = true;
+	viewer->fraction = fraction;
+	viewer->coords = coords;
+	viewer->radius = (radius > FOG_MAX_RADIUS) ? FOG_MAX_RADIUS : radius;
+	viewer->cells = cells;
+	FogViewer_compute(viewer, town);
+
+	/* add before remove, fields seen before and after never flip */
+	for (uint32_t i = 0; i < viewer->cell_count; i++)
+		Fog_add_sight(fog, fraction, viewer->cells[i]);
+
+	if (old.active)
+	{
+		for (uint32_t i = 0; i < old.cell_count; i++)
+			Fog_remove_sight(fog, old.fraction, old.cells[i]);
+	}
+
+	fog->spare_cells = old.cells;
+}
+
+void Fog_remove_viewer( Fog *fog, const uint32_t slot )
+{
+	FogViewer *viewer = &fog->viewers[slot];
+
+	if (viewer->active == false)
+		return;
+
+	for (uint32_t i = 0; i < viewer->cell_count; i++)
+		Fog_remove_sight(fog, viewer->fraction, viewer->cells[i]);
+
+	viewer->active = false;
+	viewer->cell_count = 0;
+}
+
+void Fog_rebuild( Fog *fog, Town *town )
+{
+	for (uint32_t i = 0; i < FOG_VIEWER_COUNT; i++)
+		Fog_remove_viewer(fog, i);
+
+	Fog_set_viewer(fog, town, FOG_VIEWER_HQ, FOG_PLAYER_FRACTION,
+		Town_get_hq_spawn(town), TOWN_EXPOSURE_RADIUS);
+
+	for (uint32_t i = 0; i < town->merc_count; i++)
+	{
+		if (town->mercs[i].hp == 0)
+			continue;
+
+		Fog_set_viewer(fog, town, i, town->mercs[i].fraction, town->mercs[i].coords,
+			DATA_MERCENARIES[town->mercs[i].id].sight);
+	}
+}
+
+void Fog_field_changed( Fog *fog, Town *town, const SDL_Point coords, const Field old_field )
+{
+	FogViewer *viewer;
+
+	if (blocks_sight(old_field) == blocks_sight(Town_get_field(town, coords)))
+		return;
+
+	/* only viewers in whose radius the field lies can be affected */
+	for (uint32_t i = 0; i < FOG_VIEWER_COUNT; i++)
+	{
+		viewer = &fog->viewers[i];
+
+		if (viewer->active == false ||
+			(uint32_t) abs(coords.x - viewer->coords.x) > viewer->radius ||
+			(uint32_t) abs(coords.y - viewer->coords.y) > viewer->radius)
+			continue;
+
+		Fog_set_viewer(fog, town, i, viewer->fraction, viewer->coords, viewer->radius);
+	}
+}
+
+bool Fog_visible( const Fog *fog, const MercFraction fraction, const SDL_Point coords )
+{
+	return CoordMap_get(&fog->visible[fraction], coords) != COORDMAP_NONE;
+}
+
+void Fog_reset_changes( Fog *fog )
+{
+	fog->changed_count = 0;
+}
+
+void Fog_clear( Fog *fog )
+{
+	for (uint32_t i = 0; i < FOG_FRACTION_COUNT; i++)
+		CoordMap_clear(&fog->visible[i]);
+
+	for (uint32_t i = 0; i < FOG_VIEWER_COUNT; i++)
+	{
+		free(fog->viewers[i].cells);
+		fog->viewers[i].cells = NULL;
+		fog->viewers[i].active = false;
+		fog->viewers[i].cell_count = 0;
+	}
+
+	free(fog->spare_cells);
+	fog->spare_cells = NULL;
+
+	free(fog->changed);
+	fog->changed = NULL;
+	fog->changed_count = 0;
+	fog->changed_size = 0;
+}
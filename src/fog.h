@@ -0,0 +1,93 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FOG_H
+#define FOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+#include "mercs.h"
+#include "coordmap.h"
+#include "town.h"
+
+#define FOG_FRACTION_COUNT (MF_PURPLE + 1)
+#define FOG_VIEWER_HQ MERCENARY_COUNT		/* viewer slot of the headquarter */
+#define FOG_VIEWER_COUNT (MERCENARY_COUNT + 1)
+
+#define FOG_MAX_RADIUS 15
+#define FOG_WINDOW (2 * FOG_MAX_RADIUS + 1)
+
+/* whose visibility reaches the hud and uncovers hidden fields */
+static const MercFraction FOG_PLAYER_FRACTION = MF_GREEN;
+
+/* one source of sight, a merc or the headquarter */
+typedef struct FogViewer
+{
+	bool active;
+	MercFraction fraction;
+	SDL_Point coords;
+	uint32_t radius;
+	uint32_t cell_count;
+	SDL_Point *cells;		/* fields it sees, FOG_WINDOW squared at most */
+} FogViewer ;
+
+/* visibility per fraction by shadowcasting, trees and buildings block sight.
+	Each viewer remembers what it sees, so a moved, removed or obstructed
+	viewer only recomputes its own surroundings. */
+typedef struct Fog
+{
+	bool invalid;
+	CoordMap visible[FOG_FRACTION_COUNT];	/* field to number of viewers seeing it */
+	FogViewer viewers[FOG_VIEWER_COUNT];
+	SDL_Point *spare_cells;		/* swapped with a viewer's cells on recompute */
+
+	/* fields where visibility of FOG_PLAYER_FRACTION changed */
+	uint32_t changed_count;
+	uint32_t changed_size;
+	SDL_Point *changed;
+} Fog ;
+
+Fog Fog_new( void );
+
+/* sets viewers from the headquarter and all living mercs of town */
+void Fog_rebuild( Fog *fog, Town *town );
+
+/* (re)places viewer slot at coords */
+void Fog_set_viewer(
+	Fog *fog,
+	Town *town,
+	const uint32_t slot,
+	const MercFraction fraction,
+	const SDL_Point coords,
+	const uint32_t radius );
+
+void Fog_remove_viewer( Fog *fog, const uint32_t slot );
+
+/* call after a field changed, viewers nearby recompute if it changed
+	whether it blocks sight */
+void Fog_field_changed( Fog *fog, Town *town, const SDL_Point coords, const Field old_field );
+
+bool Fog_visible( const Fog *fog, const MercFraction fraction, const SDL_Point coords );
+
+/* forgets recorded changes */
+void Fog_reset_changes( Fog *fog );
+
+void Fog_clear( Fog *fog );
+
+#endif /* FOG_H */
@@ -31,11 +31,11 @@
 #include "commands.h"
 #include "messages.h"
 #include "path.h"
-#include "admins.h"
 #include "town.h"
 #include "config.h"
 #include "hud.h"
 #include "game_commands.h"
+#include "ai.h"
 #include "game.h"
 
 static const uint_fast8_t MAX_ARGS = 16;
@@ -55,6 +55,10 @@ void Game_issue_command( Game *game, Hud *hud, const char *str )
 	bool valid_field;
 	Mercenary merc_id;
 	MercFraction frac_id;
+	uint32_t rounds;
+	SimStop stop;
+	uint32_t money_below;
+	uint32_t rollouts;
 
 	// parse input
 	splits[0] = &str[0];
@@ -100,7 +104,7 @@ void Game_issue_command( Game *game, Hud *hud, const char *str )
 			printf(MSG_WARN_ARG_MAX);
 		}*/
 
-		gm_cmd_save(hud, game->town_name, game->town);
+		gm_cmd_save(game, hud);
 		break;
 
 	case DJB2_GM_SAVE_AS:
@@ -145,6 +149,7 @@ void Game_issue_command( Game *game, Hud *hud, const char *str )
 		}*/
 
 		gm_cmd_config_set(hud, game->cfg, argv[1], argv[2]);
+		ChunkStore_set_budget(&game->town->chunks, game->cfg->chunk_cache_mb);
 		break;
 
 	/*case DJB2_GM_CONFIG_SHOW:
@@ -164,7 +169,54 @@ void Game_issue_command( Game *game, Hud *hud, const char *str )
 			printf(MSG_WARN_ARG_MAX);
 		}*/
 
-		gm_cmd_pass(game, hud);
+		// parse args, no args passes one round
+		rounds = 1;
+		stop = SS_ROUNDS;
+		money_below = 0;
+
+		if (argc > 1 && strcmp(argv[1], "until") == 0)
+		{
+			// check arg min
+			if (argc < 3 || (strcmp(argv[2], "money") == 0 && argc < 4))
+			{
+				Hud_update_feedback(hud, GM_MSG_ERR_MIN_ARG);
+				return;
+			}
+
+			rounds = GAME_PASS_MAX_ROUNDS;
+
+			if (strcmp(argv[2], "construction") == 0)
+			{
+				stop = SS_CONSTRUCTION_DONE;
+			}
+			else if (strcmp(argv[2], "money") == 0)
+			{
+				stop = SS_MONEY_BELOW;
+				money_below = strtoul(argv[3], NULL, 10);
+			}
+			else
+			{
+				Hud_update_feedback(hud, GM_MSG_ERR_PASS);
+				return;
+			}
+		}
+		else if (argc > 1)
+		{
+			rounds = strtoul(argv[1], NULL, 10);
+		}
+
+		gm_cmd_pass(game, hud, rounds, stop, money_below);
+		break;
+
+	case DJB2_GM_KEEP_BACKUPS:
+		// check arg min
+		if (argc < 2)
+		{
+			Hud_update_feedback(hud, GM_MSG_ERR_MIN_ARG);
+			return;
+		}
+
+		gm_cmd_keep_backups(game, hud, argv[1]);
 		break;
 
 #ifdef _DEBUG
@@ -206,9 +258,41 @@ void Game_issue_command( Game *game, Hud *hud, const char *str )
 		dest_coord.x = strtol(argv[3], NULL, 10);
 		dest_coord.y = strtol(argv[4], NULL, 10);
 
+		if (Town_coords_valid(game->town, coord.x, coord.y) == false ||
+			Town_coords_valid(game->town, dest_coord.x, dest_coord.y) == false)
+		{
+			Hud_update_feedback(hud, GM_MSG_MERC_COORD_INVALID);
+			return;
+		}
+
 		gm_cmd_merc_move(game, hud, coord, dest_coord);
 		break;
 
+	case DJB2_GM_MERC_PATH:
+	case DJB2_GM_MERC_PATH_ABBR:
+		// check arg min
+		if (argc < 5)
+		{
+			Hud_update_feedback(hud, GM_MSG_ERR_MIN_ARG);
+			return;
+		}
+
+		// parse args
+		coord.x = strtol(argv[1], NULL, 10);
+		coord.y = strtol(argv[2], NULL, 10);
+		dest_coord.x = strtol(argv[3], NULL, 10);
+		dest_coord.y = strtol(argv[4], NULL, 10);
+
+		if (Town_coords_valid(game->town, coord.x, coord.y) == false ||
+			Town_coords_valid(game->town, dest_coord.x, dest_coord.y) == false)
+		{
+			Hud_update_feedback(hud, GM_MSG_MERC_COORD_INVALID);
+			return;
+		}
+
+		gm_cmd_merc_path(game, hud, coord, dest_coord);
+		break;
+
 	case DJB2_GM_MERC_ATTACK:
 	case DJB2_GM_MERC_ATTACK_ABBR:
 		// check arg min
@@ -225,9 +309,42 @@ void Game_issue_command( Game *game, Hud *hud, const char *str )
 		dest_coord.x = strtol(argv[4], NULL, 10);
 		dest_coord.y = strtol(argv[5], NULL, 10);
 
+		if (Town_coords_valid(game->town, coord.x, coord.y) == false ||
+			Town_coords_valid(game->town, dest_coord.x, dest_coord.y) == false)
+		{
+			Hud_update_feedback(hud, GM_MSG_MERC_COORD_INVALID);
+			return;
+		}
+
 		gm_cmd_merc_attack(game, hud, coord, weapon_slot, dest_coord);
 		break;
 
+	case DJB2_GM_MERC_ESTIMATE:
+	case DJB2_GM_MERC_ESTIMATE_ABBR:
+		// check arg min
+		if (argc < 5)
+		{
+			Hud_update_feedback(hud, GM_MSG_ERR_MIN_ARG);
+			return;
+		}
+
+		// parse args, rollouts are optional
+		coord.x = strtol(argv[1], NULL, 10);
+		coord.y = strtol(argv[2], NULL, 10);
+		dest_coord.x = strtol(argv[3], NULL, 10);
+		dest_coord.y = strtol(argv[4], NULL, 10);
+		rollouts = argc > 5 ? strtoul(argv[5], NULL, 10) : AI_ESTIMATE_ROLLOUTS;
+
+		if (Town_coords_valid(game->town, coord.x, coord.y) == false ||
+			Town_coords_valid(game->town, dest_coord.x, dest_coord.y) == false)
+		{
+			Hud_update_feedback(hud, GM_MSG_MERC_COORD_INVALID);
+			return;
+		}
+
+		gm_cmd_merc_estimate(game, hud, coord, dest_coord, rollouts);
+		break;
+
 	case DJB2_GM_DESTRUCT:
 	case DJB2_GM_DESTRUCT_ABBR:
 		// check arg min
@@ -273,8 +390,7 @@ void Game_issue_command( Game *game, Hud *hud, const char *str )
 			return;
 		}
 
-		if (coord.x < 0 || coord.y < 0 ||
-			coord.x > TOWN_WIDTH || coord.y > TOWN_HEIGHT)
+		if (Town_coords_valid(game->town, coord.x, coord.y) == false)
 		{
 			Hud_update_feedback(hud, GM_MSG_CONSTRUCT_COORD_INVALID);
 			return;
@@ -298,277 +414,324 @@ void Game_issue_command( Game *game, Hud *hud, const char *str )
 	}
 }
 
-void Game_end_round( Game *game, Hud *hud )
+static void Game_log( Game *game, const JournalEntry entry )
 {
-	uint32_t cost = 0;
+	/* replayed records are already in the journal */
+	if (game->replaying)
+		return;
 
-	/* get running cost for admin */
-	cost += DATA_ADMINS[game->town->admin_id].salary;
+	Journal_append(&game->journal, &entry);
+}
 
-	/* for each building, add cost */
-	for (uint32_t x = 0; x < TOWN_WIDTH; x++)
-	{
-		for (uint32_t y = 0; y < TOWN_HEIGHT; y++)
-		{
-			cost += DATA_FIELDS[game->town->field[x][y]].running_cost;
-		}
-	}
+void Game_on_event( void *ctx, const SimEvent *event )
+{
+	Game *game = ctx;
 
-	/* if cost is not higher than current money */
-	if (cost < game->town->money)
-	{
-		/* subtract running cost from players money */
-		game->town->money -= cost;
-	}
-	else
+	switch (event->type)
 	{
-		/* gameover */
-		game->game_state = GS_FAILURE_COST;
-		return;
-	}
+	case SE_CONSTRUCTED:
+		Game_log(game, (JournalEntry) {
+			.type = JR_CONSTRUCT,
+			.coord = event->coords,
+			.arg = event->field,
+		});
+		break;
 
-	/* for all constructions */
-	for (uint32_t i = 0; i < game->town->construction_count; i++)
-	{
-		/* increment progress */
-		game->town->constructions[i].progress++;
+	case SE_MERC_SPAWNED:
+		Game_log(game, (JournalEntry) {
+			.type = JR_SPAWN_MERC,
+			.coord = event->coords,
+			.arg = event->arg,
+			.arg2 = event->arg2,
+		});
+		break;
+
+	case SE_MERC_MOVED:
+		Game_log(game, (JournalEntry) {
+			.type = JR_MOVE_MERC,
+			.coord = event->coords,
+			.dest_coord = event->dest,
+		});
+		break;
+
+	case SE_MERC_ATTACKED:
+		Game_log(game, (JournalEntry) {
+			.type = JR_MERC_ATTACK,
+			.coord = event->coords,
+			.dest_coord = event->dest,
+			.arg = event->arg,
+		});
+		break;
 
-		/* if building is done */
-		if (game->town->constructions[i].progress >=
-			DATA_FIELDS[game->town->constructions[i].field].construction_time)
+	case SE_ROUND_ENDED:
+		/* log rounds, every now and then fold journal into a full save */
+		if (event->rounds == 1)
+			Game_log(game, (JournalEntry) {.type = JR_ROUND_END});
+		else
+			Game_log(game, (JournalEntry) {.type = JR_ROUNDS_END, .rounds = event->rounds});
+
+		if (game->replaying == false &&
+			event->value / GAME_CHECKPOINT_ROUNDS != (event->value - event->rounds) / GAME_CHECKPOINT_ROUNDS)
 		{
-            /* set field to actual building */
-            game->town->field
-            	[game->town->constructions[i].coords.x]
-            	[game->town->constructions[i].coords.y]
-            	= game->town->constructions[i].field;
-
-            /* update hud */
-            Hud_set_field(
-            	hud,
-            	game->town->constructions[game->town->construction_count - 1].coords,
-            	hud->spr_fields[game->town->constructions[i].field].texture);
-
-            /* remove entry from construction list */
-            Town_construction_list_remove(game->town, i);
+			if (game->defer_checkpoints)
+				game->checkpoint_due = true;
+			else
+				Game_checkpoint(game);
 		}
-	}
+		break;
 
-	// reset mercenaries move counter and attacked flag
-	for (uint32_t i = 0; i < game->town->merc_count; i++)
-	{
-		game->town->mercs[i].moved = 0;
-		game->town->mercs[i].attacked = false;
+	default:
+		break;
 	}
+}
 
-	/* increment time */
-	game->town->round++;
+/* hands a snapshot to the saver, the journal keeps going until a save is confirmed */
+void Game_checkpoint( Game *game )
+{
+#ifdef _DEBUG
+	/* a full rescan per round would defeat the counts, once per save catches drift
+		before it gets persisted */
+	if (Town_verify_field_counts(game->town) == false)
+		printf(MSG_ERR_FIELD_COUNTS);
 
-	/* save file */
-	Town_save(game->town, game->town_name);
+	if (Town_verify_merc_index(game->town) == false)
+		printf(MSG_ERR_MERC_INDEX);
+#endif
 
-	/* update hud */
-	Hud_update_time(hud, game->town->round);
-	Hud_update_money(hud, game->town->money);
+	game->town->generation++;
+
+	/* mark the point after which records apply to the new generation */
+	Game_log(game, (JournalEntry) {
+		.type = JR_CHECKPOINT,
+		.generation = game->town->generation,
+	});
+
+	Saver_submit(&game->saver, game->town);
 }
 
-bool Game_construct( Game *game, Hud *hud, const SDL_Point coords, const Field field )
+/* checkpoints and waits for the save, then starts a clean journal */
+bool Game_save( Game *game )
 {
-	// if destruction wished
-	if (field == FIELD_EMPTY)
-	{
-		// if field is empty or headquarter, stop
-		if (game->town->field[coords.x][coords.y] == FIELD_EMPTY ||
-			game->town->field[coords.x][coords.y] == FIELD_ADMINISTRATION)
-			return false;
-	}
-	else // if construction wished
-	{
-		// if field is not empty, stop
-		if (game->town->field[coords.x][coords.y] != FIELD_EMPTY)
-			return false;
-	}
+	Game_checkpoint(game);
 
-	/* change field */
-	game->town->field[coords.x][coords.y] = FIELD_CONSTRUCTION;
-
-	/* add building to construction list */
-	game->town->construction_count++;
-	game->town->constructions[game->town->construction_count - 1].field = field;
-	game->town->constructions[game->town->construction_count - 1].coords = coords;
-	game->town->constructions[game->town->construction_count - 1].progress = 0;
+	if (Saver_drain(&game->saver) == false)
+		return false;
 
-	/* subtract cost of building */
-	game->town->money -= DATA_FIELDS[field].construction_cost;
+	Journal_reset(&game->journal, game->town->generation);
 
-	/* update hud */
-	Hud_update_money(hud, game->town->money);
-	Hud_set_field(hud, coords, hud->spr_fields[FIELD_CONSTRUCTION].texture);
+	/* nothing is being written now, so stale chunk records can go */
+	Town_compact(game->town, game->town_name);
 
 	return true;
 }
 
-bool Game_spawn_merc( Game *game, Hud *hud, const TownMerc merc )
+/* applies the records after the loaded save, returns how many,
+	applies tells whether records appended now would apply on the next load */
+static uint32_t Game_apply_journal( Game *game, bool *applies )
 {
-	// if field is not empty, stop
-	if (game->town->field[merc.coords.x][merc.coords.y] != FIELD_EMPTY)
-		return false;
+	JournalEntry entry;
+	uint32_t count = 0;
+	uint32_t passed;
 
-	// if merc already exists, stop
-	for (uint32_t i = 0; i < game->town->merc_count; i++)
+	/* records apply after the base or the checkpoint of the loaded save,
+		earlier ones are already part of it */
+	*applies = (game->journal.base_generation == game->town->generation);
+	game->replaying = true;
+
+	while (Journal_next(&game->journal, &entry))
 	{
-		if (merc.id == game->town->mercs[i].id)
+		if (*applies == false)
 		{
-			return false;
+			*applies = (entry.type == JR_CHECKPOINT && entry.generation == game->town->generation);
+			continue;
 		}
-	}
 
-	// add to merc list
-	game->town->merc_count++;
-	game->town->mercs[game->town->merc_count - 1] = merc;
+		switch (entry.type)
+		{
+		case JR_ROUND_END:
+			Game_end_round(game);
+			break;
 
-    // update town
-	game->town->field[merc.coords.x][merc.coords.y] = FIELD_MERC;
+		case JR_ROUNDS_END:
+			Game_end_rounds(game, entry.rounds, SS_ROUNDS, 0, &passed);
+			break;
 
-    // update hud
-	Hud_set_field(hud, merc.coords, hud->spr_merc_base.texture);
+		case JR_CONSTRUCT:
+			Sim_construct(&game->sim, entry.coord, entry.arg);
+			break;
 
-	return true;
-}
+		case JR_SPAWN_MERC:
+			if (entry.arg >= MERCENARY_COUNT)
+				break;
 
-bool Game_move_merc( Game *game, Hud *hud, const SDL_Point src_coord, const SDL_Point dest_coord )
-{
-	uint32_t merc;
-	uint32_t distance;
+			Sim_spawn_merc(&game->sim, (TownMerc) {
+				.id = entry.arg,
+				.coords = entry.coord,
+				.hp = DATA_MERCENARIES[entry.arg].max_hp,
+				.fraction = entry.arg2,
+			});
+			break;
 
-	// check if src_coord has mercenary
-	if (game->town->field[src_coord.x][src_coord.y] != FIELD_MERC)
-		return false;
+		case JR_MOVE_MERC:
+			Sim_move_merc(&game->sim, entry.coord, entry.dest_coord);
+			break;
+
+		case JR_MERC_ATTACK:
+			Sim_merc_attack(&game->sim, entry.coord, entry.arg, entry.dest_coord);
+			break;
 
-    // check if destination is empty
-    if (game->town->field[dest_coord.x][dest_coord.y] != FIELD_EMPTY)
-    	return false;
-
-    // find merc in list
-    for (uint_fast32_t i = 0; i < game->town->merc_count; i++)
-    {
-    	if (game->town->mercs[i].coords.x == src_coord.x &&
-    		game->town->mercs[i].coords.y == src_coord.y)
-    	{
-    		merc = i;
-    	}
+		case JR_CHECKPOINT:
+			/* that save never made it to disk, state matches it again here */
+			game->town->generation = entry.generation;
+			continue;
+		}
+
+		count++;
 	}
 
-	// check if merc can travel so far
-	distance = get_distance(src_coord, dest_coord);
+	game->replaying = false;
 
-	if (DATA_MERCENARIES[game->town->mercs[merc].id].range - game->town->mercs[merc].moved < distance)
-		return false;
+	return count;
+}
+
+void Game_replay_journal( Game *game )
+{
+	bool applies;
+
+	if (game->journal.invalid)
+		return;
 
+	/* fold replayed records into a fresh save, else start a clean journal */
+	if (Game_apply_journal(game, &applies) > 0)
+		Game_save(game);
 	else
-		game->town->mercs[merc].moved += distance;
+		Journal_reset(&game->journal, game->town->generation);
+}
 
-	// move merc field
-    game->town->field[src_coord.x][src_coord.y] = FIELD_EMPTY;
-    game->town->field[dest_coord.x][dest_coord.y] = FIELD_MERC;
+void Game_resume_journal( Game *game )
+{
+	bool applies;
 
-    // update merc in list
-	game->town->mercs[merc].coords.x = dest_coord.x;
-    game->town->mercs[merc].coords.y = dest_coord.y;
+	if (game->journal.invalid)
+		return;
 
-    // update hud
-    Hud_set_field(hud, src_coord, hud->spr_fields[FIELD_EMPTY].texture);
-    Hud_set_field(hud, dest_coord, hud->spr_merc_base.texture);
+	Game_apply_journal(game, &applies);
 
-	return true;
+	/* records nobody would replay are no use to keep */
+	if (applies)
+		Journal_continue(&game->journal);
+	else
+		Journal_reset(&game->journal, game->town->generation);
 }
 
-int_fast32_t Game_merc_attack(
-	Game *game, Hud *hud,
-	const SDL_Point src_coord,
-	const uint_fast8_t weapon_slot,
-	const SDL_Point dest_coord )
+void Game_end_round( Game *game )
 {
-	MercWeapon weapon;
-	int_fast32_t damage;
-	uint_fast32_t distance;
-	float dmg_falloff;
-	uint32_t source_merc;
-	uint32_t target_merc;
-
-	// check if src_coord has mercenary
-	if (game->town->field[src_coord.x][src_coord.y] != FIELD_MERC)
-		return 0;
-
-	// check if destination is valid target
-	if (game->town->field[dest_coord.x][dest_coord.y] != FIELD_MERC)
-		return 0;
-
-	// find used weapon
-	for (uint_fast32_t i = 0; i < game->town->merc_count; i++)
-    {
-    	if (game->town->mercs[i].coords.x == src_coord.x &&
-    		game->town->mercs[i].coords.y == src_coord.y)
-    	{
-			weapon = DATA_MERCENARIES[game->town->mercs[i].id].loadout[weapon_slot];
-			break;
-    	}
-	}
+	uint32_t passed;
+
+	Game_end_rounds(game, 1, SS_ROUNDS, 0, &passed);
+}
+
+SimStop Game_end_rounds(
+	Game *game,
+	const uint32_t max_rounds,
+	const SimStop stop,
+	const uint32_t money_below,
+	uint32_t *passed )
+{
+	const SimStop result = Sim_end_rounds(&game->sim, max_rounds, stop, money_below, passed);
 
-    // if not in range, stop
-    distance = get_distance(src_coord, dest_coord);
+	if (result == SS_BANKRUPT)
+		game->game_state = GS_FAILURE_COST;
 
-	if (DATA_WEAPONS[weapon].range < distance)
-		return 0;
+	return result;
+}
 
-	// calculate damage
-	damage = DATA_WEAPONS[weapon].damage;
+/* whether the ai plays and has mercs to play */
+static bool Game_ai_active( const Game *game )
+{
+	if (game->cfg->ai_turn_ms == 0)
+		return false;
 
-	if (DATA_WEAPONS[weapon].damage_falloff)
+	for (uint32_t i = 0; i < game->town->merc_count; i++)
 	{
-		dmg_falloff = 1.5f - ((float) (distance) / (float) DATA_WEAPONS[weapon].range);
-		damage *= dmg_falloff;
+		if (game->town->mercs[i].hp > 0 && game->town->mercs[i].fraction == GAME_AI_FRACTION)
+			return true;
 	}
 
-	// find source and target merc in list
-	for (uint_fast32_t i = 0; i < game->town->merc_count; i++)
-    {
-    	if (game->town->mercs[i].coords.x == src_coord.x &&
-    		game->town->mercs[i].coords.y == src_coord.y)
-    	{
-    		source_merc = i;
-    	}
-
-    	if (game->town->mercs[i].coords.x == dest_coord.x &&
-    		game->town->mercs[i].coords.y == dest_coord.y)
-    	{
-    		target_merc = i;
-		}
-	}
+	return false;
+}
+
+void Game_ai_turn( Game *game, const uint32_t budget_ms )
+{
+	AiPlan plan;
+
+	if (Game_ai_active(game) == false)
+		return;
+
+	// reads the board on this thread, what it plays is journaled like any player action
+	plan = Ai_plan(
+		game->town,
+		GAME_AI_FRACTION,
+		budget_ms < game->cfg->ai_turn_ms ? budget_ms : game->cfg->ai_turn_ms,
+		game->ai_threads);
+
+	if (plan.invalid)
+		return;
 
-	// if source merc can not attack, stop
-	if (game->town->mercs[source_merc].attacked)
-		return 0;
+	Ai_play(&game->sim, &plan);
+	game->ai_turns++;
+}
 
-	// set attacked flag
-	game->town->mercs[source_merc].attacked = true;
+SimStop Game_pass(
+	Game *game,
+	const uint32_t max_rounds,
+	const SimStop stop,
+	const uint32_t money_below,
+	uint32_t *passed )
+{
+	const uint32_t start = SDL_GetTicks();
+	SimStop result = SS_ROUNDS;
+	uint32_t pass_ms = game->ai_pass_ms;
+	uint32_t spent = 0;
+	uint32_t step;
 
-	// if damage is lethal
-	if (damage >= game->town->mercs[target_merc].hp)
+	*passed = 0;
+
+	if (pass_ms == 0)
+		pass_ms = game->cfg->ai_turn_ms > GAME_PASS_AI_MS ? game->cfg->ai_turn_ms : GAME_PASS_AI_MS;
+
+	// the pass runs on the event loop, long ones must not hang it
+	while (*passed < max_rounds && spent < pass_ms && Game_ai_active(game))
 	{
-        // kill merc, update town
-        game->town->mercs[target_merc].hp = 0;
-        game->town->field[dest_coord.x][dest_coord.y] = FIELD_EMPTY;
+		Game_ai_turn(game, pass_ms - spent);
+		result = Game_end_rounds(game, 1, stop, money_below, &step);
+		*passed += step;
+
+		if (result != SS_ROUNDS)
+			return result;
 
-        // update hud
-        Hud_set_field(hud, dest_coord, hud->spr_fields[FIELD_EMPTY].texture);
+		spent = SDL_GetTicks() - start;
 	}
 
-	// else apply damage
-	else
-		game->town->mercs[target_merc].hp -= damage;
+	/* without ai mercs or time for them the rest passes in one go */
+	if (*passed < max_rounds)
+	{
+		result = Game_end_rounds(game, max_rounds - *passed, stop, money_below, &step);
+		*passed += step;
+	}
+
+	return result;
+}
 
-	return damage;
+/* highlights what the merc at coords can reach, hides it if there is none */
+static void Game_show_reach( Game *game, Hud *hud, const SDL_Point coords )
+{
+	const Reach *reach = Sim_merc_reach(&game->sim, coords);
+
+	if (reach == NULL)
+		Hud_set_reach(hud, NULL, 0);
+	else
+		Hud_set_reach(hud, reach->fields, reach->field_count);
 }
 
 int32_t Game_main( Game *game )
@@ -619,7 +782,7 @@ int32_t Game_main( Game *game )
 	}
 
 	// init hud
-	Hud_new(&hud, renderer, game->cfg);
+	Hud_new(&hud, renderer, game->cfg, game->town->width, game->town->height);
 
 	if (hud.invalid)
 		goto game_clear;
@@ -643,9 +806,16 @@ int32_t Game_main( Game *game )
 		printf(MSG_WARN_WIN_ICON);
 	}
 
+	// hud follows every change of the town from here on
+	Sim_subscribe(&game->sim, Hud_on_event, &hud);
+
+	// sight of mercs in the loaded town, then catch up on actions since last full save
+	Sim_rebuild_fog(&game->sim);
+	Game_replay_journal(game);
+
 	// handle hud field textures
-	Hud_generate_flips(&hud);
-	Hud_map_textures(&hud, game->town->hidden, game->town->field);
+	Hud_generate_flips(&hud, game->town->seed);
+	Hud_map_textures(&hud, game->town);
 
 	// set hud values and recalculate ui sizes
 	Hud_update_time(&hud, game->town->round);
@@ -663,7 +833,7 @@ int32_t Game_main( Game *game )
 	int32_t border_t, border_l;
 	int32_t window_x, window_y;
 	int32_t window_w, window_h;
-	SDL_Point hover_coord;
+	SDL_Point hover_coord = {-1, -1};
 	Field hover_field;
 
 	while (game->game_state == GS_ACTIVE)
@@ -689,6 +859,10 @@ int32_t Game_main( Game *game )
 		// update time
 		ts_now = SDL_GetTicks();
 
+		// report failed background saves
+		if (Saver_poll_failure(&game->saver))
+			Hud_update_feedback(&hud, GM_MSG_ERR_TOWN_SAVE);
+
 		// update mouse coords
 		SDL_GetMouseState(&mouse.x, &mouse.y);
 
@@ -710,6 +884,9 @@ int32_t Game_main( Game *game )
 					hud.txt_command.text.str[0] = '\0';
 					hud.txt_command.text.len = 0;
 
+					// command may have changed what the hovered merc reaches
+					Game_show_reach(game, &hud, hover_coord);
+
 					// reset command history cursor
 					hud.cmd_history_cursor = -1;
 					break;
@@ -745,13 +922,13 @@ int32_t Game_main( Game *game )
 				hover_coord.x = (mouse.x - hud.rect_area.x) / hud.field_width;
 				hover_coord.y = (mouse.y - hud.rect_area.y) / hud.field_height;
 
-				if (hover_coord.x >= 0 && hover_coord.y >= 0 &&
-					hover_coord.x < TOWN_WIDTH && hover_coord.y < TOWN_HEIGHT)
+				if (Town_coords_valid(game->town, hover_coord.x, hover_coord.y))
 				{
-					hover_field = game->town->field[hover_coord.x][hover_coord.y];
+					hover_field = Town_get_field(game->town, hover_coord);
 				}
 
 				Hud_update_hover(&hud, hover_coord, DATA_FIELDS[hover_field].name);
+				Game_show_reach(game, &hud, hover_coord);
 				break;
 
 			// window
@@ -780,7 +957,7 @@ int32_t Game_main( Game *game )
 
 			case SDL_QUIT:
 				// save and close
-				Town_save(game->town, game->town_name);
+				Game_save(game);
 				game->game_state = GS_CLOSE;
 				break;
 			}
@@ -792,6 +969,9 @@ int32_t Game_main( Game *game )
 
 	game_clear:
 
+	// the hud is gone after this
+	Sim_unsubscribe(&game->sim, Hud_on_event, &hud);
+
 	// clear hud
 	Hud_clear(&hud);
 
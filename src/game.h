@@ -23,9 +23,16 @@
 #include <stdint.h>
 #include <SDL.h>
 #include "town.h"
+#include "journal.h"
+#include "saver.h"
+#include "sim.h"
+
+static const uint32_t GAME_CHECKPOINT_ROUNDS = 24;	/* full save once a day */
+static const uint32_t GAME_PASS_MAX_ROUNDS = 24 * 365;	/* most rounds one pass goes */
+static const uint32_t GAME_PASS_AI_MS = 2000;			/* most ai thinking in one pass */
+static const MercFraction GAME_AI_FRACTION = MF_PURPLE;	/* played by the computer */
 
 typedef struct Config Config;
-typedef struct Hud Hud;
 
 enum GameState
 {
@@ -39,23 +46,59 @@ typedef struct Game
 	const char *town_name;
 	Town *town;
 	Config *cfg;
+	Journal journal;
+	Saver saver;
+	Sim sim;
+	bool replaying;
+	uint32_t ai_turns;		/* turns the ai played, not saved */
+	uint32_t ai_pass_ms;	/* ai thinking one pass may take, 0 for GAME_PASS_AI_MS */
+	uint32_t ai_threads;	/* cores one ai turn may use, 0 for all */
+	bool defer_checkpoints;	/* a day passing only sets checkpoint_due, the owner saves */
+	bool checkpoint_due;
 
 	enum GameState game_state;
 } Game ;
 
-void Game_end_round( Game *game, Hud *hud );
-
-bool Game_construct( Game *game, Hud *hud, const SDL_Point field, const Field building );
-
-bool Game_spawn_merc( Game *game, Hud *hud, const TownMerc merc );
-
-bool Game_move_merc( Game *game, Hud *hud, const SDL_Point src_coord, const SDL_Point dest_coord );
-
-int_fast32_t Game_merc_attack(
-	Game *game, Hud *hud,
-	const SDL_Point src_coord,
-	const uint_fast8_t weapon_slot,
-	const SDL_Point dest_coord );
+/* SimListener, ctx is the game.
+	Journals actions and checkpoints now and then, replayed records are not logged again. */
+void Game_on_event( void *ctx, const SimEvent *event );
+
+void Game_checkpoint( Game *game );
+
+bool Game_save( Game *game );
+
+/* catches up on the journal, what it replayed is folded into a full save */
+void Game_replay_journal( Game *game );
+
+/* like Game_replay_journal, but the records stay and new ones follow them,
+	the full save waits for the next checkpoint */
+void Game_resume_journal( Game *game );
+
+/* sets GS_FAILURE_COST if the running cost can not be paid */
+void Game_end_round( Game *game );
+
+/* like Sim_end_rounds, sets GS_FAILURE_COST on bankruptcy */
+SimStop Game_end_rounds(
+	Game *game,
+	const uint32_t max_rounds,
+	const SimStop stop,
+	const uint32_t money_below,
+	uint32_t *passed );
+
+/* the ai plays its mercs for the rest of this round, if it has any,
+	thinking no longer than budget_ms or ai_turn_ms, whichever is less */
+void Game_ai_turn( Game *game, const uint32_t budget_ms );
+
+/* like Game_end_rounds, but while the ai has mercs they get a turn before
+	every round, so those rounds pass one by one.
+	Once the ai thought for ai_pass_ms the rest passes in one go without it,
+	a single round always gets a full turn. */
+SimStop Game_pass(
+	Game *game,
+	const uint32_t max_rounds,
+	const SimStop stop,
+	const uint32_t money_below,
+	uint32_t *passed );
 
 int32_t Game_main( Game *game );
 
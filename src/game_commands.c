@@ -25,14 +25,13 @@
 #include "messages.h"
 #include "town.h"
 #include "config.h"
+#include "ai.h"
 #include "game_commands.h"
 #include "game.h"
 
-void gm_cmd_save( Hud *hud, const char *town_name, Town *town )
+void gm_cmd_save( Game *game, Hud *hud )
 {
-	Town_save(town, town_name);
-
-	if (town->invalid)
+	if (Game_save(game) == false)
 		Hud_update_feedback(hud, GM_MSG_ERR_TOWN_SAVE);
 	else
 	{
@@ -142,6 +141,18 @@ void gm_cmd_config_set( Hud *hud, Config *cfg, const char *setting_name, const c
 		cfg->field_border_alpha = strtoul(setting_value, NULL, 10);
 	}
 
+	//memory
+	else if (strcmp(setting_name, CFG_SETTING_CHUNK_CACHE_MB) == 0)
+	{
+		cfg->chunk_cache_mb = strtoul(setting_value, NULL, 10);
+	}
+
+	//opponent
+	else if (strcmp(setting_name, CFG_SETTING_AI_TURN_MS) == 0)
+	{
+		cfg->ai_turn_ms = strtoul(setting_value, NULL, 10);
+	}
+
 	//unknown
 	else
 	{
@@ -195,11 +206,66 @@ void gm_cmd_config_show( const Config *cfg )
 }
 */
 
-void gm_cmd_pass( Game *game, Hud *hud )
+void gm_cmd_pass(
+	Game *game, Hud *hud,
+	const uint32_t rounds,
+	const SimStop stop,
+	const uint32_t money_below )
+{
+	char msg[sizeof(GM_MSG_PASS_MONEY) + 20];
+	uint32_t passed;
+
+	if (rounds == 0 || rounds > GAME_PASS_MAX_ROUNDS)
+	{
+		Hud_update_feedback(hud, GM_MSG_ERR_PASS);
+		return;
+	}
+
+	// waiting for nothing would pass a year
+	if (stop == SS_CONSTRUCTION_DONE && game->town->construction_count == 0)
+	{
+		Hud_update_feedback(hud, GM_MSG_PASS_NO_CONSTRUCTION);
+		return;
+	}
+
+	// the opponent acts before each round ends
+	switch (Game_pass(game, rounds, stop, money_below, &passed))
+	{
+	case SS_CONSTRUCTION_DONE:
+		sprintf(msg, GM_MSG_PASS_CONSTRUCTION, passed);
+		break;
+
+	case SS_MONEY_BELOW:
+		sprintf(msg, GM_MSG_PASS_MONEY, passed, money_below);
+		break;
+
+	default:
+		if (passed == 1)
+			strcpy(msg, GM_MSG_PASS);
+		else
+			sprintf(msg, GM_MSG_PASS_ROUNDS, passed);
+		break;
+	}
+
+	Hud_update_feedback(hud, msg);
+}
+
+void gm_cmd_keep_backups( Game *game, Hud *hud, const char *count )
 {
-	Game_end_round(game, hud);
+	char *end;
+	const unsigned long value = strtoul(count, &end, 10);
+
+	if (*end != '\0' || value > UINT8_MAX)
+	{
+		Hud_update_feedback(hud, GM_MSG_ERR_KEEP_BACKUPS);
+		return;
+	}
+
+	// takes effect with the next save, which also trims the ring
+	game->town->backup_generations = value;
+	Game_checkpoint(game);
 
-	Hud_update_feedback(hud, GM_MSG_PASS);
+	Hud_update_feedback(hud, GM_MSG_KEEP_BACKUPS);
 }
 
 #ifdef _DEBUG
@@ -244,7 +310,7 @@ void gm_cmd_spawn_merc(
 		.fraction = frac_id,
 	};
 
-	if (Game_spawn_merc(game, hud, merc))
+	if (Sim_spawn_merc(&game->sim, merc))
 		Hud_update_feedback(hud, GM_MSG_MERC_SPAWN);
 
 	else
@@ -254,12 +320,30 @@ void gm_cmd_spawn_merc(
 
 void gm_cmd_merc_move( Game *game, Hud *hud, const SDL_Point src_coord, const SDL_Point dest_coord )
 {
-    if (Game_move_merc(game, hud, src_coord, dest_coord) == true)
+    if (Sim_move_merc(&game->sim, src_coord, dest_coord) == true)
     	Hud_update_feedback(hud, GM_MSG_MERC_MOVE);
 	else
 		Hud_update_feedback(hud, GM_MSG_MERC_NO_MOVE);
 }
 
+void gm_cmd_merc_path( Game *game, Hud *hud, const SDL_Point src_coord, const SDL_Point dest_coord )
+{
+	char msg[sizeof(GM_MSG_MERC_PATH) + 20];
+	const uint32_t cost = Sim_find_path(&game->sim, src_coord, dest_coord);
+
+	if (cost == PATH_NONE)
+	{
+		Hud_set_path(hud, NULL, 0);
+		Hud_update_feedback(hud, GM_MSG_MERC_NO_PATH);
+		return;
+	}
+
+	Hud_set_path(hud, game->sim.pathfinder.path, game->sim.pathfinder.path_length);
+
+	sprintf(msg, GM_MSG_MERC_PATH, cost, Sim_merc_steps_left(&game->sim, src_coord));
+	Hud_update_feedback(hud, msg);
+}
+
 void gm_cmd_merc_attack(
 	Game *game, Hud *hud,
 	const SDL_Point src_coord,
@@ -269,7 +353,7 @@ void gm_cmd_merc_attack(
 	char dmg_no[10];
 
 	SM_String msg = SM_String_from("Mercenary dealt ");
-	sprintf(dmg_no, "%li", Game_merc_attack(game, hud, src_coord, weapon_slot, dest_coord));
+	sprintf(dmg_no, "%li", Sim_merc_attack(&game->sim, src_coord, weapon_slot, dest_coord));
 	SM_String_append_cstr(&msg, dmg_no);
 	SM_String_append_cstr(&msg, " damage.");
 
@@ -278,9 +362,35 @@ void gm_cmd_merc_attack(
 	SM_String_clear(&msg);
 }
 
+void gm_cmd_merc_estimate(
+	Game *game, Hud *hud,
+	const SDL_Point src_coord,
+	const SDL_Point dest_coord,
+	const uint32_t rollouts )
+{
+	char msg[sizeof(GM_MSG_MERC_ESTIMATE) + 80];
+	const AiEstimate estimate = Ai_estimate(game->town, src_coord, dest_coord, rollouts);
+
+	if (estimate.invalid)
+	{
+		Hud_update_feedback(hud, GM_MSG_MERC_NO_ESTIMATE);
+		return;
+	}
+
+	sprintf(msg, GM_MSG_MERC_ESTIMATE,
+		estimate.win * 100.0f,
+		estimate.loss * 100.0f,
+		estimate.hp[0],
+		estimate.hp[1],
+		estimate.kill_rounds[0],
+		estimate.rollouts,
+		estimate.seconds);
+	Hud_update_feedback(hud, msg);
+}
+
 void gm_cmd_construct( Game *game, Hud *hud, const SDL_Point coord, const Field field )
 {
-	if (Game_construct(game, hud, coord, field))
+	if (Sim_construct(&game->sim, coord, field))
 		Hud_update_feedback(hud, GM_MSG_CONSTRUCT);
 
 	else
@@ -289,7 +399,7 @@ void gm_cmd_construct( Game *game, Hud *hud, const SDL_Point coord, const Field
 
 void gm_cmd_destruct( Game *game, Hud *hud, const SDL_Point coord )
 {
-	if (Game_construct(game, hud, coord, FIELD_EMPTY))
+	if (Sim_construct(&game->sim, coord, FIELD_EMPTY))
 		Hud_update_feedback(hud, GM_MSG_DESTRUCT);
 
 	else
@@ -21,6 +21,7 @@
 
 #include <stdint.h>
 #include "commands.h"
+#include "sim.h"
 
 typedef struct Config Config;
 typedef struct Town Town;
@@ -35,6 +36,7 @@ typedef enum GameCommand
 	GM_CMD_CONFIG_SET,
 	//GM_CMD_CONFIG_SHOW,
 	GM_CMD_PASS,
+	GM_CMD_KEEP_BACKUPS,
 
 #ifdef _DEBUG
 	GM_CMD_PRINT_DJB2,
@@ -42,7 +44,9 @@ typedef enum GameCommand
 #endif
 
 	GM_CMD_MERC_MOVE,
+	GM_CMD_MERC_PATH,
 	GM_CMD_MERC_ATTACK,
+	GM_CMD_MERC_ESTIMATE,
 	GM_CMD_CONSTRUCT,
 	GM_CMD_DESTRUCT,
 
@@ -59,6 +63,7 @@ typedef enum GameCommandDJB2
 	DJB2_GM_CONFIG_SET = 1267258658,
 	//DJB2_GM_CONFIG_SHOW = ,
 	DJB2_GM_PASS = 2900374925,
+	DJB2_GM_KEEP_BACKUPS = 415391951,
 
 #ifdef _DEBUG
 	DJB2_GM_PRINT_DJB2 = 2572032878,
@@ -67,8 +72,12 @@ typedef enum GameCommandDJB2
 
 	DJB2_GM_MERC_MOVE = 1817727845,
 	DJB2_GM_MERC_MOVE_ABBR = 6224251,
+	DJB2_GM_MERC_PATH = 1817829508,
+	DJB2_GM_MERC_PATH_ABBR = 6224254,
 	DJB2_GM_MERC_ATTACK = 515757909,
 	DJB2_GM_MERC_ATTACK_ABBR = 6224239,
+	DJB2_GM_MERC_ESTIMATE = 1616930825,
+	DJB2_GM_MERC_ESTIMATE_ABBR = 6224243,
 	DJB2_GM_CONSTRUCT = 2537986078,
 	DJB2_GM_CONSTRUCT_ABBR = 183053,
 	DJB2_GM_DESTRUCT = 1123813470,
@@ -82,7 +91,8 @@ static const CommandData DATA_GM_CMDS[] = {
     {"exit", false, "", "close connection to town", false, ""},
     {"config-set", false, "", "set config value", true, "VARIABLE_NAME VALUE"},
     //{"config-show", false, "", "show all current config values", false, ""},
-    {"pass", false, "", "pass time", false, ""},
+    {"pass", false, "", "pass time, by rounds or until something happens", true, "[ROUNDS | until construction | until money AMOUNT]"},
+    {"keep-backups", false, "", "set how many backups of this town are kept", true, "COUNT"},
 
 #ifdef _DEBUG
 	{"print_djb2", false, "", "", false, ""},
@@ -90,12 +100,14 @@ static const CommandData DATA_GM_CMDS[] = {
 #endif
 
     {"merc-move", true, "mm", "move a mercenary", true, "SRC_X SRC_Y DEST_X DEST_Y"},
+    {"merc-path", true, "mp", "show path a mercenary would walk", true, "SRC_X SRC_Y DEST_X DEST_Y"},
     {"merc-attack", true, "ma", "attack a coordinate", true, "SRC_X SRC_Y SLOT DEST_Y DEST_Y"},
+    {"merc-estimate", true, "me", "estimate a fight against another mercenary", true, "SRC_X SRC_Y DEST_X DEST_Y [ROLLOUTS]"},
     {"construct", true, "c", "start construction", true, "X Y CONSTRUCTION"},
     {"destruct", true, "d", "start destruction", true, "X Y"},
 };
 
-void gm_cmd_save( Hud *hud, const char *town_name, Town *town );
+void gm_cmd_save( Game *game, Hud *hud );
 
 void gm_cmd_save_as( Hud *hud, const char *town_name, Town *town );
 
@@ -103,7 +115,13 @@ void gm_cmd_config_set(Hud *hud, Config *cfg, const char *setting_name, const ch
 
 //void gm_cmd_config_show( const Config *p_cfg );
 
-void gm_cmd_pass( Game *game, Hud *hud );
+void gm_cmd_pass(
+	Game *game, Hud *hud,
+	const uint32_t rounds,
+	const SimStop stop,
+	const uint32_t money_below );
+
+void gm_cmd_keep_backups( Game *game, Hud *hud, const char *count );
 
 #ifdef _DEBUG
 void gm_cmd_print_djb2( void );
@@ -119,12 +137,20 @@ void gm_cmd_hurt_merc( Game *game, Hud *hud, const SDL_Point coord, const uint_f
 
 void gm_cmd_merc_move( Game *game, Hud *hud, const SDL_Point src_coord, const SDL_Point dest_coord );
 
+void gm_cmd_merc_path( Game *game, Hud *hud, const SDL_Point src_coord, const SDL_Point dest_coord );
+
 void gm_cmd_merc_attack(
 	Game *game, Hud *hud,
 	const SDL_Point src_coord,
 	const uint_fast8_t weapon_slot,
 	const SDL_Point dest_coord );
 
+void gm_cmd_merc_estimate(
+	Game *game, Hud *hud,
+	const SDL_Point src_coord,
+	const SDL_Point dest_coord,
+	const uint32_t rollouts );
+
 void gm_cmd_construct( Game *game, Hud *hud, const SDL_Point coord, const Field field );
 
 void gm_cmd_destruct( Game *game, Hud *hud, const SDL_Point coord );
@@ -16,6 +16,7 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <stdlib.h>
 #include <string.h>
 #include <SGUI_theme.h>
 #include "messages.h"
@@ -32,6 +33,24 @@ static const float HUD_AREA_H =		0.8f;
 
 static const float HUD_FIELD_CONTENT_SIZE =	0.95f;
 
+// fog over fields out of sight
+static const uint8_t HUD_FOG_COLOR_R = 0;
+static const uint8_t HUD_FOG_COLOR_G = 0;
+static const uint8_t HUD_FOG_COLOR_B = 0;
+static const uint8_t HUD_FOG_COLOR_A = 120;
+
+// reach overlay
+static const uint8_t HUD_REACH_COLOR_R = 80;
+static const uint8_t HUD_REACH_COLOR_G = 160;
+static const uint8_t HUD_REACH_COLOR_B = 240;
+static const uint8_t HUD_REACH_COLOR_A = 70;
+
+// path preview
+static const uint8_t HUD_PATH_COLOR_R = 240;
+static const uint8_t HUD_PATH_COLOR_G = 220;
+static const uint8_t HUD_PATH_COLOR_B = 60;
+static const uint8_t HUD_PATH_COLOR_A = 110;
+
 // bars
 static const uint8_t HUD_BAR_COLOR_R = 20;
 static const uint8_t HUD_BAR_COLOR_G = 20;
@@ -115,13 +134,46 @@ SGUI_Sprite Hud_load_sprite( Hud *hud, const char *filepath )
 	return result;
 }
 
-void Hud_new( Hud *hud, const SDL_Renderer *renderer, const Config *cfg )
+void Hud_new(
+	Hud *hud,
+	const SDL_Renderer *renderer,
+	const Config *cfg,
+	const uint32_t town_width,
+	const uint32_t town_height )
 {
+	const size_t cells = (size_t) town_width * town_height;
+
 	// init values
 	hud->invalid = false;
 	hud->renderer = (SDL_Renderer*) renderer;
 	hud->cmd_history_cursor = -1;
 
+	// per field data, sized by town
+	hud->town_width = town_width;
+	hud->town_height = town_height;
+	hud->rects_field = calloc(cells, sizeof(SDL_Rect));
+	hud->rects_field_content = calloc(cells, sizeof(SDL_Rect));
+	hud->textures_field_ground = calloc(cells, sizeof(SDL_Texture*));
+	hud->textures_field_content = calloc(cells, sizeof(SDL_Texture*));
+	hud->flips_field = calloc(cells, sizeof(SDL_RendererFlip));
+	hud->path_length = 0;
+	hud->path_cells = calloc(cells, sizeof(uint32_t));
+	hud->reach_length = 0;
+	hud->reach_cells = calloc(cells, sizeof(uint32_t));
+	hud->visible_field = calloc(cells, sizeof(bool));
+
+	if (hud->rects_field == NULL ||
+		hud->rects_field_content == NULL ||
+		hud->textures_field_ground == NULL ||
+		hud->textures_field_content == NULL ||
+		hud->flips_field == NULL ||
+		hud->path_cells == NULL ||
+		hud->reach_cells == NULL ||
+		hud->visible_field == NULL)
+	{
+		hud->invalid = true;
+	}
+
 	for (uint_fast32_t i = 0; i < HUD_CMD_HISTORY_LEN; i++)
 	{
         hud->cmd_history[i] = SM_String_new(8);
@@ -196,7 +248,8 @@ void Hud_new( Hud *hud, const SDL_Renderer *renderer, const Config *cfg )
 void Hud_update_hover( Hud *hud, const SDL_Point coord, const char *name )
 {
     // if hover values are out of town, make invisible and stop
-    if (coord.x >= TOWN_WIDTH || coord.y >= TOWN_HEIGHT)
+    if (coord.x < 0 || coord.y < 0 ||
+    	(uint32_t) coord.x >= hud->town_width || (uint32_t) coord.y >= hud->town_height)
 	{
         hud->lbl_hover_x.visible = false;
         hud->lbl_hover_y.visible = false;
@@ -341,150 +394,188 @@ void Hud_calc( Hud *hud, const int32_t window_w, const int32_t window_h )
     hud->rect_bar_cmd.y = window_h - hud->rect_bar_cmd.h;
 
 	/* calculate area pos and size
-		-as wide as high
+		-fields square, at least a pixel
+		-longer side of town fits the area
 		-stay on top and right
 	*/
-	hud->rect_area.h = window_h * HUD_AREA_H;
-	hud->rect_area.h -= (hud->rect_area.h % TOWN_HEIGHT);  /* remove modulo, to fix mouse hitbox */
-	hud->rect_area.w = hud->rect_area.h;
+	hud->field_height = (window_h * HUD_AREA_H) /
+		(hud->town_width > hud->town_height ? hud->town_width : hud->town_height);
+
+	if (hud->field_height == 0)
+		hud->field_height = 1;
+
+	hud->field_width = hud->field_height;
+
+	/* multiple of field size, to fix mouse hitbox */
+	hud->rect_area.w = hud->field_width * hud->town_width;
+	hud->rect_area.h = hud->field_height * hud->town_height;
 	hud->rect_area.y = window_h * HUD_AREA_Y;
 	hud->rect_area.x = (window_w * HUD_AREA_X2) - hud->rect_area.w;
 
-	// calc field size
-	hud->field_width = hud->rect_area.w / TOWN_WIDTH;
-	hud->field_height = hud->rect_area.h / TOWN_HEIGHT;
-
 	// calc field rects
-	for (uint32_t x = 0; x < TOWN_WIDTH; x++)
+	for (uint32_t y = 0; y < hud->town_height; y++)
 	{
-		for (uint32_t y = 0; y < TOWN_HEIGHT; y++)
+		for (uint32_t x = 0; x < hud->town_width; x++)
 		{
+			SDL_Rect *rect = &hud->rects_field[y * hud->town_width + x];
+			SDL_Rect *content = &hud->rects_field_content[y * hud->town_width + x];
+
 			// full rect
-			hud->rects_field[x][y].x = hud->rect_area.x + (x * hud->field_width);
-			hud->rects_field[x][y].y = hud->rect_area.y + (y * hud->field_height);
-			hud->rects_field[x][y].w = hud->field_width;
-			hud->rects_field[x][y].h = hud->field_height;
+			rect->x = hud->rect_area.x + (x * hud->field_width);
+			rect->y = hud->rect_area.y + (y * hud->field_height);
+			rect->w = hud->field_width;
+			rect->h = hud->field_height;
 
 			// content texture rect
-			hud->rects_field_content[x][y].w = hud->rects_field[x][y].w * HUD_FIELD_CONTENT_SIZE;
-			hud->rects_field_content[x][y].h = hud->rects_field[x][y].h * HUD_FIELD_CONTENT_SIZE;
-			hud->rects_field_content[x][y].x =
-				hud->rects_field[x][y].x +
-				((hud->rects_field[x][y].w - hud->rects_field_content[x][y].w) / 2);
-			hud->rects_field_content[x][y].y =
-				hud->rects_field[x][y].y +
-				((hud->rects_field[x][y].h - hud->rects_field_content[x][y].h) / 2);
+			content->w = rect->w * HUD_FIELD_CONTENT_SIZE;
+			content->h = rect->h * HUD_FIELD_CONTENT_SIZE;
+			content->x = rect->x + ((rect->w - content->w) / 2);
+			content->y = rect->y + ((rect->h - content->h) / 2);
 		}
 	}
 }
 
-void Hud_generate_flips( Hud *hud )
+void Hud_generate_flips( Hud *hud, const uint64_t seed )
 {
+	/* own stream from the town seed, flips stay the same every session
+		and do not advance the town's generator */
+	Rng rng = Rng_new(seed);
 	uint_fast32_t flip;
 
 	/* generate texture flip */
-	for (uint_fast32_t x = 0; x < TOWN_WIDTH; x++)
+	for (uint_fast32_t i = 0; i < hud->town_width * hud->town_height; i++)
 	{
-		for (uint_fast32_t y = 0; y < TOWN_HEIGHT; y++)
+		/* random */
+		flip = Rng_range(&rng, 3);
+
+		switch (flip)
 		{
-			/* random */
-			flip = rand() % 3;
-
-			switch (flip)
-			{
-			case 0:
-				hud->flips_field[x][y] = SDL_FLIP_NONE;
-				break;
-
-			case 1:
-				hud->flips_field[x][y] = SDL_FLIP_VERTICAL;
-				break;
-
-			case 2:
-				hud->flips_field[x][y] = SDL_FLIP_HORIZONTAL;
-				break;
-
-			case 3:
-				hud->flips_field[x][y] = SDL_FLIP_VERTICAL | SDL_FLIP_HORIZONTAL;
-				break;
-			}
+		case 0:
+			hud->flips_field[i] = SDL_FLIP_NONE;
+			break;
+
+		case 1:
+			hud->flips_field[i] = SDL_FLIP_VERTICAL;
+			break;
+
+		case 2:
+			hud->flips_field[i] = SDL_FLIP_HORIZONTAL;
+			break;
+
+		case 3:
+			hud->flips_field[i] = SDL_FLIP_VERTICAL | SDL_FLIP_HORIZONTAL;
+			break;
 		}
 	}
 }
 
-void Hud_map_textures(
-	Hud *hud,
-	const bool fields_hidden[TOWN_WIDTH][TOWN_HEIGHT],
-	const Field fields_content[TOWN_WIDTH][TOWN_HEIGHT] )
+static void Hud_map_cell( Hud *hud, const uint32_t i, const Field field, const bool hidden )
+{
+	// if field hidden
+	if (hidden)
+	{
+		// assign hidden ground texture
+		hud->textures_field_ground[i] = hud->spr_hidden.texture;
+
+		// and null content texture
+		hud->textures_field_content[i] = NULL;
+	}
+	else
+	{
+		// assign exposed ground texture
+		hud->textures_field_ground[i] = hud->spr_ground.texture;
+
+		// map textures to area content
+		hud->textures_field_content[i] = hud->spr_fields[field].texture;
+	}
+}
+
+void Hud_map_field( Hud *hud, Town *town, const SDL_Point coords )
+{
+	Hud_map_cell(
+		hud,
+		coords.y * town->width + coords.x,
+		Town_get_field(town, coords),
+		Town_get_hidden(town, coords));
+}
+
+void Hud_map_textures( Hud *hud, Town *town )
 {
-	for (uint32_t x = 0; x < TOWN_WIDTH; x++)
+	SDL_Point coords;
+
+	// row by row, so each chunk gets paged in once per row
+	for (coords.y = 0; (uint32_t) coords.y < town->height; coords.y++)
 	{
-		for (uint32_t y = 0; y < TOWN_HEIGHT; y++)
+		for (coords.x = 0; (uint32_t) coords.x < town->width; coords.x++)
 		{
-			// if field hidden
-			if (fields_hidden[x][y] == true)
-			{
-				// assign hidden ground texture
-				hud->textures_field_ground[x][y] = hud->spr_hidden.texture;
-
-				// and null content texture
-				hud->textures_field_content[x][y] = NULL;
-			}
-			else
-			{
-				// assign exposed ground texture
-				hud->textures_field_ground[x][y] = hud->spr_ground.texture;
-
-				// map textures to area content
-				hud->textures_field_content[x][y] = hud->spr_fields[fields_content[x][y]].texture;
-			}
+			Hud_map_field(hud, town, coords);
 		}
 	}
 }
 
+void Hud_set_visible( Hud *hud, const SDL_Point field, const bool visible )
+{
+	hud->visible_field[field.y * hud->town_width + field.x] = visible;
+}
+
 void Hud_draw( Hud *hud, const Town *town )
 {
+	SDL_Rect *merc_rect;
+
 	// draw fields
-	for (uint32_t x = 0; x < TOWN_WIDTH; x++)
+	for (uint32_t i = 0; i < hud->town_width * hud->town_height; i++)
 	{
-		for (uint32_t y = 0; y < TOWN_HEIGHT; y++)
-		{
-			// draw stored ground texture
-			SDL_RenderCopyEx(hud->renderer, hud->textures_field_ground[x][y], NULL, &hud->rects_field[x][y],
-				0.0f,
-				NULL,
-				hud->flips_field[x][y]);
+		// draw stored ground texture
+		SDL_RenderCopyEx(hud->renderer, hud->textures_field_ground[i], NULL, &hud->rects_field[i],
+			0.0f,
+			NULL,
+			hud->flips_field[i]);
 
-			// draw stored content texture
-			SDL_RenderCopy(
-				hud->renderer,
-				hud->textures_field_content[x][y],
-				NULL,
-				&hud->rects_field_content[x][y]);
+		// draw stored content texture
+		SDL_RenderCopy(
+			hud->renderer,
+			hud->textures_field_content[i],
+			NULL,
+			&hud->rects_field_content[i]);
 
-			// draw field border
+		// darken what is out of sight
+		if (hud->visible_field[i] == false)
+		{
 			SDL_SetRenderDrawColor(
 				hud->renderer,
-				hud->field_border_color.r,
-				hud->field_border_color.g,
-				hud->field_border_color.b,
-				hud->field_border_color.a);
-			SDL_RenderDrawRect(hud->renderer, &hud->rects_field[x][y]);
+				HUD_FOG_COLOR_R,
+				HUD_FOG_COLOR_G,
+				HUD_FOG_COLOR_B,
+				HUD_FOG_COLOR_A);
+			SDL_RenderFillRect(hud->renderer, &hud->rects_field[i]);
 		}
+
+		// draw field border
+		SDL_SetRenderDrawColor(
+			hud->renderer,
+			hud->field_border_color.r,
+			hud->field_border_color.g,
+			hud->field_border_color.b,
+			hud->field_border_color.a);
+		SDL_RenderDrawRect(hud->renderer, &hud->rects_field[i]);
 	}
 
 	for (uint32_t i = 0; i < town->merc_count; i++)
 	{
-		// if merc is dead, skip drawing
-		if (town->mercs[i].hp == 0)
+		// if merc is dead or out of sight, skip drawing
+		if (town->mercs[i].hp == 0 ||
+			hud->visible_field[town->mercs[i].coords.y * hud->town_width + town->mercs[i].coords.x] == false)
 			continue;
 
+		merc_rect = &hud->rects_field_content[
+			town->mercs[i].coords.y * hud->town_width + town->mercs[i].coords.x];
+
 		// draw mercenary fields
 		SDL_RenderCopy(
 			hud->renderer,
         	hud->spr_merc_base.texture,
         	NULL,
-        	&hud->rects_field_content[town->mercs[i].coords.x][town->mercs[i].coords.y]);
+        	merc_rect);
 
 		// draw fraction color tint
         if (town->mercs[i].fraction == MF_GREEN)
@@ -493,7 +584,7 @@ void Hud_draw( Hud *hud, const Town *town )
 				hud->renderer,
 	        	hud->spr_merc_tint_green.texture,
         		NULL,
-        		&hud->rects_field_content[town->mercs[i].coords.x][town->mercs[i].coords.y]);
+        		merc_rect);
         }
         else
         {
@@ -501,7 +592,7 @@ void Hud_draw( Hud *hud, const Town *town )
 				hud->renderer,
         		hud->spr_merc_tint_purple.texture,
 	        	NULL,
-    	    	&hud->rects_field_content[town->mercs[i].coords.x][town->mercs[i].coords.y]);
+    	    	merc_rect);
         }
 
 		// draw mercenary class icon
@@ -509,9 +600,30 @@ void Hud_draw( Hud *hud, const Town *town )
 			hud->renderer,
 			hud->spr_mercs[town->mercs[i].id].texture,
 			NULL,
-			&hud->rects_field_content[town->mercs[i].coords.x][town->mercs[i].coords.y]);
+			merc_rect);
 	}
 
+	// draw reach overlay, path preview above it
+	SDL_SetRenderDrawColor(
+		hud->renderer,
+		HUD_REACH_COLOR_R,
+		HUD_REACH_COLOR_G,
+		HUD_REACH_COLOR_B,
+		HUD_REACH_COLOR_A);
+
+	for (uint32_t i = 0; i < hud->reach_length; i++)
+		SDL_RenderFillRect(hud->renderer, &hud->rects_field_content[hud->reach_cells[i]]);
+
+	SDL_SetRenderDrawColor(
+		hud->renderer,
+		HUD_PATH_COLOR_R,
+		HUD_PATH_COLOR_G,
+		HUD_PATH_COLOR_B,
+		HUD_PATH_COLOR_A);
+
+	for (uint32_t i = 0; i < hud->path_length; i++)
+		SDL_RenderFillRect(hud->renderer, &hud->rects_field_content[hud->path_cells[i]]);
+
 	// draw hud bars
 	SDL_SetRenderDrawColor(
 		hud->renderer,
@@ -528,7 +640,65 @@ void Hud_draw( Hud *hud, const Town *town )
 
 void Hud_set_field( Hud *hud, const SDL_Point field, const SDL_Texture *texture )
 {
-	hud->textures_field_content[field.x][field.y] = (SDL_Texture*) texture;
+	hud->textures_field_content[field.y * hud->town_width + field.x] = (SDL_Texture*) texture;
+}
+
+/* keeps fields inside the town, returns how many */
+static uint32_t Hud_to_cells( const Hud *hud, const SDL_Point *fields, const uint32_t count, uint32_t *cells )
+{
+	uint32_t result = 0;
+
+	for (uint32_t i = 0; i < count && result < hud->town_width * hud->town_height; i++)
+	{
+		if (fields[i].x < 0 || (uint32_t) fields[i].x >= hud->town_width ||
+			fields[i].y < 0 || (uint32_t) fields[i].y >= hud->town_height)
+			continue;
+
+		cells[result] = fields[i].y * hud->town_width + fields[i].x;
+		result++;
+	}
+
+	return result;
+}
+
+void Hud_set_path( Hud *hud, const SDL_Point *steps, const uint32_t count )
+{
+	hud->path_length = Hud_to_cells(hud, steps, count, hud->path_cells);
+}
+
+void Hud_set_reach( Hud *hud, const SDL_Point *fields, const uint32_t count )
+{
+	hud->reach_length = Hud_to_cells(hud, fields, count, hud->reach_cells);
+}
+
+void Hud_on_event( void *ctx, const SimEvent *event )
+{
+	Hud *hud = ctx;
+
+	switch (event->type)
+	{
+	case SE_FIELD:
+		Hud_map_cell(hud, event->coords.y * hud->town_width + event->coords.x,
+			event->field, event->hidden);
+		Hud_set_visible(hud, event->coords, event->visible);
+		break;
+
+	case SE_MONEY:
+		Hud_update_money(hud, event->value);
+		break;
+
+	case SE_ROUND_ENDED:
+		Hud_update_time(hud, event->value);
+		break;
+
+	case SE_MERC_MOVED:
+		// previewed path is used up or stale
+		Hud_set_path(hud, NULL, 0);
+		break;
+
+	default:
+		break;
+	}
 }
 
 void Hud_add_to_command_history( Hud *hud, const char *cmd )
@@ -547,6 +717,15 @@ void Hud_clear( Hud *hud )
 {
 	SGUI_Menu_clear(&hud->mnu_hud);
 
+	free(hud->rects_field);
+	free(hud->rects_field_content);
+	free(hud->textures_field_ground);
+	free(hud->textures_field_content);
+	free(hud->flips_field);
+	free(hud->path_cells);
+	free(hud->reach_cells);
+	free(hud->visible_field);
+
 	SGUI_Sprite_clear(&hud->spr_ground);
 	SGUI_Sprite_clear(&hud->spr_hidden);
 
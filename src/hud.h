@@ -27,6 +27,7 @@
 #include <SGUI_entry.h>
 #include <SGUI_label.h>
 #include "town.h"
+#include "sim.h"
 
 typedef struct Game Game;
 typedef struct Config Config;
@@ -94,11 +95,26 @@ typedef struct Hud
 	uint32_t field_width;
 	uint32_t field_height;
 	SDL_Rect rect_area;
-	SDL_Rect rects_field[TOWN_WIDTH][TOWN_HEIGHT];
-	SDL_Rect rects_field_content[TOWN_WIDTH][TOWN_HEIGHT];
-	SDL_Texture *textures_field_ground[TOWN_WIDTH][TOWN_HEIGHT];
-	SDL_Texture *textures_field_content[TOWN_WIDTH][TOWN_HEIGHT];
-	SDL_RendererFlip flips_field[TOWN_WIDTH][TOWN_HEIGHT];
+
+	/* row-major like the town grids, index is y * town_width + x */
+	uint32_t town_width;
+	uint32_t town_height;
+	SDL_Rect *rects_field;
+	SDL_Rect *rects_field_content;
+	SDL_Texture **textures_field_ground;
+	SDL_Texture **textures_field_content;
+	SDL_RendererFlip *flips_field;
+
+	/* fields of the previewed merc path, as indices like above */
+	uint32_t path_length;
+	uint32_t *path_cells;
+
+	/* fields the player's mercs see, the rest shows last known state */
+	bool *visible_field;
+
+	/* fields the hovered merc can reach */
+	uint32_t reach_length;
+	uint32_t *reach_cells;
 
 	/* shared sprites */
 	SGUI_Sprite spr_ground;
@@ -112,7 +128,12 @@ typedef struct Hud
 	SGUI_Sprite spr_fields[FIELD_SPRITE_COUNT + FIELD_SPRITE_OFFSET];
 } Hud ;
 
-void Hud_new( Hud *hud, const SDL_Renderer *renderer, const Config *cfg );
+void Hud_new(
+	Hud *hud,
+	const SDL_Renderer *renderer,
+	const Config *cfg,
+	const uint32_t town_width,
+	const uint32_t town_height );
 
 void Hud_update_hover( Hud *hud, const SDL_Point coord, const char *name );
 
@@ -124,17 +145,27 @@ void Hud_update_feedback( Hud *hud, const char *str );
 
 void Hud_calc( Hud *hud, const int32_t window_w, const int32_t window_h );
 
-void Hud_generate_flips( Hud *hud );
+void Hud_generate_flips( Hud *hud, const uint64_t seed );
 
-void Hud_map_textures(
-	Hud *hud,
-	const bool fields_hidden[TOWN_WIDTH][TOWN_HEIGHT],
-	const Field fields_content[TOWN_WIDTH][TOWN_HEIGHT] );
+void Hud_map_field( Hud *hud, Town *town, const SDL_Point coords );
+
+void Hud_map_textures( Hud *hud, Town *town );
+
+void Hud_set_visible( Hud *hud, const SDL_Point field, const bool visible );
 
 void Hud_draw( Hud *hud, const Town *town );
 
 void Hud_set_field( Hud *hud, const SDL_Point field, const SDL_Texture *texture );
 
+/* count 0 hides the preview */
+void Hud_set_path( Hud *hud, const SDL_Point *steps, const uint32_t count );
+
+/* count 0 hides the overlay */
+void Hud_set_reach( Hud *hud, const SDL_Point *fields, const uint32_t count );
+
+/* SimListener, ctx is the hud */
+void Hud_on_event( void *ctx, const SimEvent *event );
+
 void Hud_add_to_command_history( Hud *hud, const char *cmd );
 
 void Hud_clear( Hud *hud );
@@ -0,0 +1,263 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <SM_string.h>
+#include "path.h"
+#include "buffer.h"
+#include "checksum.h"
+#include "journal.h"
+
+static const uint32_t JOURNAL_NO_GENERATION = UINT32_MAX;
+
+static void put_u16( uint8_t *dest, const uint16_t val )
+{
+	dest[0] = val & 0xFF;
+	dest[1] = (val >> 8) & 0xFF;
+}
+
+static void put_u32( uint8_t *dest, const uint32_t val )
+{
+	dest[0] = val & 0xFF;
+	dest[1] = (val >> 8) & 0xFF;
+	dest[2] = (val >> 16) & 0xFF;
+	dest[3] = (val >> 24) & 0xFF;
+}
+
+static void Journal_sync( Journal *journal )
+{
+	if (fflush(journal->file) != 0)
+	{
+		journal->invalid = true;
+		return;
+	}
+
+#ifdef _WIN32
+	_commit(_fileno(journal->file));
+#else
+	fsync(fileno(journal->file));
+#endif
+}
+
+Journal Journal_open( const char *town_name )
+{
+	Journal result = {
+		.invalid = false,
+		.file = NULL,
+		.base_generation = JOURNAL_NO_GENERATION,
+		.read_end = JOURNAL_HEADER_SIZE,
+		.batched = false,
+	};
+	uint8_t header[JOURNAL_HEADER_SIZE];
+
+	result.filepath = SM_String_new(16);
+
+	if (get_town_file_path(&result.filepath, town_name, FILETYPE_JOURNAL) != 0)
+	{
+		result.invalid = true;
+		return result;
+	}
+
+	/* open existing journal for replay */
+	result.file = fopen(result.filepath.str, "r+b");
+
+	if (result.file == NULL)
+	{
+		/* none there, start empty one */
+		Journal_reset(&result, JOURNAL_NO_GENERATION);
+		return result;
+	}
+
+	/* read header, a broken one matches no generation */
+	if (fread(header, 1, sizeof(header), result.file) == sizeof(header) &&
+		memcmp(header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) == 0 &&
+		Buffer_get_u16(&header[4]) == JOURNAL_VERSION)
+	{
+		result.base_generation = Buffer_get_u32(&header[6]);
+	}
+
+	return result;
+}
+
+bool Journal_next( Journal *journal, JournalEntry *entry )
+{
+	uint8_t record[JOURNAL_RECORD_SIZE];
+
+	if (journal->invalid || journal->base_generation == JOURNAL_NO_GENERATION)
+		return false;
+
+	/* a short or broken record is a torn write, the journal ends there */
+	if (fread(record, 1, sizeof(record), journal->file) != sizeof(record))
+		return false;
+
+	if (crc32c(record, JOURNAL_RECORD_SIZE - 4) != Buffer_get_u32(&record[JOURNAL_RECORD_SIZE - 4]))
+		return false;
+
+	entry->type = record[0];
+	entry->generation = Buffer_get_u32(&record[1]);
+	entry->rounds = Buffer_get_u32(&record[1]);
+	entry->coord.x = Buffer_get_u16(&record[1]);
+	entry->coord.y = Buffer_get_u16(&record[3]);
+	entry->dest_coord.x = Buffer_get_u16(&record[5]);
+	entry->dest_coord.y = Buffer_get_u16(&record[7]);
+	entry->arg = record[9];
+	entry->arg2 = record[10];
+	journal->read_end += JOURNAL_RECORD_SIZE;
+
+	return true;
+}
+
+void Journal_append( Journal *journal, const JournalEntry *entry )
+{
+	uint8_t record[JOURNAL_RECORD_SIZE];
+
+	if (journal->invalid)
+		return;
+
+	record[0] = entry->type;
+
+	if (entry->type == JR_CHECKPOINT)
+	{
+		put_u32(&record[1], entry->generation);
+	}
+	else if (entry->type == JR_ROUNDS_END)
+	{
+		put_u32(&record[1], entry->rounds);
+	}
+	else
+	{
+		put_u16(&record[1], entry->coord.x);
+		put_u16(&record[3], entry->coord.y);
+	}
+
+	put_u16(&record[5], entry->dest_coord.x);
+	put_u16(&record[7], entry->dest_coord.y);
+	record[9] = entry->arg;
+	record[10] = entry->arg2;
+	put_u32(&record[JOURNAL_RECORD_SIZE - 4], crc32c(record, JOURNAL_RECORD_SIZE - 4));
+
+	if (fwrite(record, 1, sizeof(record), journal->file) != sizeof(record))
+	{
+		journal->invalid = true;
+		return;
+	}
+
+	/* many journals committed together share the wait for the disk */
+	if (journal->batched)
+	{
+		if (fflush(journal->file) != 0)
+			journal->invalid = true;
+
+		return;
+	}
+
+	Journal_sync(journal);
+}
+
+void Journal_continue( Journal *journal )
+{
+	if (journal->invalid)
+		return;
+
+	/* switching from reading to writing takes a seek anyway */
+	if (fseek(journal->file, journal->read_end, SEEK_SET) != 0)
+	{
+		journal->invalid = true;
+		return;
+	}
+
+#ifdef _WIN32
+	if (_chsize(_fileno(journal->file), journal->read_end) != 0)
+#else
+	if (ftruncate(fileno(journal->file), journal->read_end) != 0)
+#endif
+		journal->invalid = true;
+}
+
+void Journal_commit( Journal *journal )
+{
+	if (journal->invalid || journal->file == NULL)
+		return;
+
+	Journal_sync(journal);
+}
+
+void Journal_reset( Journal *journal, const uint32_t base_generation )
+{
+	uint8_t header[JOURNAL_HEADER_SIZE];
+
+	if (journal->file != NULL)
+		fclose(journal->file);
+
+	/* truncate */
+	journal->file = fopen(journal->filepath.str, "w+b");
+
+	if (journal->file == NULL)
+	{
+		journal->invalid = true;
+		return;
+	}
+
+	journal->invalid = false;
+	journal->base_generation = base_generation;
+	journal->read_end = JOURNAL_HEADER_SIZE;
+
+	memcpy(header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+	put_u16(&header[4], JOURNAL_VERSION);
+	put_u32(&header[6], base_generation);
+
+	if (fwrite(header, 1, sizeof(header), journal->file) != sizeof(header))
+	{
+		journal->invalid = true;
+		return;
+	}
+
+	/* the save it follows is on disk already, an old journal only repeats it */
+	if (journal->batched)
+	{
+		if (fflush(journal->file) != 0)
+			journal->invalid = true;
+
+		return;
+	}
+
+	Journal_sync(journal);
+}
+
+void Journal_close( Journal *journal )
+{
+	if (journal->file != NULL)
+		fclose(journal->file);
+
+	journal->file = NULL;
+	SM_String_clear(&journal->filepath);
+}
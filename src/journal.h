@@ -0,0 +1,82 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <SDL.h>
+#include <SM_string.h>
+
+static const char JOURNAL_MAGIC[4] = {'R', 'C', 'J', 'N'};
+static const uint16_t JOURNAL_VERSION = 1;
+#define JOURNAL_HEADER_SIZE	10
+#define JOURNAL_RECORD_SIZE	15
+
+/* record types, never reuse or reorder */
+typedef enum JournalRecord
+{
+	JR_ROUND_END = 1,
+	JR_CONSTRUCT,
+	JR_SPAWN_MERC,
+	JR_MOVE_MERC,
+	JR_MERC_ATTACK,
+	JR_CHECKPOINT,		/* snapshot of given generation handed to the saver */
+	JR_ROUNDS_END,		/* several rounds passed in one go */
+} JournalRecord ;
+
+typedef struct JournalEntry
+{
+	JournalRecord type;
+	SDL_Point coord;
+	SDL_Point dest_coord;
+	uint8_t arg;		/* field, merc id or weapon slot */
+	uint8_t arg2;		/* fraction */
+	uint32_t generation;	/* only for JR_CHECKPOINT, stored in place of coord */
+	uint32_t rounds;		/* only for JR_ROUNDS_END, stored in place of coord */
+} JournalEntry ;
+
+typedef struct Journal
+{
+	bool invalid;
+	SM_String filepath;
+	FILE *file;
+	uint32_t base_generation;	/* generation of the save the records apply to */
+	long read_end;		/* after the last good record read */
+	bool batched;		/* appends and resets are only flushed, the owner commits them */
+} Journal ;
+
+Journal Journal_open( const char *town_name );
+
+bool Journal_next( Journal *journal, JournalEntry *entry );
+
+void Journal_append( Journal *journal, const JournalEntry *entry );
+
+/* appends go after the records read so far, a torn tail is cut off */
+void Journal_continue( Journal *journal );
+
+/* gets batched appends on disk */
+void Journal_commit( Journal *journal );
+
+void Journal_reset( Journal *journal, const uint32_t base_generation );
+
+void Journal_close( Journal *journal );
+
+#endif /* JOURNAL_H */
@@ -0,0 +1,118 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+#include <SM_string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/locking.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "path.h"
+#include "lease.h"
+
+/* returns false if the lock is held elsewhere */
+static bool Lease_try( const int fd )
+{
+#ifdef _WIN32
+	return (_locking(fd, _LK_NBLCK, 1) == 0);
+#else
+	struct flock lock = {
+		.l_type = F_WRLCK,
+		.l_whence = SEEK_SET,
+		.l_start = 0,
+		.l_len = 0,
+	};
+
+	return (fcntl(fd, F_SETLK, &lock) == 0);
+#endif
+}
+
+Lease Lease_take( const char *town_name, const uint32_t wait_ms )
+{
+	Lease result = {
+		.invalid = true,
+		.busy = false,
+		.fd = -1,
+	};
+	SM_String filepath = SM_String_new(16);
+	const uint32_t ts_begin = SDL_GetTicks();
+
+	if (get_town_file_path(&filepath, town_name, FILETYPE_LOCK) != 0)
+	{
+		SM_String_clear(&filepath);
+		return result;
+	}
+
+#ifdef _WIN32
+	result.fd = _open(filepath.str, _O_RDWR | _O_CREAT, _S_IREAD | _S_IWRITE);
+#else
+	result.fd = open(filepath.str, O_RDWR | O_CREAT, 0644);
+#endif
+
+	SM_String_clear(&filepath);
+
+	if (result.fd < 0)
+		return result;
+
+	/* the holder of a short lease is done soon, poll until it is */
+	while (Lease_try(result.fd) == false)
+	{
+		if (SDL_GetTicks() - ts_begin >= wait_ms)
+		{
+			Lease_release(&result);
+			result.busy = true;
+			return result;
+		}
+
+		SDL_Delay(LEASE_POLL_MS);
+	}
+
+	result.invalid = false;
+
+	return result;
+}
+
+void Lease_release( Lease *lease )
+{
+	/* closing drops the lock */
+	if (lease->fd >= 0)
+	{
+#ifdef _WIN32
+		_locking(lease->fd, _LK_UNLCK, 1);
+		_close(lease->fd);
+#else
+		close(lease->fd);
+#endif
+	}
+
+	lease->fd = -1;
+	lease->invalid = true;
+}
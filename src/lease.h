@@ -0,0 +1,43 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LEASE_H
+#define LEASE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+static const uint32_t LEASE_POLL_MS = 50;
+static const uint32_t LEASE_CONNECT_WAIT_MS = 30000;	/* longer than a daemon tick holds a town */
+
+/* exclusive right to change a town, held by a lock on its lock file.
+	The lock goes away with the process, so a crash never leaves a town locked.
+	The lock file is never removed, else two processes could lock two files of one name. */
+typedef struct Lease
+{
+	bool invalid;		/* not held */
+	bool busy;			/* someone else holds it */
+	int fd;
+} Lease ;
+
+/* waits up to wait_ms while someone else holds the lease */
+Lease Lease_take( const char *town_name, const uint32_t wait_ms );
+
+void Lease_release( Lease *lease );
+
+#endif /* LEASE_H */
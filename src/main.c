@@ -24,9 +24,16 @@
 #include <SM_crypto.h>
 #include "commands.h"
 #include "messages.h"
+#include "town.h"
+#include "daemon.h"
 
 static const uint_fast32_t MAX_ANSWER_LEN = 64;
 
+uint64_t new_seed( void )
+{
+	return ((uint64_t) time(NULL) << 32) ^ (uint64_t) clock();
+}
+
 void print_cmd_djb2( void )
 {
 	FILE *file = fopen("djb2_hash.txt", "w");
@@ -109,11 +116,11 @@ int main( int argc, char **argv )
 				printf("Please enter the town name now: ");
 				get_answer(input, MAX_ANSWER_LEN);
 
-				cmd_hire_admin(num_arg, input);
+				cmd_hire_admin(num_arg, input, new_seed(), TOWN_DEFAULT_WIDTH, TOWN_DEFAULT_HEIGHT);
 				break;
 
 			case 4:
-				cmd_list_towns();
+				cmd_list_towns(NULL);
 				break;
 
 			case 5:
@@ -180,34 +187,60 @@ int main( int argc, char **argv )
 
 	case DJB2_HIRE_ADMIN:
 	case DJB2_HIRE_ADMIN_ABBR:
-		// check argc min
-		if (argc < 4)
+		// check argc min, size needs both sides
+		if (argc < 4 || argc == 6)
 		{
 			printf(MSG_ERR_ARG_MIN);
 			return 0;
 		}
 
 		// check argc max
-		if (argc > 4)
+		if (argc > 7)
 		{
 			printf(MSG_WARN_ARG_MAX);
 		}
 
 		// parse args
 		int32_t admin_id = strtol(argv[2], NULL, 10);
+		uint64_t seed = (argc > 4) ? strtoull(argv[4], NULL, 10) : new_seed();
+		uint32_t width = (argc > 6) ? strtoul(argv[5], NULL, 10) : TOWN_DEFAULT_WIDTH;
+		uint32_t height = (argc > 6) ? strtoul(argv[6], NULL, 10) : TOWN_DEFAULT_HEIGHT;
 
-		cmd_hire_admin(admin_id, argv[3]);
+		cmd_hire_admin(admin_id, argv[3], seed, width, height);
+		break;
+
+	case DJB2_HIRE_ADMIN_BATCH:
+	case DJB2_HIRE_ADMIN_BATCH_ABBR:
+		// check argc min, size needs both sides
+		if (argc < 5 || argc == 6)
+		{
+			printf(MSG_ERR_ARG_MIN);
+			return 0;
+		}
+
+		// check argc max
+		if (argc > 7)
+		{
+			printf(MSG_WARN_ARG_MAX);
+		}
+
+		cmd_hire_admin_batch(
+			strtoul(argv[2], NULL, 10),
+			argv[3],
+			strtoull(argv[4], NULL, 10),
+			(argc > 6) ? strtoul(argv[5], NULL, 10) : TOWN_DEFAULT_WIDTH,
+			(argc > 6) ? strtoul(argv[6], NULL, 10) : TOWN_DEFAULT_HEIGHT);
 		break;
 
 	case DJB2_LIST_TOWNS:
 	case DJB2_LIST_TOWNS_ABBR:
 		// check argc max
-		if (argc > 2)
+		if (argc > 3)
 		{
 			printf(MSG_WARN_ARG_MAX);
 		}
 
-		cmd_list_towns();
+		cmd_list_towns((argc > 2) ? argv[2] : NULL);
 		break;
 
 	case DJB2_CONNECT:
@@ -245,6 +278,70 @@ int main( int argc, char **argv )
 		cmd_delete(argv[2]);
 		break;
 
+	case DJB2_LIST_BACKUPS:
+	case DJB2_LIST_BACKUPS_ABBR:
+		// check argc min
+		if (argc < 3)
+		{
+			printf(MSG_ERR_ARG_MIN);
+			return 0;
+		}
+
+		// check argc max
+		if (argc > 3)
+		{
+			printf(MSG_WARN_ARG_MAX);
+		}
+
+		cmd_list_backups(argv[2]);
+		break;
+
+	case DJB2_RESTORE_BACKUP:
+	case DJB2_RESTORE_BACKUP_ABBR:
+		// check argc min
+		if (argc < 4)
+		{
+			printf(MSG_ERR_ARG_MIN);
+			return 0;
+		}
+
+		// check argc max
+		if (argc > 4)
+		{
+			printf(MSG_WARN_ARG_MAX);
+		}
+
+		cmd_restore_backup(argv[2], strtoul(argv[3], NULL, 10));
+		break;
+
+	case DJB2_REPLAY:
+	case DJB2_REPLAY_ABBR:
+		// check argc min
+		if (argc < 3)
+		{
+			printf(MSG_ERR_ARG_MIN);
+			return 0;
+		}
+
+		// check argc max
+		if (argc > 3)
+		{
+			printf(MSG_WARN_ARG_MAX);
+		}
+
+		cmd_replay(argv[2]);
+		break;
+
+	case DJB2_DAEMON:
+		// check argc max
+		if (argc > 3)
+		{
+			printf(MSG_WARN_ARG_MAX);
+		}
+
+		cmd_daemon((argc > 2) ? strtoul(argv[2], NULL, 10) : DAEMON_STD_ROUND_SECONDS);
+		break;
+
 	default:
 		printf(MSG_ERR_UNKNOWN_COMMAND, DATA_CMDS[CMD_HELP].name);
 		break;
@@ -78,14 +78,15 @@ typedef struct MercenaryData
 	MercRole role;
 	uint32_t max_hp;
 	uint32_t range;			// movement per round
+	uint32_t sight;			// vision radius in fields
 	MercWeapon loadout[3];
 } MercenaryData ;
 
 static const MercenaryData DATA_MERCENARIES[] = {
-    {"Soldier",	MR_OFFENSE,	125, 	2,	{MW_SHOTGUN, MW_GRENADE, MW_KNIFE}},
-    {"Pyro",	MR_OFFENSE,	75,		3,	{MW_FLAMETHROWER, MW_SHOTGUN, MW_NONE}},
-    {"Anchor",	MR_DEFENSE, 300,	1,	{MW_MINIGUN, MW_NONE, MW_NONE}},
-    {"Medic",	MR_SUPPORT, 75,		2,	{MW_SYRINGE_GUN, MW_PISTOL, MW_SWORD}}
+    {"Soldier",	MR_OFFENSE,	125, 	2,	5,	{MW_SHOTGUN, MW_GRENADE, MW_KNIFE}},
+    {"Pyro",	MR_OFFENSE,	75,		3,	4,	{MW_FLAMETHROWER, MW_SHOTGUN, MW_NONE}},
+    {"Anchor",	MR_DEFENSE, 300,	1,	6,	{MW_MINIGUN, MW_NONE, MW_NONE}},
+    {"Medic",	MR_SUPPORT, 75,		2,	5,	{MW_SYRINGE_GUN, MW_PISTOL, MW_SWORD}}
 };
 #define MERCENARY_COUNT sizeof(DATA_MERCENARIES) / sizeof(DATA_MERCENARIES[0])
 
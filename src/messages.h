@@ -19,6 +19,7 @@
 #ifndef MESSAGES_H
 #define MESSAGES_H
 
+#include <inttypes.h>
 #include "commands.h"
 
 /* help text */
@@ -67,6 +68,9 @@ static const char MSG_ERR_DIR_BASE[] =
 static const char MSG_ERR_DIR_TOWNS_CREATE[] =
 	MSG_ERR "Town file directory does not exist and could not be created.\n";
 
+static const char MSG_ERR_DIR_BACKUP[] =
+	MSG_ERR "Town backup directory does not exist and could not be created.\n";
+
 static const char MSG_WARN_CONFIG_SAVE[] =
 	MSG_WARN "Config file could not be saved.\n";
 
@@ -82,12 +86,30 @@ static const char MSG_CONFIG_CREATED[] =
 static const char MSG_ERR_DIR_TOWNS[] =
 	MSG_ERR "Town file directory does not exist.\n";
 
+static const char MSG_TOWN_SUMMARY[] =
+	"%-24s admin: %-10s day: %-4u at: %02u:00  money: %-8u mercs: %u\n";
+
+static const char MSG_TOWN_SUMMARY_INVALID[] =
+	"%-24s (unreadable)\n";
+
+static const char MSG_ERR_CATALOG_SORT[] =
+	MSG_ERR "Towns can not be sorted by \"%s\".\nUse name, admin, round, money or mercs.\n";
+
 static const char MSG_ERR_FILE_TOWN_CORRUPT[] =
 	MSG_ERR "Town file has corrupt information.\n";
 
 static const char MSG_ERR_FILE_TOWN_SAVE[] =
 	MSG_ERR "Town was not successfully saved.\n";
 
+static const char MSG_ERR_FIELD_COUNTS[] =
+	MSG_ERR "Counts of fields differ from the grid.\n";
+
+static const char MSG_ERR_MERC_INDEX[] =
+	MSG_ERR "Index of mercenaries differs from the grid.\n";
+
+static const char MSG_ERR_FILE_TOWN_CHUNKS[] =
+	MSG_ERR "Chunks of the town could not be read or written.\n";
+
 static const char MSG_FILE_TOWN_SAVE[] =
 	"Town was successfully saved.\n";
 
@@ -95,7 +117,8 @@ static const char MSG_FILE_TOWN_SAVE_AS[] =
 	"Town was successfully saved as \"%s\".\n";
 
 static const char MSG_FILE_TOWN_CREATE[] =
-	"New town was successfully created and is awaiting your commands.\n";
+	"New town was successfully created and is awaiting your commands.\n" \
+	"It was generated from seed %" PRIu64 ".\n";
 
 static const char MSG_FILE_TOWN_DELETE[] =
 	"Depending on how bad this case was, you should also get rid of the physical drive.\n";
@@ -115,9 +138,73 @@ static const char MSG_WARN_FILE_TOWN_EXIST[] =
 static const char MSG_WARN_FILE_TOWN_BACKUP[] =
 	MSG_WARN "Creating backup files of this town failed.\n";
 
+static const char MSG_BACKUP_SUMMARY[] =
+	"%-8u generation: %-8u day: %-4u at: %02u:00  money: %u\n";
+
+static const char MSG_BACKUP_NONE[] =
+	"There are no backups of this town.\n";
+
+static const char MSG_ERR_BACKUP_RESTORE[] =
+	MSG_ERR "Backup could not be restored.\nMake sure the backup number exists.\n";
+
+static const char MSG_BACKUP_RESTORE[] =
+	"Backup %u was restored, actions made after it are gone.\n";
+
+static const char MSG_WARN_FILE_JOURNAL[] =
+	MSG_WARN "Town journal could not be opened.\nActions will only be kept on full saves.\n";
+
+static const char MSG_WARN_SAVER_THREAD[] =
+	MSG_WARN "Background saving could not be started.\nThe game will save in the foreground.\n";
+
+static const char MSG_WARN_FILE_RECORD[] =
+	MSG_WARN "Session recording could not be written.\nThis session can not be replayed.\n";
+
+static const char MSG_ERR_FILE_RECORD[] =
+	MSG_ERR "Recording could not be read.\nMake sure it is a session recording of this version.\n";
+
+static const char MSG_REPLAY_RESULT[] =
+	"Replayed %u actions and %u rounds in %.3f s, %.0f rounds per second.\n" \
+	"Town is at day %u %02u:00, state hash %016" PRIx64 ".\n";
+
+static const char MSG_REPLAY_INCOMPLETE[] =
+	MSG_WARN "Recording ends early, the session did not close normally.\n";
+
+static const char MSG_ERR_REPLAY_DIVERGED[] =
+	MSG_ERR "Replay went a different way than the session at day %u %02u:00.\n";
+
 static const char MSG_ERR_ADMIN_ID[] =
 	MSG_ERR "Given admin id does not exist.\nUse \"%s\" command to make your decision.\n";
 
+static const char MSG_ERR_TOWN_SIZE[] =
+	MSG_ERR "Town width and height must be between %u and %u.\n";
+
+static const char MSG_TOWN_BUSY_WAIT[] =
+	"Town is being advanced in the background, waiting for it.\n";
+
+static const char MSG_ERR_TOWN_BUSY[] =
+	MSG_ERR "Town is in use by another connection.\n";
+
+static const char MSG_ERR_TOWN_LEASE[] =
+	MSG_ERR "Town could not be locked for use.\n";
+
+static const char MSG_DAEMON_START[] =
+	"Advancing all towns by one round every %u s, interrupt to stop.\n";
+
+static const char MSG_ERR_DAEMON_SECONDS[] =
+	MSG_ERR "Seconds per round must be between 1 and %u.\n";
+
+static const char MSG_DAEMON_TICK[] =
+	"Round tick: %u towns, %u advanced by %u, %u in use, %u bankrupt, %u failed, %u saved in %.2f s.\n";
+
+static const char MSG_DAEMON_STOP[] =
+	"Stopped advancing towns.\n";
+
+static const char MSG_BATCH_DONE[] =
+	"%i towns created, %i skipped, %i failed in %.2f s (%.1f towns per second).\n";
+
+static const char MSG_ERR_TOWN_GENERATE[] =
+	MSG_ERR "Town could not be generated.\n";
+
 static const char MSG_TOWN_CREATION_STOPPED[] =
 	"Town creation stopped.\n";
 
@@ -179,15 +266,51 @@ static const char GM_MSG_ERR_TOWN_SAVE[] =
 static const char GM_MSG_TOWN_SAVE[] =
 	"Town saved";
 
+static const char GM_MSG_KEEP_BACKUPS[] =
+	"Backup count set.";
+
+static const char GM_MSG_ERR_KEEP_BACKUPS[] =
+	MSG_ERR "Backup count must be between 0 and 255.";
+
 static const char GM_MSG_PASS[] =
 	"Round ended.";
 
+static const char GM_MSG_PASS_ROUNDS[] =
+	"%u rounds passed.";
+
+static const char GM_MSG_PASS_CONSTRUCTION[] =
+	"%u rounds passed, construction done.";
+
+static const char GM_MSG_PASS_MONEY[] =
+	"%u rounds passed, money below %u.";
+
+static const char GM_MSG_PASS_NO_CONSTRUCTION[] =
+	"No construction to wait for.";
+
+static const char GM_MSG_ERR_PASS[] =
+	MSG_ERR "Pass takes 1 to 8760 rounds, \"until construction\" or \"until money AMOUNT\".";
+
 static const char GM_MSG_MERC_MOVE[] =
 	"Mercenary moved.";
 
 static const char GM_MSG_MERC_NO_MOVE[] =
 	"Mercenary could not move to destination.";
 
+static const char GM_MSG_MERC_PATH[] =
+	"Path takes %u of %u steps.";
+
+static const char GM_MSG_MERC_NO_PATH[] =
+	"Mercenary can not reach destination.";
+
+static const char GM_MSG_MERC_COORD_INVALID[] =
+	"Mercenary order invalid. (Coordinates invalid)";
+
+static const char GM_MSG_MERC_ESTIMATE[] =
+	"Win %.0f%%, loss %.0f%%, hp left %.0f to %.0f, kill in %.1f rounds. (%u fights in %.2f s)";
+
+static const char GM_MSG_MERC_NO_ESTIMATE[] =
+	"No fight to estimate. (Two enemy mercenaries needed)";
+
 static const char GM_MSG_CONSTRUCT[] =
 	"Construction order accepted.";
 
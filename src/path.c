@@ -92,6 +92,78 @@ int32_t get_town_path( SM_String *out )
 	return 0;
 }
 
+int32_t get_town_file_path( SM_String *out, const char *town_name, const char *filetype )
+{
+	int32_t rc;
+
+	/* get town dir */
+	rc = get_town_path(out);
+
+	if (rc != 0)
+		return rc;
+
+	/* glue file part to path */
+	SM_String_append_cstr(out, town_name);
+	SM_String_append_cstr(out, ".");
+	SM_String_append_cstr(out, filetype);
+
+	return 0;
+}
+
+int32_t get_town_backup_path( SM_String *out, const char *town_name )
+{
+	int32_t rc;
+	struct stat st;
+
+	/* get backup dir, named like the single backup file of older versions */
+	rc = get_town_file_path(out, town_name, FILETYPE_BACKUP);
+
+	if (rc != 0)
+		return rc;
+
+	/* replace such an old backup file */
+	if (stat(out->str, &st) == 0 && S_ISDIR(st.st_mode) == 0)
+		remove(out->str);
+
+	SM_String_append_cstr(out, SLASH);
+
+	/* in case, create dir */
+	errno = 0;
+
+	#ifdef _WIN32
+		rc = mkdir(out->str);
+	#else
+		rc = mkdir(out->str, S_IRWXU);
+	#endif
+
+	if (rc == -1)
+	{
+		if (errno != EEXIST)
+		{
+			printf(MSG_ERR_DIR_BACKUP);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int32_t get_catalog_path( SM_String *out )
+{
+	int32_t rc;
+
+	/* get town dir */
+	rc = get_town_path(out);
+
+	if (rc != 0)
+		return rc;
+
+	/* get path */
+	SM_String_append_cstr(out, PATH_CATALOG);
+
+	return 0;
+}
+
 int32_t get_config_path( SM_String *out )
 {
 	int32_t rc;
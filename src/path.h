@@ -30,15 +30,29 @@
 
 static const char PATH_TOWNS[] = "towns";
 static const char PATH_CONFIG[] = "config.cfg";
+static const char PATH_CATALOG[] = "catalog.idx";
 static const char PATH_TEXTURE_ICON[] =	PATH_TEXTURES "icon.png";
 
 static const char FILETYPE_TOWN[] = "twn";
 static const char FILETYPE_BACKUP[] = "bkp";
+static const char FILETYPE_TEMP[] = "tmp";
+static const char FILETYPE_JOURNAL[] = "jnl";
+static const char FILETYPE_BACKUP_MANIFEST[] = "man";
+static const char FILETYPE_BACKUP_CHUNK[] = "blk";
+static const char FILETYPE_CHUNKS[] = "chk";
+static const char FILETYPE_RECORD[] = "rec";
+static const char FILETYPE_LOCK[] = "lock";
 
 int32_t get_base_path( SM_String *out );
 
 int32_t get_town_path( SM_String *out );
 
+int32_t get_town_file_path( SM_String *out, const char *town_name, const char *filetype );
+
+int32_t get_town_backup_path( SM_String *out, const char *town_name );
+
+int32_t get_catalog_path( SM_String *out );
+
 int32_t get_config_path( SM_String *out );
 
 #endif /* PATH_H */
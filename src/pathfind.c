@@ -0,0 +1,466 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+#include "town.h"
+#include "pathfind.h"
+
+static const SDL_Point PATH_DIRECTIONS[] = {
+	{1, 0},
+	{-1, 0},
+	{0, 1},
+	{0, -1},
+};
+#define PATH_DIRECTION_COUNT (sizeof(PATH_DIRECTIONS) / sizeof(PATH_DIRECTIONS[0]))
+
+Pathfinder Pathfinder_new( void )
+{
+	Pathfinder result = {
+		.invalid = false,
+		.size = 0,
+		.stamp = 0,
+		.stamps = NULL,
+		.cost = NULL,
+		.heap_pos = NULL,
+		.from = NULL,
+		.open_count = 0,
+		.open = NULL,
+		.path_length = 0,
+		.path = NULL,
+	};
+
+	return result;
+}
+
+static bool Pathfinder_reserve( Pathfinder *pf, const uint32_t cells )
+{
+	uint32_t size = (pf->size == 0) ? 64 : pf->size;
+
+	if (cells <= pf->size)
+		return true;
+
+	while (size < cells)
+		size *= 2;
+
+	Pathfinder_clear(pf);
+
+	pf->stamps = calloc(size, sizeof(uint32_t));
+	pf->cost = malloc(size * sizeof(uint32_t));
+	pf->heap_pos = malloc(size * sizeof(uint32_t));
+	pf->from = malloc(size * sizeof(uint8_t));
+	pf->open = malloc(size * sizeof(uint32_t));
+	pf->path = malloc(size * sizeof(SDL_Point));
+
+	if (pf->stamps == NULL || pf->cost == NULL || pf->heap_pos == NULL ||
+		pf->from == NULL || pf->open == NULL || pf->path == NULL)
+	{
+		Pathfinder_clear(pf);
+		pf->invalid = true;
+		return false;
+	}
+
+	pf->size = size;
+	return true;
+}
+
+static uint32_t manhattan( const SDL_Point a, const SDL_Point b )
+{
+	return abs(a.x - b.x) + abs(a.y - b.y);
+}
+
+static SDL_Point Pathfinder_coords( const Pathfinder *pf, const uint32_t cell )
+{
+	SDL_Point result = {
+		.x = pf->origin.x + (int) (cell % pf->window_w),
+		.y = pf->origin.y + (int) (cell / pf->window_w),
+	};
+
+	return result;
+}
+
+/* lower estimate first, on ties the one further along */
+static bool Pathfinder_before(
+	const Pathfinder *pf, const SDL_Point dest, const uint32_t a, const uint32_t b )
+{
+	const uint32_t est_a = pf->cost[a] + manhattan(Pathfinder_coords(pf, a), dest);
+	const uint32_t est_b = pf->cost[b] + manhattan(Pathfinder_coords(pf, b), dest);
+
+	if (est_a != est_b)
+		return est_a < est_b;
+
+	return pf->cost[a] > pf->cost[b];
+}
+
+static void Pathfinder_sift_up( Pathfinder *pf, const SDL_Point dest, uint32_t pos )
+{
+	const uint32_t cell = pf->open[pos];
+	uint32_t parent;
+
+	while (pos > 0)
+	{
+		parent = (pos - 1) / 2;
+
+		if (Pathfinder_before(pf, dest, cell, pf->open[parent]) == false)
+			break;
+
+		pf->open[pos] = pf->open[parent];
+		pf->heap_pos[pf->open[pos]] = pos;
+		pos = parent;
+	}
+
+	pf->open[pos] = cell;
+	pf->heap_pos[cell] = pos;
+}
+
+static uint32_t Pathfinder_pop( Pathfinder *pf, const SDL_Point dest )
+{
+	const uint32_t result = pf->open[0];
+	uint32_t cell;
+	uint32_t pos = 0;
+	uint32_t child;
+
+	pf->open_count--;
+	pf->heap_pos[result] = PATH_NONE;
+
+	if (pf->open_count == 0)
+		return result;
+
+	/* sift last entry down from the top */
+	cell = pf->open[pf->open_count];
+
+	while ((child = pos * 2 + 1) < pf->open_count)
+	{
+		if (child + 1 < pf->open_count &&
+			Pathfinder_before(pf, dest, pf->open[child + 1], pf->open[child]))
+			child++;
+
+		if (Pathfinder_before(pf, dest, pf->open[child], cell) == false)
+			break;
+
+		pf->open[pos] = pf->open[child];
+		pf->heap_pos[pf->open[pos]] = pos;
+		pos = child;
+	}
+
+	pf->open[pos] = cell;
+	pf->heap_pos[cell] = pos;
+
+	return result;
+}
+
+/* writes the walked fields into path, back to front */
+static void Pathfinder_trace( Pathfinder *pf, const uint32_t dest_cell )
+{
+	SDL_Point coords = Pathfinder_coords(pf, dest_cell);
+	uint32_t cell = dest_cell;
+
+	pf->path_length = pf->cost[dest_cell];
+
+	for (uint32_t i = pf->path_length; i > 0; i--)
+	{
+		pf->path[i - 1] = coords;
+		coords.x -= PATH_DIRECTIONS[pf->from[cell]].x;
+		coords.y -= PATH_DIRECTIONS[pf->from[cell]].y;
+		cell = (coords.y - pf->origin.y) * pf->window_w + (coords.x - pf->origin.x);
+	}
+}
+
+uint32_t Pathfinder_find(
+	Pathfinder *pf,
+	Town *town,
+	const SDL_Point src,
+	const SDL_Point dest,
+	const uint32_t max_cost )
+{
+	int32_t x0, y0, x1, y1;
+	uint32_t cell;
+	uint32_t next;
+	uint32_t cost;
+	SDL_Point coords;
+	SDL_Point next_coords;
+
+	pf->path_length = 0;
+
+	if (Town_coords_valid(town, src.x, src.y) == false ||
+		Town_coords_valid(town, dest.x, dest.y) == false ||
+		manhattan(src, dest) > max_cost)
+		return PATH_NONE;
+
+	if (src.x == dest.x && src.y == dest.y)
+		return 0;
+
+	if (Town_get_field(town, dest) != FIELD_EMPTY)
+		return PATH_NONE;
+
+	/* nothing beyond max_cost of src can be on a path */
+	x0 = (max_cost < (uint32_t) src.x) ? src.x - (int32_t) max_cost : 0;
+	y0 = (max_cost < (uint32_t) src.y) ? src.y - (int32_t) max_cost : 0;
+	x1 = (max_cost < town->width - src.x) ? src.x + (int32_t) max_cost : (int32_t) town->width - 1;
+	y1 = (max_cost < town->height - src.y) ? src.y + (int32_t) max_cost : (int32_t) town->height - 1;
+
+	pf->origin.x = x0;
+	pf->origin.y = y0;
+	pf->window_w = x1 - x0 + 1;
+	pf->window_h = y1 - y0 + 1;
+
+	if (Pathfinder_reserve(pf, pf->window_w * pf->window_h) == false)
+		return PATH_NONE;
+
+	/* new stamp instead of clearing, reset only when it wraps */
+	pf->stamp++;
+
+	if (pf->stamp == 0)
+	{
+		memset(pf->stamps, 0, pf->size * sizeof(uint32_t));
+		pf->stamp = 1;
+	}
+
+	cell = (src.y - y0) * pf->window_w + (src.x - x0);
+	pf->stamps[cell] = pf->stamp;
+	pf->cost[cell] = 0;
+	pf->open[0] = cell;
+	pf->heap_pos[cell] = 0;
+	pf->open_count = 1;
+
+	while (pf->open_count > 0)
+	{
+		cell = Pathfinder_pop(pf, dest);
+		coords = Pathfinder_coords(pf, cell);
+
+		if (coords.x == dest.x && coords.y == dest.y)
+		{
+			Pathfinder_trace(pf, cell);
+			return pf->cost[cell];
+		}
+
+		cost = pf->cost[cell] + 1;
+
+		for (uint32_t i = 0; i < PATH_DIRECTION_COUNT; i++)
+		{
+			next_coords.x = coords.x + PATH_DIRECTIONS[i].x;
+			next_coords.y = coords.y + PATH_DIRECTIONS[i].y;
+
+			if (next_coords.x < x0 || next_coords.x > x1 ||
+				next_coords.y < y0 || next_coords.y > y1 ||
+				cost + manhattan(next_coords, dest) > max_cost)
+				continue;
+
+			next = (next_coords.y - y0) * pf->window_w + (next_coords.x - x0);
+
+			/* first visit, blocked fields get closed right away */
+			if (pf->stamps[next] != pf->stamp)
+			{
+				pf->stamps[next] = pf->stamp;
+
+				if (Town_get_field(town, next_coords) != FIELD_EMPTY)
+				{
+					pf->heap_pos[next] = PATH_NONE;
+					continue;
+				}
+
+				pf->cost[next] = cost;
+				pf->from[next] = i;
+				pf->open[pf->open_count] = next;
+				pf->heap_pos[next] = pf->open_count;
+				pf->open_count++;
+				Pathfinder_sift_up(pf, dest, pf->heap_pos[next]);
+			}
+
+			/* heuristic is consistent, closed fields are final */
+			else if (pf->heap_pos[next] != PATH_NONE && cost < pf->cost[next])
+			{
+				pf->cost[next] = cost;
+				pf->from[next] = i;
+				Pathfinder_sift_up(pf, dest, pf->heap_pos[next]);
+			}
+		}
+	}
+
+	return PATH_NONE;
+}
+
+void Pathfinder_clear( Pathfinder *pf )
+{
+	free(pf->stamps);
+	free(pf->cost);
+	free(pf->heap_pos);
+	free(pf->from);
+	free(pf->open);
+	free(pf->path);
+
+	pf->stamps = NULL;
+	pf->cost = NULL;
+	pf->heap_pos = NULL;
+	pf->from = NULL;
+	pf->open = NULL;
+	pf->path = NULL;
+	pf->size = 0;
+	pf->path_length = 0;
+}
+
+Reach Reach_new( void )
+{
+	Reach result = {
+		.invalid = false,
+		.valid = false,
+		.map_version = 0,
+		.src = {0, 0},
+		.budget = 0,
+		.size = 0,
+		.cost = NULL,
+		.field_count = 0,
+		.fields = NULL,
+	};
+
+	return result;
+}
+
+static bool Reach_reserve( Reach *reach, const uint32_t cells )
+{
+	uint32_t size = (reach->size == 0) ? 16 : reach->size;
+
+	if (cells <= reach->size)
+		return true;
+
+	while (size < cells)
+		size *= 2;
+
+	Reach_clear(reach);
+
+	reach->cost = malloc(size * sizeof(uint32_t));
+	reach->fields = malloc(size * sizeof(SDL_Point));
+
+	if (reach->cost == NULL || reach->fields == NULL)
+	{
+		Reach_clear(reach);
+		reach->invalid = true;
+		return false;
+	}
+
+	reach->size = size;
+	return true;
+}
+
+bool Reach_update( Reach *reach, Town *town, const SDL_Point src, const uint32_t budget )
+{
+	int32_t x0, y0, x1, y1;
+	uint32_t head;
+	uint32_t cell;
+	uint32_t cost;
+	SDL_Point coords;
+	SDL_Point next_coords;
+
+	if (reach->valid &&
+		reach->map_version == town->map_version &&
+		reach->src.x == src.x && reach->src.y == src.y &&
+		reach->budget == budget)
+		return true;
+
+	reach->valid = false;
+	reach->field_count = 0;
+
+	if (Town_coords_valid(town, src.x, src.y) == false)
+		return false;
+
+	x0 = (budget < (uint32_t) src.x) ? src.x - (int32_t) budget : 0;
+	y0 = (budget < (uint32_t) src.y) ? src.y - (int32_t) budget : 0;
+	x1 = (budget < town->width - src.x) ? src.x + (int32_t) budget : (int32_t) town->width - 1;
+	y1 = (budget < town->height - src.y) ? src.y + (int32_t) budget : (int32_t) town->height - 1;
+
+	reach->origin.x = x0;
+	reach->origin.y = y0;
+	reach->window_w = x1 - x0 + 1;
+	reach->window_h = y1 - y0 + 1;
+
+	if (Reach_reserve(reach, reach->window_w * reach->window_h) == false)
+		return false;
+
+	for (uint32_t i = 0; i < reach->window_w * reach->window_h; i++)
+		reach->cost[i] = PATH_NONE;
+
+	reach->cost[(src.y - y0) * reach->window_w + (src.x - x0)] = 0;
+
+	/* fields double as the queue, the source is visited first but not kept */
+	coords = src;
+	head = 0;
+
+	while (true)
+	{
+		cost = reach->cost[(coords.y - y0) * reach->window_w + (coords.x - x0)] + 1;
+
+		for (uint32_t i = 0; cost <= budget && i < PATH_DIRECTION_COUNT; i++)
+		{
+			next_coords.x = coords.x + PATH_DIRECTIONS[i].x;
+			next_coords.y = coords.y + PATH_DIRECTIONS[i].y;
+
+			if (next_coords.x < x0 || next_coords.x > x1 ||
+				next_coords.y < y0 || next_coords.y > y1)
+				continue;
+
+			cell = (next_coords.y - y0) * reach->window_w + (next_coords.x - x0);
+
+			if (reach->cost[cell] != PATH_NONE ||
+				Town_get_field(town, next_coords) != FIELD_EMPTY)
+				continue;
+
+			reach->cost[cell] = cost;
+			reach->fields[reach->field_count] = next_coords;
+			reach->field_count++;
+		}
+
+		if (head == reach->field_count)
+			break;
+
+		coords = reach->fields[head];
+		head++;
+	}
+
+	reach->valid = true;
+	reach->map_version = town->map_version;
+	reach->src = src;
+	reach->budget = budget;
+
+	return true;
+}
+
+uint32_t Reach_cost( const Reach *reach, const SDL_Point coords )
+{
+	if (reach->valid == false ||
+		coords.x < reach->origin.x || coords.y < reach->origin.y ||
+		coords.x >= reach->origin.x + (int32_t) reach->window_w ||
+		coords.y >= reach->origin.y + (int32_t) reach->window_h)
+		return PATH_NONE;
+
+	return reach->cost[(coords.y - reach->origin.y) * reach->window_w + (coords.x - reach->origin.x)];
+}
+
+void Reach_clear( Reach *reach )
+{
+	free(reach->cost);
+	free(reach->fields);
+
+	reach->cost = NULL;
+	reach->fields = NULL;
+	reach->size = 0;
+	reach->valid = false;
+	reach->field_count = 0;
+}
@@ -0,0 +1,105 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PATHFIND_H
+#define PATHFIND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+
+struct Town;
+
+#define PATH_NONE UINT32_MAX
+
+/* A* over empty fields, 4 neighbours, unit step cost.
+	Searches only the window max_cost reaches around the source, buffers
+	are kept between queries and only grow when a window needs more cells.
+	Only backs merc-path, moves are checked against Reach below. */
+typedef struct Pathfinder
+{
+	bool invalid;
+	uint32_t size;			/* cells the buffers hold */
+	uint32_t stamp;			/* query id, cells of other queries are unvisited */
+
+	/* window of the current query, in town coordinates */
+	SDL_Point origin;
+	uint32_t window_w;
+	uint32_t window_h;
+
+	/* per window cell */
+	uint32_t *stamps;
+	uint32_t *cost;
+	uint32_t *heap_pos;		/* PATH_NONE once closed */
+	uint8_t *from;			/* direction the cell was entered with */
+
+	uint32_t open_count;
+	uint32_t *open;			/* min-heap of window cells by estimate */
+
+	/* result of the last successful query, excluding the source */
+	uint32_t path_length;
+	SDL_Point *path;
+} Pathfinder ;
+
+Pathfinder Pathfinder_new( void );
+
+/* returns steps from src to dest or PATH_NONE if dest is not reachable
+	within max_cost, on success path holds the fields walked */
+uint32_t Pathfinder_find(
+	Pathfinder *pf,
+	struct Town *town,
+	const SDL_Point src,
+	const SDL_Point dest,
+	const uint32_t max_cost );
+
+void Pathfinder_clear( Pathfinder *pf );
+
+/* every field a walker can reach with budget steps, by breadth-first
+	search, kept until the map, the source or the budget change */
+typedef struct Reach
+{
+	bool invalid;
+	bool valid;				/* holds a result for the key below */
+
+	/* key */
+	uint32_t map_version;
+	SDL_Point src;
+	uint32_t budget;
+
+	uint32_t size;			/* cells the buffers hold */
+	SDL_Point origin;
+	uint32_t window_w;
+	uint32_t window_h;
+	uint32_t *cost;			/* per window cell, PATH_NONE if unreachable */
+
+	/* reachable fields in order of cost, excluding the source */
+	uint32_t field_count;
+	SDL_Point *fields;
+} Reach ;
+
+Reach Reach_new( void );
+
+/* recomputes only if the cached set is stale, returns false if out of memory */
+bool Reach_update( Reach *reach, struct Town *town, const SDL_Point src, const uint32_t budget );
+
+/* returns steps to coords or PATH_NONE */
+uint32_t Reach_cost( const Reach *reach, const SDL_Point coords );
+
+void Reach_clear( Reach *reach );
+
+#endif /* PATHFIND_H */
@@ -0,0 +1,479 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <SM_string.h>
+#include "path.h"
+#include "buffer.h"
+#include "checksum.h"
+#include "town.h"
+#include "sim.h"
+#include "record.h"
+
+#define RECORD_MAX_PAYLOAD 12
+
+/* payload bytes per record type */
+static const uint8_t RECORD_PAYLOAD_SIZE[] = {
+	[RR_CONSTRUCT] = 5,
+	[RR_SPAWN_MERC] = 6,
+	[RR_MOVE_MERC] = 8,
+	[RR_MERC_ATTACK] = 9,
+	[RR_ROUNDS_END] = 12,
+	[RR_END] = 8,
+};
+
+static void Recorder_write( Recorder *recorder, Buffer *record )
+{
+	Buffer_write_u32(record, crc32c(record->data, record->len));
+
+	if (record->invalid ||
+		fwrite(record->data, 1, record->len, recorder->file) != record->len)
+	{
+		recorder->invalid = true;
+	}
+}
+
+/* whether name is a session stamp as Record_session_path writes it */
+static bool Record_is_stamp( const char *name, const size_t len )
+{
+	if (len == 0)
+		return false;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		if ((name[i] < '0' || name[i] > '9') && name[i] != '-')
+			return false;
+	}
+
+	return true;
+}
+
+/* <town>.<date>-<time>.rec, a number is appended if that is taken already */
+static int32_t Record_session_path( SM_String *out, const char *town_name )
+{
+	const time_t now = time(NULL);
+	const struct tm *local = localtime(&now);
+	char stamp[32] = "0";
+	char suffix[16];
+	FILE *f;
+
+	if (local != NULL)
+		strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", local);
+
+	for (uint32_t i = 0; ; i++)
+	{
+		SM_String_copy_cstr(out, "");
+
+		if (get_town_path(out) != 0)
+			return 1;
+
+		SM_String_append_cstr(out, town_name);
+		SM_String_append_cstr(out, ".");
+		SM_String_append_cstr(out, stamp);
+
+		if (i > 0)
+		{
+			sprintf(suffix, "-%u", i);
+			SM_String_append_cstr(out, suffix);
+		}
+
+		SM_String_append_cstr(out, ".");
+		SM_String_append_cstr(out, FILETYPE_RECORD);
+
+		f = fopen(out->str, "r");
+
+		if (f == NULL)
+			return 0;
+
+		fclose(f);
+	}
+}
+
+Recorder Recorder_open( const char *town_name, Town *town )
+{
+	Recorder result = {
+		.invalid = false,
+		.file = NULL,
+		.town = town,
+	};
+	SM_String filepath = SM_String_new(16);
+	Buffer header = Buffer_new(TOWN_SAVE_BUFFER_SIZE);
+
+	if (Record_session_path(&filepath, town_name) != 0)
+	{
+		result.invalid = true;
+		goto recorder_open_clear;
+	}
+
+	Buffer_write(&header, RECORD_MAGIC, sizeof(RECORD_MAGIC));
+	Buffer_write_u16(&header, RECORD_VERSION);
+	Buffer_write_u64(&header, town->seed);
+	Buffer_write_u32(&header, 0);	/* snapshot length, patched below */
+	Town_write_snapshot(town, &header);
+	Buffer_patch_u32(&header, sizeof(RECORD_MAGIC) + 2 + 8,
+		header.len - sizeof(RECORD_MAGIC) - 2 - 8 - 4);
+
+	result.file = fopen(filepath.str, "wb");
+
+	if (result.file == NULL)
+	{
+		result.invalid = true;
+		goto recorder_open_clear;
+	}
+
+	Recorder_write(&result, &header);
+
+	recorder_open_clear:
+
+	SM_String_clear(&filepath);
+	Buffer_clear(&header);
+
+	return result;
+}
+
+void Recorder_on_event( void *ctx, const SimEvent *event )
+{
+	Recorder *recorder = ctx;
+	uint8_t data[1 + RECORD_MAX_PAYLOAD + 4];
+	Buffer record = {
+		.invalid = false,
+		.data = data,
+		.len = 0,
+		.size = sizeof(data),
+		.pos = 0,
+		.mapped = false,
+	};
+
+	if (recorder->invalid)
+		return;
+
+	switch (event->type)
+	{
+	case SE_CONSTRUCTED:
+		Buffer_write_u8(&record, RR_CONSTRUCT);
+		Buffer_write_u16(&record, event->coords.x);
+		Buffer_write_u16(&record, event->coords.y);
+		Buffer_write_u8(&record, event->field);
+		break;
+
+	case SE_MERC_SPAWNED:
+		Buffer_write_u8(&record, RR_SPAWN_MERC);
+		Buffer_write_u16(&record, event->coords.x);
+		Buffer_write_u16(&record, event->coords.y);
+		Buffer_write_u8(&record, event->arg);
+		Buffer_write_u8(&record, event->arg2);
+		break;
+
+	case SE_MERC_MOVED:
+		Buffer_write_u8(&record, RR_MOVE_MERC);
+		Buffer_write_u16(&record, event->coords.x);
+		Buffer_write_u16(&record, event->coords.y);
+		Buffer_write_u16(&record, event->dest.x);
+		Buffer_write_u16(&record, event->dest.y);
+		break;
+
+	case SE_MERC_ATTACKED:
+		Buffer_write_u8(&record, RR_MERC_ATTACK);
+		Buffer_write_u16(&record, event->coords.x);
+		Buffer_write_u16(&record, event->coords.y);
+		Buffer_write_u8(&record, event->arg);
+		Buffer_write_u16(&record, event->dest.x);
+		Buffer_write_u16(&record, event->dest.y);
+		break;
+
+	case SE_ROUND_ENDED:
+		Buffer_write_u8(&record, RR_ROUNDS_END);
+		Buffer_write_u32(&record, event->rounds);
+		Buffer_write_u64(&record, Town_state_hash(recorder->town));
+		break;
+
+	default:
+		return;
+	}
+
+	Recorder_write(recorder, &record);
+}
+
+void Recorder_close( Recorder *recorder )
+{
+	uint8_t data[1 + RECORD_MAX_PAYLOAD + 4];
+	Buffer record = {
+		.invalid = false,
+		.data = data,
+		.len = 0,
+		.size = sizeof(data),
+		.pos = 0,
+		.mapped = false,
+	};
+
+	if (recorder->file == NULL)
+		return;
+
+	if (recorder->invalid == false)
+	{
+		Buffer_write_u8(&record, RR_END);
+		Buffer_write_u64(&record, Town_state_hash(recorder->town));
+		Recorder_write(recorder, &record);
+	}
+
+	fclose(recorder->file);
+	recorder->file = NULL;
+}
+
+/* applies one record, returns false if the session did not go this way */
+static bool Record_apply( Sim *sim, const RecordType type, Buffer *payload, ReplayResult *result )
+{
+	SDL_Point coords;
+	SDL_Point dest;
+	uint8_t arg, arg2;
+	uint32_t slot;
+	uint32_t rounds;
+	uint32_t passed;
+	uint64_t hash;
+
+	switch (type)
+	{
+	case RR_CONSTRUCT:
+		coords.x = Buffer_read_u16(payload);
+		coords.y = Buffer_read_u16(payload);
+		arg = Buffer_read_u8(payload);
+		result->actions++;
+
+		return arg <= FIELD_LAST &&
+			Town_coords_valid(sim->town, coords.x, coords.y) &&
+			Sim_construct(sim, coords, arg);
+
+	case RR_SPAWN_MERC:
+		coords.x = Buffer_read_u16(payload);
+		coords.y = Buffer_read_u16(payload);
+		arg = Buffer_read_u8(payload);
+		arg2 = Buffer_read_u8(payload);
+		result->actions++;
+
+		return arg < MERCENARY_COUNT && arg2 <= MF_PURPLE &&
+			Town_coords_valid(sim->town, coords.x, coords.y) &&
+			Sim_spawn_merc(sim, (TownMerc) {
+				.id = arg,
+				.coords = coords,
+				.hp = DATA_MERCENARIES[arg].max_hp,
+				.fraction = arg2,
+			});
+
+	case RR_MOVE_MERC:
+		coords.x = Buffer_read_u16(payload);
+		coords.y = Buffer_read_u16(payload);
+		dest.x = Buffer_read_u16(payload);
+		dest.y = Buffer_read_u16(payload);
+		result->actions++;
+
+		return Town_coords_valid(sim->town, coords.x, coords.y) &&
+			Town_coords_valid(sim->town, dest.x, dest.y) &&
+			Sim_move_merc(sim, coords, dest);
+
+	case RR_MERC_ATTACK:
+		coords.x = Buffer_read_u16(payload);
+		coords.y = Buffer_read_u16(payload);
+		arg = Buffer_read_u8(payload);
+		dest.x = Buffer_read_u16(payload);
+		dest.y = Buffer_read_u16(payload);
+		result->actions++;
+
+		if (Town_coords_valid(sim->town, coords.x, coords.y) == false ||
+			Town_coords_valid(sim->town, dest.x, dest.y) == false)
+			return false;
+
+		slot = Town_merc_at(sim->town, coords);
+
+		if (slot == COORDMAP_NONE || sim->town->mercs[slot].attacked)
+			return false;
+
+		/* an accepted attack always marks the attacker, damage may be 0 */
+		Sim_merc_attack(sim, coords, arg, dest);
+
+		return sim->town->mercs[slot].attacked;
+
+	case RR_ROUNDS_END:
+		rounds = Buffer_read_u32(payload);
+		hash = Buffer_read_u64(payload);
+
+		if (Sim_end_rounds(sim, rounds, SS_ROUNDS, 0, &passed) != SS_ROUNDS || passed != rounds)
+			return false;
+
+		result->rounds += rounds;
+
+		return Town_state_hash(sim->town) == hash;
+
+	case RR_END:
+		result->complete = true;
+
+		return Town_state_hash(sim->town) == Buffer_read_u64(payload);
+	}
+
+	return false;
+}
+
+ReplayResult Record_replay( const char *filepath )
+{
+	ReplayResult result = {
+		.invalid = false,
+		.complete = false,
+		.diverged = false,
+		.actions = 0,
+		.rounds = 0,
+		.round = 0,
+		.hash = 0,
+	};
+	Buffer buf = Buffer_from_file(filepath);
+	Buffer snapshot;
+	Buffer payload;
+	const uint8_t *magic;
+	const uint8_t *record;
+	uint32_t snapshot_len;
+	uint8_t type;
+	Town town;
+	Sim sim;
+
+	/* header */
+	magic = Buffer_view(&buf, sizeof(RECORD_MAGIC));
+
+	if (buf.invalid || magic == NULL || memcmp(magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) != 0 ||
+		Buffer_read_u16(&buf) != RECORD_VERSION)
+	{
+		result.invalid = true;
+		Buffer_clear(&buf);
+		return result;
+	}
+
+	Buffer_read_u64(&buf);	/* seed, also part of the snapshot */
+	snapshot_len = Buffer_read_u32(&buf);
+	snapshot = Buffer_slice(&buf, buf.pos, snapshot_len);
+	buf.pos += snapshot_len;
+
+	if (snapshot.invalid || buf.pos + 4 > buf.len ||
+		crc32c(buf.data, buf.pos) != Buffer_read_u32(&buf))
+	{
+		result.invalid = true;
+		Buffer_clear(&buf);
+		return result;
+	}
+
+	town = Town_read_snapshot(&snapshot);
+
+	if (town.invalid)
+	{
+		result.invalid = true;
+		goto record_replay_clear;
+	}
+
+	/* the session started by computing sight, which uncovers fields */
+	sim = Sim_new(&town);
+	Sim_rebuild_fog(&sim);
+
+	/* a short or broken record is where the session crashed */
+	while (result.complete == false && result.diverged == false && buf.pos < buf.len)
+	{
+		type = buf.data[buf.pos];
+
+		if (type < RR_CONSTRUCT || type > RR_END)
+			break;
+
+		record = Buffer_view(&buf, 1 + RECORD_PAYLOAD_SIZE[type] + 4);
+
+		if (record == NULL ||
+			crc32c(record, 1 + RECORD_PAYLOAD_SIZE[type]) !=
+				Buffer_get_u32(&record[1 + RECORD_PAYLOAD_SIZE[type]]))
+		{
+			break;
+		}
+
+		payload = Buffer_slice(&buf, buf.pos - RECORD_PAYLOAD_SIZE[type] - 4, RECORD_PAYLOAD_SIZE[type]);
+
+		if (Record_apply(&sim, type, &payload, &result) == false)
+			result.diverged = true;
+	}
+
+	result.round = town.round;
+	result.hash = Town_state_hash(&town);
+
+	Sim_clear(&sim);
+
+	record_replay_clear:
+
+	Town_clear(&town);
+	Buffer_clear(&buf);
+
+	return result;
+}
+
+void Record_delete_all( const char *town_name )
+{
+	SM_String dir = SM_String_new(16);
+	SM_String filepath = SM_String_new(16);
+	const size_t prefix_len = strlen(town_name) + 1;
+	const size_t suffix_len = strlen(FILETYPE_RECORD) + 1;
+	DIR *d;
+	struct dirent *d_ent;
+	const char *rest;
+	size_t rest_len;
+
+	if (get_town_path(&dir) != 0)
+		goto record_delete_all_clear;
+
+	d = opendir(dir.str);
+
+	if (d == NULL)
+		goto record_delete_all_clear;
+
+	while ((d_ent = readdir(d)) != NULL)
+	{
+		/* <town>.rec of older versions or <town>.<stamp>.rec */
+		if (strncmp(d_ent->d_name, town_name, prefix_len - 1) != 0 ||
+			d_ent->d_name[prefix_len - 1] != '.')
+		{
+			continue;
+		}
+
+		rest = &d_ent->d_name[prefix_len];
+		rest_len = strlen(rest);
+
+		if (strcmp(rest, FILETYPE_RECORD) != 0 &&
+			(rest_len <= suffix_len ||
+			strcmp(&rest[rest_len - suffix_len + 1], FILETYPE_RECORD) != 0 ||
+			rest[rest_len - suffix_len] != '.' ||
+			Record_is_stamp(rest, rest_len - suffix_len) == false))
+		{
+			continue;
+		}
+
+		SM_String_copy(&filepath, &dir);
+		SM_String_append_cstr(&filepath, d_ent->d_name);
+		remove(filepath.str);
+	}
+
+	closedir(d);
+
+	record_delete_all_clear:
+
+	SM_String_clear(&dir);
+	SM_String_clear(&filepath);
+}
@@ -0,0 +1,78 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "town.h"
+#include "sim.h"
+
+static const char RECORD_MAGIC[4] = {'R', 'C', 'R', 'C'};
+static const uint16_t RECORD_VERSION = 1;
+
+/* record types, never reuse or reorder */
+typedef enum RecordType
+{
+	RR_CONSTRUCT = 1,
+	RR_SPAWN_MERC,
+	RR_MOVE_MERC,
+	RR_MERC_ATTACK,
+	RR_ROUNDS_END,		/* rounds passed and state hash after them */
+	RR_END,				/* state hash when the session closed */
+} RecordType ;
+
+/* session log: header with seed and snapshot of the town as the session
+	found it, then every action the simulation accepted.
+	Each record is its type, a fixed payload and a crc32c of both. */
+typedef struct Recorder
+{
+	bool invalid;
+	FILE *file;
+	Town *town;
+} Recorder ;
+
+/* starts a new recording of town in a file named by the time
+	the session began, recordings of earlier sessions are kept */
+Recorder Recorder_open( const char *town_name, Town *town );
+
+/* SimListener, ctx is the recorder */
+void Recorder_on_event( void *ctx, const SimEvent *event );
+
+void Recorder_close( Recorder *recorder );
+
+typedef struct ReplayResult
+{
+	bool invalid;		/* file missing or header broken */
+	bool complete;		/* log ended with RR_END, else the session crashed */
+	bool diverged;		/* an action failed or a hash differed */
+	uint32_t actions;
+	uint32_t rounds;
+	uint32_t round;		/* of the town where replay stopped */
+	uint64_t hash;		/* of the town where replay stopped */
+} ReplayResult ;
+
+/* re-executes a recording without display, verifying hashes on the way */
+ReplayResult Record_replay( const char *filepath );
+
+/* removes the recordings of all sessions of town_name */
+void Record_delete_all( const char *town_name );
+
+#endif /* RECORD_H */
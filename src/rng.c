@@ -0,0 +1,96 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include "rng.h"
+
+static uint64_t splitmix64( uint64_t *x )
+{
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+	return z ^ (z >> 31);
+}
+
+static uint32_t rotl( const uint32_t x, const int k )
+{
+	return (x << k) | (x >> (32 - k));
+}
+
+Rng Rng_new( const uint64_t seed )
+{
+	Rng result;
+	uint64_t x = seed;
+	uint64_t z;
+
+	/* spread seed over whole state, never all zero */
+	z = splitmix64(&x);
+	result.s[0] = z & 0xFFFFFFFF;
+	result.s[1] = z >> 32;
+	z = splitmix64(&x);
+	result.s[2] = z & 0xFFFFFFFF;
+	result.s[3] = z >> 32;
+
+	return result;
+}
+
+/* independent seed for the index-th member of a batch */
+uint64_t Rng_derive_seed( const uint64_t seed, const uint64_t index )
+{
+	uint64_t x = seed ^ (index * 0xD1B54A32D192ED03ULL);
+
+	return splitmix64(&x);
+}
+
+uint32_t Rng_next( Rng *rng )
+{
+	const uint32_t result = rotl(rng->s[1] * 5, 7) * 9;
+	const uint32_t t = rng->s[1] << 9;
+
+	rng->s[2] ^= rng->s[0];
+	rng->s[3] ^= rng->s[1];
+	rng->s[1] ^= rng->s[2];
+	rng->s[0] ^= rng->s[3];
+	rng->s[2] ^= t;
+	rng->s[3] = rotl(rng->s[3], 11);
+
+	return result;
+}
+
+/* unbiased number in [0, bound), Lemire's multiply and reject */
+uint32_t Rng_range( Rng *rng, const uint32_t bound )
+{
+	uint64_t m = (uint64_t) Rng_next(rng) * bound;
+	uint32_t low = (uint32_t) m;
+	uint32_t threshold;
+
+	if (low < bound)
+	{
+		threshold = (0u - bound) % bound;
+
+		while (low < threshold)
+		{
+			m = (uint64_t) Rng_next(rng) * bound;
+			low = (uint32_t) m;
+		}
+	}
+
+	return m >> 32;
+}
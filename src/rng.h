@@ -0,0 +1,38 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/* xoshiro128** generator, small enough to live in every town */
+typedef struct Rng
+{
+	uint32_t s[4];
+} Rng ;
+
+Rng Rng_new( const uint64_t seed );
+
+uint64_t Rng_derive_seed( const uint64_t seed, const uint64_t index );
+
+uint32_t Rng_next( Rng *rng );
+
+uint32_t Rng_range( Rng *rng, const uint32_t bound );
+
+#endif /* RNG_H */
@@ -0,0 +1,213 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+#include "town.h"
+#include "saver.h"
+
+static int Saver_run( void *data )
+{
+	Saver *saver = data;
+	Town snapshot;
+
+	SDL_LockMutex(saver->mutex);
+
+	while (true)
+	{
+		while (saver->has_pending == false && saver->quit == false)
+			SDL_CondWait(saver->cond, saver->mutex);
+
+		if (saver->has_pending == false)
+			break;
+
+		/* take over newest snapshot, write it without holding the lock */
+		snapshot = saver->pending;
+		saver->has_pending = false;
+		saver->busy = true;
+		SDL_UnlockMutex(saver->mutex);
+
+		snapshot.invalid = false;
+		Town_save(&snapshot, saver->town_name);
+		Town_clear(&snapshot);
+
+		SDL_LockMutex(saver->mutex);
+		saver->busy = false;
+		saver->failed |= snapshot.invalid;
+		SDL_CondBroadcast(saver->cond);
+	}
+
+	SDL_UnlockMutex(saver->mutex);
+
+	return 0;
+}
+
+void Saver_new( Saver *saver, const char *town_name )
+{
+	saver->invalid = false;
+	saver->town_name = town_name;
+	saver->thread = NULL;
+	saver->has_pending = false;
+	saver->busy = false;
+	saver->quit = false;
+	saver->failed = false;
+
+	saver->mutex = SDL_CreateMutex();
+	saver->cond = SDL_CreateCond();
+
+	if (saver->mutex == NULL || saver->cond == NULL)
+	{
+		saver->invalid = true;
+		return;
+	}
+
+	/* the thread keeps a pointer, so saver must not move from here on */
+	saver->thread = SDL_CreateThread(Saver_run, "saver", saver);
+
+	if (saver->thread == NULL)
+		saver->invalid = true;
+}
+
+void Saver_new_inline( Saver *saver, const char *town_name )
+{
+	saver->invalid = true;
+	saver->town_name = town_name;
+	saver->thread = NULL;
+	saver->mutex = NULL;
+	saver->cond = NULL;
+	saver->has_pending = false;
+	saver->busy = false;
+	saver->quit = false;
+	saver->failed = false;
+}
+
+static void Saver_fail( Saver *saver )
+{
+	if (saver->invalid)
+	{
+		saver->failed = true;
+		return;
+	}
+
+	SDL_LockMutex(saver->mutex);
+	saver->failed = true;
+	SDL_UnlockMutex(saver->mutex);
+}
+
+void Saver_submit( Saver *saver, Town *town )
+{
+	Town snapshot;
+
+	/* only this thread writes to the chunk log, the snapshot just refers to it */
+	if (ChunkStore_flush(&town->chunks) == false)
+	{
+		Saver_fail(saver);
+		return;
+	}
+
+	/* the snapshot needs its own directory and constructions */
+	snapshot = Town_copy(town);
+
+	if (snapshot.invalid)
+	{
+		Town_clear(&snapshot);
+		Saver_fail(saver);
+		return;
+	}
+
+	if (saver->invalid)
+	{
+		Town_save(&snapshot, saver->town_name);
+		saver->failed |= snapshot.invalid;
+		Town_clear(&snapshot);
+		return;
+	}
+
+	SDL_LockMutex(saver->mutex);
+
+	/* an unwritten older snapshot is superseded */
+	if (saver->has_pending)
+		Town_clear(&saver->pending);
+
+	saver->pending = snapshot;
+	saver->has_pending = true;
+	SDL_CondBroadcast(saver->cond);
+	SDL_UnlockMutex(saver->mutex);
+}
+
+/* returns whether a save failed since the last call, without waiting */
+bool Saver_poll_failure( Saver *saver )
+{
+	bool result;
+
+	if (saver->invalid)
+	{
+		result = saver->failed;
+		saver->failed = false;
+		return result;
+	}
+
+	SDL_LockMutex(saver->mutex);
+	result = saver->failed;
+	saver->failed = false;
+	SDL_UnlockMutex(saver->mutex);
+
+	return result;
+}
+
+/* waits until all submitted snapshots are written,
+	returns false if any save failed since the last check */
+bool Saver_drain( Saver *saver )
+{
+	if (saver->invalid == false)
+	{
+		SDL_LockMutex(saver->mutex);
+
+		while (saver->has_pending || saver->busy)
+			SDL_CondWait(saver->cond, saver->mutex);
+
+		SDL_UnlockMutex(saver->mutex);
+	}
+
+	return (Saver_poll_failure(saver) == false);
+}
+
+void Saver_clear( Saver *saver )
+{
+	if (saver->thread != NULL)
+	{
+		SDL_LockMutex(saver->mutex);
+		saver->quit = true;
+		SDL_CondBroadcast(saver->cond);
+		SDL_UnlockMutex(saver->mutex);
+
+		/* pending snapshots get written before the thread ends */
+		SDL_WaitThread(saver->thread, NULL);
+		saver->thread = NULL;
+	}
+
+	if (saver->cond != NULL)
+		SDL_DestroyCond(saver->cond);
+
+	if (saver->mutex != NULL)
+		SDL_DestroyMutex(saver->mutex);
+
+	saver->cond = NULL;
+	saver->mutex = NULL;
+}
@@ -0,0 +1,58 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SAVER_H
+#define SAVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+#include "town.h"
+
+/* writes town snapshots on a background thread,
+	a newer snapshot replaces one that has not been picked up yet */
+typedef struct Saver
+{
+	bool invalid;		/* no thread, saves happen synchronously */
+	const char *town_name;
+
+	SDL_Thread *thread;
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+
+	Town pending;
+	bool has_pending;
+	bool busy;
+	bool quit;
+	bool failed;		/* a save failed since last check */
+} Saver ;
+
+void Saver_new( Saver *saver, const char *town_name );
+
+/* without a thread, for callers that already are one of many workers */
+void Saver_new_inline( Saver *saver, const char *town_name );
+
+void Saver_submit( Saver *saver, Town *town );
+
+bool Saver_poll_failure( Saver *saver );
+
+bool Saver_drain( Saver *saver );
+
+void Saver_clear( Saver *saver );
+
+#endif /* SAVER_H */
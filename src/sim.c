@@ -0,0 +1,557 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "admins.h"
+#include "mercs.h"
+#include "town.h"
+#include "sim.h"
+
+Sim Sim_new( Town *town )
+{
+	Sim result = {
+		.town = town,
+		.pathfinder = Pathfinder_new(),
+		.fog = Fog_new(),
+		.listener_count = 0,
+	};
+
+	for (uint32_t i = 0; i < MERCENARY_COUNT; i++)
+		result.reach[i] = Reach_new();
+
+	return result;
+}
+
+bool Sim_subscribe( Sim *sim, const SimListener listener, void *ctx )
+{
+	if (sim->listener_count >= SIM_MAX_LISTENERS)
+		return false;
+
+	sim->listeners[sim->listener_count] = listener;
+	sim->listener_ctx[sim->listener_count] = ctx;
+	sim->listener_count++;
+
+	return true;
+}
+
+void Sim_unsubscribe( Sim *sim, const SimListener listener, void *ctx )
+{
+	for (uint32_t i = 0; i < sim->listener_count; i++)
+	{
+		if (sim->listeners[i] != listener || sim->listener_ctx[i] != ctx)
+			continue;
+
+		/* keep order, listeners may rely on being called after others */
+		for (uint32_t j = i + 1; j < sim->listener_count; j++)
+		{
+			sim->listeners[j - 1] = sim->listeners[j];
+			sim->listener_ctx[j - 1] = sim->listener_ctx[j];
+		}
+
+		sim->listener_count--;
+		return;
+	}
+}
+
+static void Sim_emit( Sim *sim, const SimEvent event )
+{
+	for (uint32_t i = 0; i < sim->listener_count; i++)
+		sim->listeners[i](sim->listener_ctx[i], &event);
+}
+
+static void Sim_emit_field( Sim *sim, const SDL_Point coords )
+{
+	Sim_emit(sim, (SimEvent) {
+		.type = SE_FIELD,
+		.coords = coords,
+		.field = Town_get_field(sim->town, coords),
+		.hidden = Town_get_hidden(sim->town, coords),
+		.visible = Fog_visible(&sim->fog, FOG_PLAYER_FRACTION, coords),
+	});
+}
+
+static void Sim_emit_money( Sim *sim )
+{
+	Sim_emit(sim, (SimEvent) {
+		.type = SE_MONEY,
+		.value = sim->town->money,
+	});
+}
+
+/* reports fields whose visibility changed,
+	fields the player sees for the first time stop being hidden */
+static void Sim_apply_fog( Sim *sim )
+{
+	SDL_Point coords;
+
+	for (uint32_t i = 0; i < sim->fog.changed_count; i++)
+	{
+		coords = sim->fog.changed[i];
+
+		if (Fog_visible(&sim->fog, FOG_PLAYER_FRACTION, coords) &&
+			Town_get_hidden(sim->town, coords))
+			Town_set_hidden(sim->town, coords, false);
+
+		Sim_emit_field(sim, coords);
+	}
+
+	Fog_reset_changes(&sim->fog);
+}
+
+void Sim_rebuild_fog( Sim *sim )
+{
+	Fog_rebuild(&sim->fog, sim->town);
+	Sim_apply_fog(sim);
+}
+
+/* running cost per round, fixed until a field changes */
+static uint32_t Sim_upkeep( const Town *town )
+{
+	return DATA_ADMINS[town->admin_id].salary + Town_running_cost(town);
+}
+
+/* rounds that can pass before the next construction is due */
+static uint32_t Sim_quiet_rounds( const Town *town )
+{
+	uint32_t ready;
+
+	if (town->construction_count == 0)
+		return UINT32_MAX;
+
+	ready = Construction_ready_round(&town->constructions[0]);
+
+	if (ready <= town->round + 1)
+		return 0;
+
+	return ready - town->round - 1;
+}
+
+/* passes rounds in which only the upkeep is paid, caller makes sure
+	they are quiet and affordable */
+static void Sim_skip_rounds( Sim *sim, const uint32_t rounds, const uint32_t cost )
+{
+	Town *town = sim->town;
+
+	town->money -= rounds * cost;
+	town->round += rounds;
+
+	// reset mercenaries move counter and attacked flag
+	for (uint32_t i = 0; i < town->merc_count; i++)
+	{
+		town->mercs[i].moved = 0;
+		town->mercs[i].attacked = false;
+	}
+}
+
+/* finishes constructions due by now, others stay untouched, returns how many */
+static uint32_t Sim_finish_constructions( Sim *sim )
+{
+	Town *town = sim->town;
+	uint32_t result = 0;
+
+	while (town->construction_count > 0 &&
+		Construction_ready_round(&town->constructions[0]) <= town->round)
+	{
+		const Construction site = town->constructions[0];
+
+		Town_construction_queue_remove(town, 0);
+
+		/* set field to actual building */
+		Town_set_field(town, site.coords, site.field);
+		Fog_field_changed(&sim->fog, town, site.coords, FIELD_CONSTRUCTION);
+
+		Sim_emit_field(sim, site.coords);
+		Sim_emit(sim, (SimEvent) {
+			.type = SE_CONSTRUCTION_DONE,
+			.coords = site.coords,
+			.field = site.field,
+		});
+
+		result++;
+	}
+
+	return result;
+}
+
+SimStop Sim_end_rounds(
+	Sim *sim,
+	const uint32_t max_rounds,
+	const SimStop stop,
+	const uint32_t money_below,
+	uint32_t *passed )
+{
+	Town *town = sim->town;
+	SimStop result = SS_ROUNDS;
+	uint32_t cost;
+	uint32_t rounds;
+
+	*passed = 0;
+
+	if (stop == SS_MONEY_BELOW && town->money < money_below)
+		return SS_MONEY_BELOW;
+
+	while (*passed < max_rounds)
+	{
+		cost = Sim_upkeep(town);
+
+		/* if cost is not lower than current money, gameover */
+		if (cost >= town->money)
+		{
+			result = SS_BANKRUPT;
+			break;
+		}
+
+		/* jump over rounds that only cost upkeep, up to whatever comes first */
+		rounds = max_rounds - *passed;
+
+		if (Sim_quiet_rounds(town) < rounds)
+			rounds = Sim_quiet_rounds(town);
+
+		if (cost > 0)
+		{
+			/* rounds the money pays for */
+			if ((town->money - 1) / cost < rounds)
+				rounds = (town->money - 1) / cost;
+
+			/* rounds until money drops below the mark */
+			if (stop == SS_MONEY_BELOW && (town->money - money_below) / cost + 1 < rounds)
+				rounds = (town->money - money_below) / cost + 1;
+		}
+
+		if (rounds > 0)
+		{
+			Sim_skip_rounds(sim, rounds, cost);
+			*passed += rounds;
+		}
+		else
+		{
+			/* next round finishes constructions, play it out */
+			Sim_skip_rounds(sim, 1, cost);
+			*passed += 1;
+
+			if (Sim_finish_constructions(sim) > 0 && stop == SS_CONSTRUCTION_DONE)
+			{
+				result = SS_CONSTRUCTION_DONE;
+				break;
+			}
+		}
+
+		if (stop == SS_MONEY_BELOW && town->money < money_below)
+		{
+			result = SS_MONEY_BELOW;
+			break;
+		}
+	}
+
+	if (*passed == 0)
+		return result;
+
+	Sim_apply_fog(sim);
+	Sim_emit_money(sim);
+
+	/* last, so listeners see the finished rounds */
+	Sim_emit(sim, (SimEvent) {
+		.type = SE_ROUND_ENDED,
+		.value = town->round,
+		.rounds = *passed,
+	});
+
+	return result;
+}
+
+bool Sim_end_round( Sim *sim )
+{
+	uint32_t passed;
+
+	return Sim_end_rounds(sim, 1, SS_ROUNDS, 0, &passed) != SS_BANKRUPT;
+}
+
+bool Sim_construct( Sim *sim, const SDL_Point coords, const Field field )
+{
+	const Field old_field = Town_get_field(sim->town, coords);
+
+	// if destruction wished
+	if (field == FIELD_EMPTY)
+	{
+		// if field is empty, headquarter or a merc, stop
+		if (old_field == FIELD_EMPTY ||
+			old_field == FIELD_ADMINISTRATION ||
+			old_field == FIELD_MERC)
+			return false;
+	}
+	else // if construction wished
+	{
+		// if field is not empty, stop
+		if (old_field != FIELD_EMPTY)
+			return false;
+	}
+
+	/* queue building, replacing a pending job on this site */
+	if (Town_construction_queue_add(sim->town, (Construction) {
+			.field = field,
+			.coords = coords,
+			.start_round = sim->town->round,
+		}) == false)
+	{
+		return false;
+	}
+
+	/* change field */
+	Town_set_field(sim->town, coords, FIELD_CONSTRUCTION);
+	Fog_field_changed(&sim->fog, sim->town, coords, old_field);
+
+	/* subtract cost of building */
+	sim->town->money -= DATA_FIELDS[field].construction_cost;
+
+	Sim_emit(sim, (SimEvent) {
+		.type = SE_CONSTRUCTED,
+		.coords = coords,
+		.field = field,
+	});
+	Sim_emit_money(sim);
+	Sim_emit_field(sim, coords);
+	Sim_apply_fog(sim);
+
+	return true;
+}
+
+bool Sim_spawn_merc( Sim *sim, const TownMerc merc )
+{
+	if (merc.id >= MERCENARY_COUNT)
+		return false;
+
+	// if field is not empty, stop
+	if (Town_get_field(sim->town, merc.coords) != FIELD_EMPTY)
+		return false;
+
+	// if merc already exists, stop
+	for (uint32_t i = 0; i < sim->town->merc_count; i++)
+	{
+		if (merc.id == sim->town->mercs[i].id)
+			return false;
+	}
+
+	// add to merc list and occupy field
+	if (Town_merc_spawn(sim->town, merc) == false)
+		return false;
+
+	Fog_set_viewer(&sim->fog, sim->town, sim->town->merc_count - 1,
+		merc.fraction, merc.coords, DATA_MERCENARIES[merc.id].sight);
+
+	Sim_emit(sim, (SimEvent) {
+		.type = SE_MERC_SPAWNED,
+		.coords = merc.coords,
+		.arg = merc.id,
+		.arg2 = merc.fraction,
+	});
+	Sim_emit_field(sim, merc.coords);
+	Sim_apply_fog(sim);
+
+	return true;
+}
+
+uint32_t Sim_merc_steps_left( const Sim *sim, const SDL_Point src_coord )
+{
+	const uint32_t merc = Town_merc_at(sim->town, src_coord);
+	uint32_t range;
+
+	if (merc == COORDMAP_NONE)
+		return 0;
+
+	range = DATA_MERCENARIES[sim->town->mercs[merc].id].range;
+
+	if (sim->town->mercs[merc].moved >= range)
+		return 0;
+
+	return range - sim->town->mercs[merc].moved;
+}
+
+const Reach* Sim_merc_reach( Sim *sim, const SDL_Point src_coord )
+{
+	const uint32_t merc = Town_merc_at(sim->town, src_coord);
+	Reach *reach;
+
+	if (merc == COORDMAP_NONE)
+		return NULL;
+
+	/* reuses the last set unless map or budget changed since */
+	reach = &sim->reach[merc];
+
+	if (Reach_update(reach, sim->town, src_coord, Sim_merc_steps_left(sim, src_coord)) == false)
+		return NULL;
+
+	return reach;
+}
+
+uint32_t Sim_find_path( Sim *sim, const SDL_Point src_coord, const SDL_Point dest_coord )
+{
+	if (Town_merc_at(sim->town, src_coord) == COORDMAP_NONE)
+		return PATH_NONE;
+
+	return Pathfinder_find(
+		&sim->pathfinder,
+		sim->town,
+		src_coord,
+		dest_coord,
+		Sim_merc_steps_left(sim, src_coord));
+}
+
+bool Sim_move_merc( Sim *sim, const SDL_Point src_coord, const SDL_Point dest_coord )
+{
+	const Reach *reach;
+	TownMerc *merc;
+	uint32_t slot;
+	uint32_t cost;
+
+	// check if src_coord has mercenary
+	slot = Town_merc_at(sim->town, src_coord);
+	reach = Sim_merc_reach(sim, src_coord);
+
+	if (slot == COORDMAP_NONE || reach == NULL)
+		return false;
+
+	// walk around whatever is in the way, as far as range is left
+	cost = Reach_cost(reach, dest_coord);
+
+	if (cost == PATH_NONE || cost == 0)
+		return false;
+
+	merc = &sim->town->mercs[slot];
+	merc->moved += cost;
+
+	// move merc and its field
+	Town_merc_move(sim->town, slot, dest_coord);
+	Fog_set_viewer(&sim->fog, sim->town, slot, merc->fraction,
+		dest_coord, DATA_MERCENARIES[merc->id].sight);
+
+	Sim_emit(sim, (SimEvent) {
+		.type = SE_MERC_MOVED,
+		.coords = src_coord,
+		.dest = dest_coord,
+	});
+	Sim_emit_field(sim, src_coord);
+	Sim_emit_field(sim, dest_coord);
+	Sim_apply_fog(sim);
+
+	return true;
+}
+
+int_fast32_t Sim_weapon_damage( const MercWeapon weapon, const uint_fast32_t distance )
+{
+	int_fast32_t damage = DATA_WEAPONS[weapon].damage;
+	float dmg_falloff;
+
+	if (DATA_WEAPONS[weapon].damage_falloff)
+	{
+		dmg_falloff = 1.5f - ((float) (distance) / (float) DATA_WEAPONS[weapon].range);
+		damage *= dmg_falloff;
+	}
+
+	return damage;
+}
+
+int_fast32_t Sim_merc_attack(
+	Sim *sim,
+	const SDL_Point src_coord,
+	const uint_fast8_t weapon_slot,
+	const SDL_Point dest_coord )
+{
+	MercWeapon weapon;
+	int_fast32_t damage;
+	uint_fast32_t distance;
+	uint32_t source_merc;
+	uint32_t target_merc;
+	Mercenary target_id;
+
+	// check if src_coord has mercenary
+	source_merc = Town_merc_at(sim->town, src_coord);
+
+	if (source_merc == COORDMAP_NONE)
+		return 0;
+
+	// check if destination is valid target
+	target_merc = Town_merc_at(sim->town, dest_coord);
+
+	if (target_merc == COORDMAP_NONE)
+		return 0;
+
+	// find used weapon
+	if (weapon_slot >= sizeof(DATA_MERCENARIES[0].loadout) / sizeof(DATA_MERCENARIES[0].loadout[0]))
+		return 0;
+
+	weapon = DATA_MERCENARIES[sim->town->mercs[source_merc].id].loadout[weapon_slot];
+
+	// if not in range, stop
+	distance = get_distance(src_coord, dest_coord);
+
+	if (DATA_WEAPONS[weapon].range < distance)
+		return 0;
+
+	// calculate damage
+	damage = Sim_weapon_damage(weapon, distance);
+
+	// if source merc can not attack, stop
+	if (sim->town->mercs[source_merc].attacked)
+		return 0;
+
+	// set attacked flag
+	sim->town->mercs[source_merc].attacked = true;
+
+	Sim_emit(sim, (SimEvent) {
+		.type = SE_MERC_ATTACKED,
+		.coords = src_coord,
+		.dest = dest_coord,
+		.arg = weapon_slot,
+		.value = damage,
+	});
+
+	// if damage is lethal
+	if (damage >= sim->town->mercs[target_merc].hp)
+	{
+		// kill merc, update town
+		target_id = sim->town->mercs[target_merc].id;
+		Town_merc_kill(sim->town, target_merc);
+		Fog_remove_viewer(&sim->fog, target_merc);
+
+		Sim_emit(sim, (SimEvent) {
+			.type = SE_MERC_KILLED,
+			.coords = dest_coord,
+			.arg = target_id,
+		});
+		Sim_emit_field(sim, dest_coord);
+		Sim_apply_fog(sim);
+	}
+
+	// else apply damage
+	else
+		sim->town->mercs[target_merc].hp -= damage;
+
+	return damage;
+}
+
+void Sim_clear( Sim *sim )
+{
+	Pathfinder_clear(&sim->pathfinder);
+
+	for (uint32_t i = 0; i < MERCENARY_COUNT; i++)
+		Reach_clear(&sim->reach[i]);
+
+	Fog_clear(&sim->fog);
+	sim->listener_count = 0;
+}
@@ -0,0 +1,138 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+#include "town.h"
+#include "pathfind.h"
+#include "fog.h"
+
+#define SIM_MAX_LISTENERS 4
+
+enum SimEventType
+{
+	SE_FIELD,				/* content or player visibility of coords changed */
+	SE_MONEY,				/* value is the new balance */
+	SE_ROUND_ENDED,			/* value is the new round, rounds how many passed */
+	SE_CONSTRUCTED,			/* field was ordered at coords */
+	SE_CONSTRUCTION_DONE,	/* field was finished at coords */
+	SE_MERC_SPAWNED,		/* arg is the merc id, arg2 its fraction */
+	SE_MERC_MOVED,			/* from coords to dest */
+	SE_MERC_ATTACKED,		/* from coords at dest with weapon slot arg, value is damage */
+	SE_MERC_KILLED,			/* arg is the merc id */
+};
+
+/* why passing rounds stopped, or what should stop it */
+typedef enum SimStop
+{
+	SS_ROUNDS,				/* all rounds passed */
+	SS_CONSTRUCTION_DONE,
+	SS_MONEY_BELOW,
+	SS_BANKRUPT
+} SimStop ;
+
+typedef struct SimEvent
+{
+	enum SimEventType type;
+	SDL_Point coords;
+	SDL_Point dest;
+	uint32_t value;
+	uint32_t rounds;
+	uint8_t arg;
+	uint8_t arg2;
+
+	/* state of coords after a SE_FIELD, also set for construction events */
+	Field field;
+	bool hidden;
+	bool visible;
+} SimEvent ;
+
+/* events arrive synchronously, after the town already changed */
+typedef void (*SimListener)( void *ctx, const SimEvent *event );
+
+/* game rules on a town, without any display.
+	Mutators check the rules, change the town and tell listeners what changed. */
+typedef struct Sim
+{
+	Town *town;
+	Pathfinder pathfinder;			/* buffers reused by every path query */
+	Reach reach[MERCENARY_COUNT];	/* per merc slot, computed on first request */
+	Fog fog;
+
+	uint32_t listener_count;
+	SimListener listeners[SIM_MAX_LISTENERS];
+	void *listener_ctx[SIM_MAX_LISTENERS];
+} Sim ;
+
+Sim Sim_new( Town *town );
+
+bool Sim_subscribe( Sim *sim, const SimListener listener, void *ctx );
+
+void Sim_unsubscribe( Sim *sim, const SimListener listener, void *ctx );
+
+/* sight of everything in the town, for a freshly loaded town */
+void Sim_rebuild_fog( Sim *sim );
+
+/* returns false and changes nothing if the running cost can not be paid */
+bool Sim_end_round( Sim *sim );
+
+/* ends up to max_rounds rounds, stopping early once a construction finished
+	or money dropped below money_below if stop asks for it.
+	Rounds between constructions only cost upkeep and pass in one step,
+	listeners get a single SE_ROUND_ENDED for all of them. */
+SimStop Sim_end_rounds(
+	Sim *sim,
+	const uint32_t max_rounds,
+	const SimStop stop,
+	const uint32_t money_below,
+	uint32_t *passed );
+
+/* FIELD_EMPTY destructs */
+bool Sim_construct( Sim *sim, const SDL_Point coords, const Field field );
+
+bool Sim_spawn_merc( Sim *sim, const TownMerc merc );
+
+/* steps the merc at src_coord could still walk this round */
+uint32_t Sim_merc_steps_left( const Sim *sim, const SDL_Point src_coord );
+
+/* fields the merc at src_coord can still reach this round, NULL if there is none */
+const Reach* Sim_merc_reach( Sim *sim, const SDL_Point src_coord );
+
+/* returns path cost or PATH_NONE, path is left in sim->pathfinder */
+uint32_t Sim_find_path( Sim *sim, const SDL_Point src_coord, const SDL_Point dest_coord );
+
+bool Sim_move_merc( Sim *sim, const SDL_Point src_coord, const SDL_Point dest_coord );
+
+/* damage of weapon on a target at distance, which must be within its range,
+	negative heals */
+int_fast32_t Sim_weapon_damage( const MercWeapon weapon, const uint_fast32_t distance );
+
+/* returns dealt damage */
+int_fast32_t Sim_merc_attack(
+	Sim *sim,
+	const SDL_Point src_coord,
+	const uint_fast8_t weapon_slot,
+	const SDL_Point dest_coord );
+
+void Sim_clear( Sim *sim );
+
+#endif /* SIM_H */
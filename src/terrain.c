@@ -0,0 +1,203 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "terrain.h"
+
+static uint64_t mix64( uint64_t z )
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+	return z ^ (z >> 31);
+}
+
+/* value of a lattice point in [0, 1), stateless so maps can have any size */
+static float lattice_value( const uint64_t seed, const uint32_t octave, const uint32_t ix, const uint32_t iy )
+{
+	uint64_t h = mix64(seed + 0x9E3779B97F4A7C15ULL * (octave + 1));
+
+	h = mix64(h ^ ((uint64_t) ix << 32 | iy));
+
+	return (h >> 40) * (1.0f / 16777216.0f);
+}
+
+static float smooth( const float t )
+{
+	return t * t * (3.0f - 2.0f * t);
+}
+
+/* lattice row iy of an octave, interpolated horizontally for every column */
+static void lattice_row(
+	float *out,
+	float *lattice,
+	const uint32_t width,
+	const uint32_t period,
+	const uint64_t seed,
+	const uint32_t octave,
+	const uint32_t iy )
+{
+	const uint32_t lattice_count = width / period + 2;
+	uint32_t ix;
+	float sx;
+
+	for (uint32_t i = 0; i < lattice_count; i++)
+	{
+		lattice[i] = lattice_value(seed, octave, i, iy);
+	}
+
+	for (uint32_t x = 0; x < width; x++)
+	{
+		ix = x / period;
+		sx = smooth((float) (x % period) / period);
+		out[x] = lattice[ix] + sx * (lattice[ix + 1] - lattice[ix]);
+	}
+}
+
+/* out += weight * (row0 + sy * (row1 - row0)), the bulk of the work */
+static void blend_rows(
+	float *out,
+	const float *row0,
+	const float *row1,
+	const float sy,
+	const float weight,
+	const uint32_t width )
+{
+	uint32_t x = 0;
+
+#ifdef __SSE2__
+	const __m128 v_sy = _mm_set1_ps(sy);
+	const __m128 v_weight = _mm_set1_ps(weight);
+	__m128 v0, v1;
+
+	for (; x + 4 <= width; x += 4)
+	{
+		v0 = _mm_loadu_ps(&row0[x]);
+		v1 = _mm_loadu_ps(&row1[x]);
+		v0 = _mm_add_ps(v0, _mm_mul_ps(v_sy, _mm_sub_ps(v1, v0)));
+		_mm_storeu_ps(&out[x], _mm_add_ps(_mm_loadu_ps(&out[x]), _mm_mul_ps(v_weight, v0)));
+	}
+#endif
+
+	for (; x < width; x++)
+	{
+		out[x] += weight * (row0[x] + sy * (row1[x] - row0[x]));
+	}
+}
+
+/* fills out (row-major) with coherent noise in [0, 1) */
+bool Terrain_density( float *out, const uint32_t width, const uint32_t height, const uint64_t seed )
+{
+	float *rows = malloc((2 * width + width / 2 + 2) * sizeof(float));
+	float *row0, *row1, *swap;
+	float *lattice;
+	float weight = 1.0f;
+	float weight_sum = 0.0f;
+	uint32_t period = TERRAIN_BASE_PERIOD;
+	uint32_t iy, cur_iy;
+
+	if (rows == NULL)
+		return false;
+
+	row0 = rows;
+	row1 = &rows[width];
+	lattice = &rows[2 * width];
+
+	for (uint32_t octave = 0; octave < TERRAIN_OCTAVES; octave++)
+		weight_sum += 1.0f / (1 << octave);
+
+	memset(out, 0, (size_t) width * height * sizeof(float));
+
+	for (uint32_t octave = 0; octave < TERRAIN_OCTAVES; octave++)
+	{
+		/* periods below 2 would just be white noise */
+		if (period < 2)
+			period = 2;
+
+		lattice_row(row0, lattice, width, period, seed, octave, 0);
+		lattice_row(row1, lattice, width, period, seed, octave, 1);
+		cur_iy = 0;
+
+		for (uint32_t y = 0; y < height; y++)
+		{
+			/* next lattice row, reuse lower one */
+			iy = y / period;
+
+			if (iy != cur_iy)
+			{
+				swap = row0;
+				row0 = row1;
+				row1 = swap;
+				lattice_row(row1, lattice, width, period, seed, octave, iy + 1);
+				cur_iy = iy;
+			}
+
+			blend_rows(&out[(size_t) y * width], row0, row1,
+				smooth((float) (y % period) / period),
+				weight / weight_sum,
+				width);
+		}
+
+		period /= 2;
+		weight /= 2.0f;
+	}
+
+	free(rows);
+
+	return true;
+}
+
+/* density above which the given share of all values lies */
+float Terrain_cutoff( const float *density, const size_t count, const float share )
+{
+	size_t histogram[TERRAIN_HISTOGRAM_BINS] = {0};
+	size_t target = share * count;
+	size_t sum = 0;
+	int32_t bin;
+
+	if (target == 0)
+		return 1.0f;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		bin = density[i] * TERRAIN_HISTOGRAM_BINS;
+
+		if (bin >= TERRAIN_HISTOGRAM_BINS)
+			bin = TERRAIN_HISTOGRAM_BINS - 1;
+
+		histogram[bin]++;
+	}
+
+	for (bin = TERRAIN_HISTOGRAM_BINS - 1; bin > 0; bin--)
+	{
+		sum += histogram[bin];
+
+		if (sum >= target)
+			break;
+	}
+
+	return (float) bin / TERRAIN_HISTOGRAM_BINS;
+}
@@ -0,0 +1,36 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* value noise octaves, each has half the lattice period
+	and half the weight of the one before */
+#define TERRAIN_OCTAVES			4
+#define TERRAIN_BASE_PERIOD		8
+#define TERRAIN_HISTOGRAM_BINS	1024
+
+bool Terrain_density( float *out, const uint32_t width, const uint32_t height, const uint64_t seed );
+
+float Terrain_cutoff( const float *density, const size_t count, const float share );
+
+#endif /* TERRAIN_H */
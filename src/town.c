@@ -23,7 +23,13 @@
 #include <SM_string.h>
 #include "messages.h"
 #include "app.h"
+#include "admins.h"
 #include "path.h"
+#include "buffer.h"
+#include "backup.h"
+#include "catalog.h"
+#include "terrain.h"
+#include "checksum.h"
 #include "town.h"
 
 bool str_to_field( const char *str, Field *field )
@@ -42,284 +48,1784 @@ bool str_to_field( const char *str, Field *field )
 
 uint_fast32_t get_distance( const SDL_Point pt1, const SDL_Point pt2 )
 {
-	int_fast32_t val = (pt1.x - pt2.x) + (pt1.y - pt2.y);
-
-	if (val < 0)
-		val *= -1;
-
-	return val;
+	/* manhattan, fields have 4 neighbours */
+	return abs(pt1.x - pt2.x) + abs(pt1.y - pt2.y);
 }
 
-Town Town_new( void )
+Town Town_new( const uint32_t width, const uint32_t height )
 {
 	Town result = {
 		.invalid = false,
 		.admin_id = 0,
+		.width = width,
+		.height = height,
 		.construction_count = 0,
+		.construction_size = 0,
+		.constructions = NULL,
+		.construction_index = CoordMap_new(),
 		.merc_count = 0,
+		.merc_index = CoordMap_new(),
+		.map_version = 0,
+		.grid_hash_valid = true,	/* empty and exposed fields hash to 0 */
+		.grid_hash = 0,
 		.money = TOWN_START_MONEY,
 		.round = TOWN_START_TIME,
+		.generation = 0,
+		.backup_generations = TOWN_BACKUP_GENERATIONS,
+		.seed = 0,
 	};
 
+	result.rng = Rng_new(result.seed);
+
+	if (width < TOWN_MIN_SIZE || width > TOWN_MAX_SIZE ||
+		height < TOWN_MIN_SIZE || height > TOWN_MAX_SIZE)
+	{
+		result.invalid = true;
+		result.width = 0;
+		result.height = 0;
+	}
+
+	result.chunks = ChunkStore_new(result.width, result.height, FIELD_LAST);
+	result.invalid |= result.chunks.invalid;
+
+	/* chunks start out empty */
+	memset(result.field_counts, 0, sizeof(result.field_counts));
+	result.field_counts[FIELD_EMPTY] = result.width * result.height;
+
 	return result;
 }
 
-void Town_print( const Town *town, const char *town_name )
+Town Town_copy( const Town *town )
 {
-	/* name */
-	printf("%s\n\n", town_name);
+	Town result = *town;
 
-	/* exposure */
-	for (uint32_t y = 0; y < TOWN_HEIGHT; y++)
+	/* own chunks and constructions, everything else is plain data,
+		invalid only tells whether the copy failed */
+	result.chunks = ChunkStore_copy(&town->chunks);
+	result.invalid = result.chunks.invalid;
+	result.construction_size = 0;
+	result.constructions = NULL;
+	result.construction_index = CoordMap_new();
+	result.merc_index = CoordMap_copy(&town->merc_index);
+	result.invalid |= result.merc_index.invalid;
+
+	if (result.invalid)
 	{
-		for (uint32_t x = 0; x < TOWN_WIDTH; x++)
+		result.construction_count = 0;
+		return result;
+	}
+
+	if (town->construction_count > 0)
+	{
+		result.constructions = malloc(town->construction_count * sizeof(Construction));
+		result.construction_index = CoordMap_copy(&town->construction_index);
+
+		if (result.constructions == NULL || result.construction_index.invalid)
 		{
-			printf("%i ", town->hidden[x][y]);
+			result.invalid = true;
+			result.construction_count = 0;
+			return result;
 		}
 
-		printf("\n");
+		memcpy(result.constructions, town->constructions,
+			town->construction_count * sizeof(Construction));
+		result.construction_size = town->construction_count;
 	}
 
-	printf("\n");
+	return result;
+}
 
-	/* content */
-	for (uint32_t y = 0; y < TOWN_HEIGHT; y++)
+bool Town_coords_valid( const Town *town, const int32_t x, const int32_t y )
+{
+	return (x >= 0) && (y >= 0) &&
+		((uint32_t) x < town->width) && ((uint32_t) y < town->height);
+}
+
+/* index of coords within their chunk */
+static uint32_t chunk_cell( const SDL_Point coords )
+{
+	return ((coords.y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) | (coords.x & (CHUNK_SIZE - 1));
+}
+
+/* empty and exposed fields are 0, so a new grid needs no scan */
+static uint64_t Town_field_hash( const SDL_Point coords, const Field field, const bool hidden )
+{
+	if (field == FIELD_EMPTY && hidden == false)
+		return 0;
+
+	return Rng_derive_seed(((uint64_t) coords.y << 16) | coords.x, (field << 1) | hidden);
+}
+
+Field Town_get_field( Town *town, const SDL_Point coords )
+{
+	return ChunkStore_fetch(&town->chunks, coords.x, coords.y)->field[chunk_cell(coords)];
+}
+
+void Town_set_field( Town *town, const SDL_Point coords, const Field field )
+{
+	Chunk *chunk = ChunkStore_fetch(&town->chunks, coords.x, coords.y);
+	const uint32_t cell = chunk_cell(coords);
+
+	town->field_counts[chunk->field[cell]]--;
+	town->field_counts[field]++;
+
+	if (town->grid_hash_valid)
 	{
-		for (uint32_t x = 0; x < TOWN_WIDTH; x++)
-		{
-			printf("%i ", town->field[x][y]);
-		}
+		town->grid_hash ^= Town_field_hash(coords, chunk->field[cell], chunk->hidden[cell]);
+		town->grid_hash ^= Town_field_hash(coords, field, chunk->hidden[cell]);
+	}
 
-		printf("\n");
+	chunk->field[cell] = field;
+	chunk->dirty = true;
+	town->map_version++;
+}
+
+bool Town_get_hidden( Town *town, const SDL_Point coords )
+{
+	return ChunkStore_fetch(&town->chunks, coords.x, coords.y)->hidden[chunk_cell(coords)];
+}
+
+void Town_set_hidden( Town *town, const SDL_Point coords, const bool hidden )
+{
+	Chunk *chunk = ChunkStore_fetch(&town->chunks, coords.x, coords.y);
+	const uint32_t cell = chunk_cell(coords);
+
+	if (town->grid_hash_valid)
+	{
+		town->grid_hash ^= Town_field_hash(coords, chunk->field[cell], chunk->hidden[cell]);
+		town->grid_hash ^= Town_field_hash(coords, chunk->field[cell], hidden);
 	}
+
+	chunk->hidden[cell] = hidden;
+	chunk->dirty = true;
 }
 
-void Town_save( Town *town, const char *town_name )
+SDL_Point Town_get_hq_spawn( const Town *town )
 {
-	SM_String filepath_save = SM_String_new(16);
-	SM_String filepath_bkp = SM_String_new(16);
-	FILE *f;
-	uint32_t town_width = TOWN_WIDTH;
-	uint32_t town_height = TOWN_HEIGHT;
+	SDL_Point result = {
+		.x = town->width / 2,
+		.y = town->height / 2,
+	};
 
-	/* get path */
-	if (get_town_path(&filepath_save) != 0)
+	return result;
+}
+
+uint32_t Town_running_cost( const Town *town )
+{
+	uint32_t result = 0;
+
+	for (uint32_t i = 0; i <= FIELD_LAST; i++)
+		result += town->field_counts[i] * DATA_FIELDS[i].running_cost;
+
+	return result;
+}
+
+uint64_t Town_state_hash( Town *town )
+{
+	SDL_Point coords;
+	uint64_t result;
+	uint64_t sites = 0;
+
+	if (town->grid_hash_valid == false)
 	{
-		town->invalid = true;
-		return;
+		town->grid_hash = 0;
+
+		for (coords.y = 0; (uint32_t) coords.y < town->height; coords.y++)
+		{
+			for (coords.x = 0; (uint32_t) coords.x < town->width; coords.x++)
+			{
+				town->grid_hash ^= Town_field_hash(coords,
+					Town_get_field(town, coords),
+					Town_get_hidden(town, coords));
+			}
+		}
+
+		town->grid_hash_valid = true;
+	}
+
+	/* chain scalars through the mixer, order matters for them */
+	result = Rng_derive_seed(town->grid_hash, ((uint64_t) town->width << 16) | town->height);
+	result = Rng_derive_seed(result, ((uint64_t) town->round << 32) | town->money);
+	result = Rng_derive_seed(result, town->admin_id);
+	result = Rng_derive_seed(result, town->seed);
+	result = Rng_derive_seed(result, ((uint64_t) town->rng.s[0] << 32) | town->rng.s[1]);
+	result = Rng_derive_seed(result, ((uint64_t) town->rng.s[2] << 32) | town->rng.s[3]);
+
+	for (uint32_t i = 0; i < town->merc_count; i++)
+	{
+		result = Rng_derive_seed(result,
+			((uint64_t) town->mercs[i].id << 56) |
+			((uint64_t) town->mercs[i].fraction << 48) |
+			((uint64_t) town->mercs[i].coords.y << 32) |
+			((uint64_t) town->mercs[i].coords.x << 16) |
+			((uint64_t) town->mercs[i].moved << 1) |
+			town->mercs[i].attacked);
+		result = Rng_derive_seed(result, town->mercs[i].hp);
+	}
+
+	/* heap layout depends on history, the set of sites does not */
+	for (uint32_t i = 0; i < town->construction_count; i++)
+	{
+		sites += Rng_derive_seed(
+			((uint64_t) town->constructions[i].coords.y << 16) | town->constructions[i].coords.x,
+			((uint64_t) town->constructions[i].start_round << 8) | town->constructions[i].field);
 	}
 
-	/* glue file part to path */
-	SM_String_append_cstr(&filepath_save, town_name);
-	SM_String_append_cstr(&filepath_save, ".");
+	return Rng_derive_seed(result, sites);
+}
 
-	SM_String_copy(&filepath_bkp, &filepath_save);
-	SM_String_append_cstr(&filepath_save, FILETYPE_TOWN);
-	SM_String_append_cstr(&filepath_bkp, FILETYPE_BACKUP);
+static void Town_count_fields( Town *town, uint32_t counts[FIELD_LAST + 1] )
+{
+	SDL_Point coords;
 
-	/* if save already exists, move to backup */
-	f = fopen(filepath_save.str, "r");
+	memset(counts, 0, (FIELD_LAST + 1) * sizeof(uint32_t));
 
-	if (f != NULL)
+	for (coords.y = 0; (uint32_t) coords.y < town->height; coords.y++)
 	{
-		if (rename(filepath_save.str, filepath_bkp.str) != 0)
+		for (coords.x = 0; (uint32_t) coords.x < town->width; coords.x++)
 		{
-			printf(MSG_WARN_FILE_TOWN_BACKUP);
+			counts[Town_get_field(town, coords)]++;
 		}
+	}
+}
+
+#ifdef _DEBUG
+bool Town_verify_field_counts( Town *town )
+{
+	uint32_t counts[FIELD_LAST + 1];
+
+	Town_count_fields(town, counts);
+
+	return memcmp(counts, town->field_counts, sizeof(counts)) == 0;
+}
+
+bool Town_verify_merc_index( Town *town )
+{
+	uint32_t living = 0;
+
+	/* every living merc stands on a marker and is indexed there */
+	for (uint32_t i = 0; i < town->merc_count; i++)
+	{
+		if (town->mercs[i].hp == 0)
+			continue;
 
-		fclose(f);
+		living++;
+
+		if (Town_merc_at(town, town->mercs[i].coords) != i ||
+			Town_get_field(town, town->mercs[i].coords) != FIELD_MERC)
+			return false;
 	}
 
-	/* open file */
-	f = fopen(filepath_save.str, "w");
+	/* and there are no markers without a merc */
+	return town->merc_index.count == living &&
+		town->field_counts[FIELD_MERC] == living;
+}
+#endif
+
+/* same seed and size, same town */
+void Town_generate( Town *town, const uint64_t seed )
+{
+	const uint32_t w = town->width;
+	const uint32_t h = town->height;
+	const SDL_Point hq = Town_get_hq_spawn(town);
+	SDL_Point coords;
+	float *density;
+	float cutoff;
+
+	town->seed = seed;
+	town->rng = Rng_new(seed);
 
-	if (f == NULL)
+	/* forests grow where noise is dense, share of trees stays fixed */
+	density = malloc((size_t) w * h * sizeof(float));
+
+	if (density == NULL || Terrain_density(density, w, h, seed) == false)
 	{
+		free(density);
 		town->invalid = true;
-		printf(MSG_ERR_FILE_SAVE);
 		return;
 	}
 
-	/* write header */
-	const uint32_t app_major = APP_MAJOR;
-	const uint32_t app_minor = APP_MINOR;
-	const uint32_t app_patch = APP_PATCH;
+	cutoff = Terrain_cutoff(density, (size_t) w * h,
+		(100 - TOWN_GEN_TREE_THRESHOLD) / 100.0f);
+
+	/* hide fields, generate trees */
+	for (coords.y = 0; (uint32_t) coords.y < h; coords.y++)
+	{
+		for (coords.x = 0; (uint32_t) coords.x < w; coords.x++)
+		{
+			/* tree if dense enough */
+			if (density[coords.y * w + coords.x] >= cutoff)
+			{
+				/* chance for species */
+				Town_set_field(town, coords,
+					FIELD_TREE_0 + Rng_range(&town->rng, FIELD_TREE_COUNT));
+			}
+			else
+			{
+				Town_set_field(town, coords, FIELD_EMPTY);
+			}
+
+			/* hide field */
+			Town_set_hidden(town, coords, true);
+		}
+	}
+
+	free(density);
+
+	/* expose starting area */
+	for (coords.y = hq.y - TOWN_EXPOSURE_RADIUS; coords.y <= hq.y + (int32_t) TOWN_EXPOSURE_RADIUS; coords.y++)
+	{
+		for (coords.x = hq.x - TOWN_EXPOSURE_RADIUS; coords.x <= hq.x + (int32_t) TOWN_EXPOSURE_RADIUS; coords.x++)
+		{
+			Town_set_hidden(town, coords, false);
+		}
+	}
+
+	/* clear tree-free zone from trees */
+	for (coords.y = hq.y - TOWN_TREEFREE_RADIUS; coords.y <= hq.y + (int32_t) TOWN_TREEFREE_RADIUS; coords.y++)
+	{
+		for (coords.x = hq.x - TOWN_TREEFREE_RADIUS; coords.x <= hq.x + (int32_t) TOWN_TREEFREE_RADIUS; coords.x++)
+		{
+			Town_set_field(town, coords, FIELD_EMPTY);
+		}
+	}
+
+	/* set headquarter */
+	Town_set_field(town, hq, FIELD_ADMINISTRATION);
+}
+
+void Town_print( Town *town, const char *town_name )
+{
+	SDL_Point coords;
 
-	fwrite(&app_major, sizeof(app_major), 1, f);
-	fwrite(&app_minor, sizeof(app_minor), 1, f);
-	fwrite(&app_patch, sizeof(app_patch), 1, f);
-	fwrite(&town->admin_id, sizeof(town->admin_id), 1, f);
-	fwrite(&town->round, sizeof(town->round), 1, f);
-	fwrite(&town->money, sizeof(town->money), 1, f);
-	fwrite(&town_width, sizeof(uint32_t), 1, f);
-	fwrite(&town_height, sizeof(uint32_t), 1, f);
-	fputc('\n', f);
+	/* name */
+	printf("%s\n\n", town_name);
 
-	/* write exposure data */
-	for (uint32_t x = 0; x < TOWN_WIDTH; x++)
+	/* exposure */
+	for (coords.y = 0; (uint32_t) coords.y < town->height; coords.y++)
 	{
-		fwrite(town->hidden[x], sizeof(town->hidden[x][0]), TOWN_HEIGHT, f);
+		for (coords.x = 0; (uint32_t) coords.x < town->width; coords.x++)
+		{
+			printf("%i ", Town_get_hidden(town, coords));
+		}
+
+		printf("\n");
 	}
 
-	/* write content data */
-	for (uint32_t x = 0; x < TOWN_WIDTH; x++)
+	printf("\n");
+
+	/* content */
+	for (coords.y = 0; (uint32_t) coords.y < town->height; coords.y++)
 	{
-		fwrite(town->field[x], sizeof(town->field[x][0]), TOWN_HEIGHT, f);
+		for (coords.x = 0; (uint32_t) coords.x < town->width; coords.x++)
+		{
+			printf("%i ", Town_get_field(town, coords));
+		}
+
+		printf("\n");
 	}
+}
+
+static void Town_write_meta( const Town *town, Buffer *buf )
+{
+	Buffer_write_u8(buf, town->admin_id);
+	Buffer_write_u32(buf, town->round);
+	Buffer_write_u32(buf, town->money);
+	Buffer_write_u16(buf, town->width);
+	Buffer_write_u16(buf, town->height);
+	Buffer_write_u8(buf, town->merc_count);
+	Buffer_write_u32(buf, town->generation);
+	Buffer_write_u8(buf, town->backup_generations);
+	Buffer_write_u64(buf, town->seed);
+
+	for (uint32_t i = 0; i < 4; i++)
+		Buffer_write_u32(buf, town->rng.s[i]);
+}
+
+static void Town_write_chunk_dir( const Town *town, Buffer *buf )
+{
+	ChunkStore_write_dir(&town->chunks, buf);
+}
+
+static void Town_write_field_counts( const Town *town, Buffer *buf )
+{
+	Buffer_write_u8(buf, FIELD_LAST + 1);
 
-	fputc('\n', f);
+	for (uint32_t i = 0; i <= FIELD_LAST; i++)
+		Buffer_write_u32(buf, town->field_counts[i]);
+}
 
-	/* write construction list data */
-	fwrite(&town->construction_count, sizeof(town->construction_count), 1, f);
-	fputc('\n', f);
+static void Town_write_constructions( const Town *town, Buffer *buf )
+{
+	Buffer_write_u16(buf, town->construction_count);
 
-	/* write construction list */
 	for (uint32_t i = 0; i < town->construction_count; i++)
 	{
-		fwrite(&town->constructions[i].field, sizeof(town->constructions[i].field), 1, f);
-		fwrite(&town->constructions[i].coords.x, sizeof(town->constructions[i].coords.x), 1, f);
-		fwrite(&town->constructions[i].coords.y, sizeof(town->constructions[i].coords.y), 1, f);
-		fwrite(&town->constructions[i].progress, sizeof(town->constructions[i].progress), 1, f);
+		Buffer_write_u8(buf, town->constructions[i].field);
+		Buffer_write_u16(buf, town->constructions[i].coords.x);
+		Buffer_write_u16(buf, town->constructions[i].coords.y);
+		Buffer_write_u32(buf, town->constructions[i].start_round);
 	}
+}
 
-	// write merc list data
-	fwrite(&town->merc_count, sizeof(town->merc_count), 1, f);
-	fputc('\n', f);
+static void Town_write_mercs( const Town *town, Buffer *buf )
+{
+	Buffer_write_u8(buf, town->merc_count);
 
-	// write merc list
 	for (uint32_t i = 0; i < town->merc_count; i++)
 	{
-		fwrite(&town->mercs[i].id, sizeof(town->mercs[i].id), 1, f);
-		fwrite(&town->mercs[i].coords.x, sizeof(town->mercs[i].coords.x), 1, f);
-		fwrite(&town->mercs[i].coords.y, sizeof(town->mercs[i].coords.y), 1, f);
-		fwrite(&town->mercs[i].hp, sizeof(town->mercs[i].hp), 1, f);
-		fwrite(&town->mercs[i].fraction, sizeof(town->mercs[i].fraction), 1, f);
-		fwrite(&town->mercs[i].moved, sizeof(town->mercs[i].moved), 1, f);
-		fwrite(&town->mercs[i].attacked, sizeof(town->mercs[i].attacked), 1, f);
+		Buffer_write_u8(buf, town->mercs[i].id);
+		Buffer_write_u16(buf, town->mercs[i].coords.x);
+		Buffer_write_u16(buf, town->mercs[i].coords.y);
+		Buffer_write_u32(buf, town->mercs[i].hp);
+		Buffer_write_u8(buf, town->mercs[i].fraction);
+		Buffer_write_u8(buf, town->mercs[i].moved);
+		Buffer_write_u8(buf, town->mercs[i].attacked);
 	}
+}
 
-	/* check and done */
-	if (ferror(f))
+/* cuts receives the offsets of the header and every section */
+static void Town_serialize( const Town *town, Buffer *buf, size_t cuts[TOWN_SECTION_COUNT + 1] )
+{
+	static const struct {
+		TownSection id;
+		void (*write)( const Town*, Buffer* );
+	} SECTIONS[TOWN_SECTION_COUNT] = {
+		{TS_META,			Town_write_meta},
+		{TS_CHUNK_DIR,		Town_write_chunk_dir},
+		{TS_FIELD_COUNTS,	Town_write_field_counts},
+		{TS_CONSTRUCTION_QUEUE,	Town_write_constructions},
+		{TS_MERCS,			Town_write_mercs},
+	};
+	size_t table_pos;
+	size_t section_begin;
+	uint32_t header_crc;
+
+	/* fixed header */
+	Buffer_write(buf, TOWN_FILE_MAGIC, sizeof(TOWN_FILE_MAGIC));
+	Buffer_write_u16(buf, TOWN_FILE_VERSION);
+	Buffer_write_u16(buf, APP_MAJOR);
+	Buffer_write_u16(buf, APP_MINOR);
+	Buffer_write_u16(buf, APP_PATCH);
+	Buffer_write_u16(buf, TOWN_SECTION_COUNT);
+	Buffer_write_u16(buf, 0);
+	Buffer_write_u32(buf, 0);	/* header checksum, patched below */
+
+	/* reserve section table */
+	table_pos = buf->len;
+
+	for (uint32_t i = 0; i < TOWN_SECTION_COUNT * TOWN_FILE_SECTION_ENTRY_SIZE; i++)
+		Buffer_write_u8(buf, 0);
+
+	cuts[0] = 0;
+
+	/* sections, each with its own entry and checksum */
+	for (uint32_t i = 0; i < TOWN_SECTION_COUNT; i++)
 	{
-		town->invalid = true;
-		printf(MSG_ERR_FILE_TOWN_SAVE);
+		section_begin = buf->len;
+		cuts[i + 1] = section_begin;
+		SECTIONS[i].write(town, buf);
+
+		if (buf->invalid)
+			return;
+
+		Buffer_patch_u16(buf, table_pos + (i * TOWN_FILE_SECTION_ENTRY_SIZE), SECTIONS[i].id);
+		Buffer_patch_u32(buf, table_pos + (i * TOWN_FILE_SECTION_ENTRY_SIZE) + 4, section_begin);
+		Buffer_patch_u32(buf, table_pos + (i * TOWN_FILE_SECTION_ENTRY_SIZE) + 8,
+			buf->len - section_begin);
+		Buffer_patch_u32(buf, table_pos + (i * TOWN_FILE_SECTION_ENTRY_SIZE) + 12,
+			crc32c(&buf->data[section_begin], buf->len - section_begin));
 	}
 
-	fclose(f);
-	SM_String_clear(&filepath_save);
-	SM_String_clear(&filepath_bkp);
+	/* header checksum covers fixed header (without itself) and section table */
+	header_crc = crc32c(buf->data, TOWN_FILE_HEADER_SIZE - sizeof(uint32_t));
+	header_crc = crc32c_update(header_crc, &buf->data[table_pos],
+		TOWN_SECTION_COUNT * TOWN_FILE_SECTION_ENTRY_SIZE);
+	Buffer_patch_u32(buf, TOWN_FILE_HEADER_SIZE - sizeof(uint32_t), header_crc);
 }
 
-void Town_load( Town *town, const char *town_name )
+static void Town_read_meta( TownHeader *header, Buffer *buf )
 {
-	FILE *f;
-	SM_String filepath = SM_String_new(16);
-	uint32_t town_width, town_height;
-	uint32_t file_major, file_minor, file_patch;
+	header->admin_id = Buffer_read_u8(buf);
+	header->round = Buffer_read_u32(buf);
+	header->money = Buffer_read_u32(buf);
+	header->width = Buffer_read_u16(buf);
+	header->height = Buffer_read_u16(buf);
+	header->merc_count = Buffer_read_u8(buf);
 
-	/* get path */
-	if (get_town_path(&filepath) != 0)
+	/* fields appended later, missing in older files */
+	header->generation = (buf->len - buf->pos >= 4) ? Buffer_read_u32(buf) : 0;
+	header->backup_generations = (buf->len - buf->pos >= 1) ?
+		Buffer_read_u8(buf) : TOWN_BACKUP_GENERATIONS;
+	header->seed = (buf->len - buf->pos >= 8) ? Buffer_read_u64(buf) : 0;
+	header->rng = Rng_new(header->seed);
+
+	if (buf->len - buf->pos >= 16)
 	{
-		town->invalid = true;
+		for (uint32_t i = 0; i < 4; i++)
+			header->rng.s[i] = Buffer_read_u32(buf);
+	}
+
+	if (header->width < TOWN_MIN_SIZE || header->width > TOWN_MAX_SIZE ||
+		header->height < TOWN_MIN_SIZE || header->height > TOWN_MAX_SIZE ||
+		header->admin_id >= (sizeof(DATA_ADMINS) / sizeof(DATA_ADMINS[0])))
+	{
+		buf->invalid = true;
+	}
+}
+
+static void read_hidden( bool *cells, const uint32_t count, Buffer *buf )
+{
+	const uint8_t *grid = Buffer_view(buf, count);
+
+	if (grid == NULL)
 		return;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		cells[i] = (grid[i] != 0);
 	}
+}
 
-	/* glue file part to path */
-	SM_String_append_cstr(&filepath, town_name);
-	SM_String_append_cstr(&filepath, ".");
-	SM_String_append_cstr(&filepath, FILETYPE_TOWN);
+static void read_field( uint8_t *cells, const uint32_t count, Buffer *buf )
+{
+	const uint8_t *grid = Buffer_view(buf, count);
 
-	/* open */
-	f = fopen(filepath.str, "r");
+	if (grid == NULL)
+		return;
 
-	if (f == NULL)
+	for (uint32_t i = 0; i < count; i++)
 	{
-		town->invalid = true;
-		printf(MSG_ERR_FILE_LOAD);
+		if (grid[i] > FIELD_LAST)
+		{
+			buf->invalid = true;
+			return;
+		}
+
+		cells[i] = grid[i];
+	}
+}
+
+/* copies whole row-major grids into chunks */
+static void Town_import_grids( Town *town, const uint8_t *field, const bool *hidden )
+{
+	SDL_Point coords;
+
+	for (coords.y = 0; (uint32_t) coords.y < town->height; coords.y++)
+	{
+		for (coords.x = 0; (uint32_t) coords.x < town->width; coords.x++)
+		{
+			Town_set_field(town, coords, field[coords.y * town->width + coords.x]);
+			Town_set_hidden(town, coords, hidden[coords.y * town->width + coords.x]);
+		}
+	}
+}
+
+static void Town_read_field_counts( Town *town, Buffer *buf )
+{
+	const uint8_t kinds = Buffer_read_u8(buf);
+	uint64_t sum = 0;
+
+	if (kinds > FIELD_LAST + 1)
+	{
+		buf->invalid = true;
 		return;
 	}
 
-	/* read header */
-	fread(&file_major, sizeof(file_major), 1, f);
-	fread(&file_minor, sizeof(file_minor), 1, f);
-	fread(&file_patch, sizeof(file_patch), 1, f);
-	fread(&town->admin_id, sizeof(town->admin_id), 1, f);
-	fread(&town->round, sizeof(town->round), 1, f);
-	fread(&town->money, sizeof(town->money), 1, f);
-	fread(&town_width, sizeof(town_width), 1, f);
-	fread(&town_height, sizeof(town_height), 1, f);
-	fgetc(f);
+	memset(town->field_counts, 0, sizeof(town->field_counts));
 
-	/* check header info */
-	if ((town_width != TOWN_WIDTH) || (town_height != TOWN_HEIGHT))
+	for (uint32_t i = 0; i < kinds; i++)
 	{
-		town->invalid = true;
-		printf(MSG_ERR_FILE_TOWN_CORRUPT);
+		town->field_counts[i] = Buffer_read_u32(buf);
+		sum += town->field_counts[i];
+	}
+
+	if (sum != (uint64_t) town->width * town->height || buf->pos != buf->len)
+		buf->invalid = true;
+}
+
+/* older files kept a progress counter, counting up from start */
+static void Town_read_constructions( Town *town, Buffer *buf, const bool progress )
+{
+	Construction construction;
+	uint32_t count;
+	uint32_t x, y;
+	uint32_t value;
+
+	/* drop whatever was queued before */
+	town->construction_count = 0;
+	CoordMap_clear(&town->construction_index);
+
+	count = Buffer_read_u16(buf);
+
+	if (count > (town->width * town->height))
+	{
+		buf->invalid = true;
 		return;
 	}
 
-	/* read exposure data */
-	for (uint32_t x = 0; x < TOWN_WIDTH; x++)
+	for (uint32_t i = 0; i < count; i++)
+	{
+		construction.field = Buffer_read_u8(buf);
+		x = Buffer_read_u16(buf);
+		y = Buffer_read_u16(buf);
+		value = Buffer_read_u32(buf);
+
+		if (buf->invalid || construction.field > FIELD_LAST ||
+			Town_coords_valid(town, x, y) == false)
+		{
+			buf->invalid = true;
+			return;
+		}
+
+		construction.coords.x = x;
+		construction.coords.y = y;
+
+		if (progress)
+			construction.start_round = (value > town->round) ? 0 : town->round - value;
+		else
+			construction.start_round = value;
+
+		/* a heap written in order stays as it is */
+		if (Town_construction_queue_add(town, construction) == false)
+		{
+			buf->invalid = true;
+			return;
+		}
+	}
+}
+
+static void Town_read_mercs( Town *town, Buffer *buf )
+{
+	uint32_t x, y;
+
+	CoordMap_clear(&town->merc_index);
+	town->merc_count = Buffer_read_u8(buf);
+
+	if (town->merc_count > MERCENARY_COUNT)
 	{
-		fread(town->hidden[x], sizeof(town->hidden[x][0]), TOWN_HEIGHT, f);
+		buf->invalid = true;
+		return;
 	}
 
-	/* read content data */
-	for (uint32_t x = 0; x < TOWN_WIDTH; x++)
+	for (uint32_t i = 0; i < town->merc_count; i++)
 	{
-		fread(town->field[x], sizeof(town->field[x][0]), TOWN_HEIGHT, f);
+		town->mercs[i].id = Buffer_read_u8(buf);
+		x = Buffer_read_u16(buf);
+		y = Buffer_read_u16(buf);
+		town->mercs[i].hp = Buffer_read_u32(buf);
+		town->mercs[i].fraction = Buffer_read_u8(buf);
+		town->mercs[i].moved = Buffer_read_u8(buf);
+		town->mercs[i].attacked = (Buffer_read_u8(buf) != 0);
+
+		if (town->mercs[i].id >= MERCENARY_COUNT ||
+			town->mercs[i].fraction > MF_PURPLE ||
+			Town_coords_valid(town, x, y) == false)
+		{
+			buf->invalid = true;
+			return;
+		}
+
+		town->mercs[i].coords.x = x;
+		town->mercs[i].coords.y = y;
+
+		if (town->mercs[i].hp == 0)
+			continue;
+
+		/* two living mercs can not share a field */
+		if (Town_merc_at(town, town->mercs[i].coords) != COORDMAP_NONE ||
+			CoordMap_set(&town->merc_index, town->mercs[i].coords, i) == false)
+		{
+			buf->invalid = true;
+			return;
+		}
 	}
-	fgetc(f);
+}
 
-	/* read construction list data */
-	fread(&town->construction_count, sizeof(town->construction_count), 1, f);
-	fgetc(f);
+/* checks fixed header and section table of a version 2 file,
+	returns pointer to the table or NULL, reads the file version into version.
+	Files without magic are taken for version 0. */
+static const uint8_t* Town_read_file_header( Buffer *buf, uint16_t *version, uint16_t *section_count )
+{
+	const uint8_t *magic;
+	const uint8_t *table;
+	uint32_t header_crc;
+	uint32_t crc;
 
-	/* read construction list */
-	for (uint32_t i = 0; i < town->construction_count; i++)
+	magic = Buffer_view(buf, sizeof(TOWN_FILE_MAGIC));
+
+	if (magic == NULL)
+		return NULL;
+
+	/* the original Town_save started with the app version */
+	if (memcmp(magic, TOWN_FILE_MAGIC, sizeof(TOWN_FILE_MAGIC)) != 0)
 	{
-		fread(&town->constructions[i].field, sizeof(town->constructions[i].field), 1, f);
-		fread(&town->constructions[i].coords.x, sizeof(town->constructions[i].coords.x), 1, f);
-		fread(&town->constructions[i].coords.y, sizeof(town->constructions[i].coords.y), 1, f);
-		fread(&town->constructions[i].progress, sizeof(town->constructions[i].progress), 1, f);
+		*version = 0;
+		return NULL;
 	}
 
-	// read merc list data
-	fread(&town->merc_count, sizeof(town->merc_count), 1, f);
-	fgetc(f);
+	*version = Buffer_read_u16(buf);
 
-	// read merc list
-	for (uint32_t i = 0; i < town->merc_count; i++)
+	/* older files have no section table */
+	if (*version < TOWN_FILE_VERSION)
+		return NULL;
+
+	if (*version > TOWN_FILE_VERSION)
 	{
-		fread(&town->mercs[i].id, sizeof(town->mercs[i].id), 1, f);
-		fread(&town->mercs[i].coords.x, sizeof(town->mercs[i].coords.x), 1, f);
-		fread(&town->mercs[i].coords.y, sizeof(town->mercs[i].coords.y), 1, f);
-		fread(&town->mercs[i].hp, sizeof(town->mercs[i].hp), 1, f);
-		fread(&town->mercs[i].fraction, sizeof(town->mercs[i].fraction), 1, f);
-		fread(&town->mercs[i].moved, sizeof(town->mercs[i].moved), 1, f);
-		fread(&town->mercs[i].attacked, sizeof(town->mercs[i].attacked), 1, f);
+		buf->invalid = true;
+		return NULL;
 	}
 
-	/* check and done */
-	if (ferror(f))
+	/* app version of writer, informational only */
+	Buffer_read_u16(buf);
+	Buffer_read_u16(buf);
+	Buffer_read_u16(buf);
+
+	*section_count = Buffer_read_u16(buf);
+	Buffer_read_u16(buf);
+	header_crc = Buffer_read_u32(buf);
+
+	if (*section_count > TOWN_FILE_MAX_SECTIONS)
 	{
-		town->invalid = true;
-		printf(MSG_ERR_FILE_TOWN_LOAD);
-		fclose(f);
+		buf->invalid = true;
+		return NULL;
 	}
 
-	fclose(f);
-	SM_String_clear(&filepath);
-}
+	table = Buffer_view(buf, *section_count * TOWN_FILE_SECTION_ENTRY_SIZE);
 
-void Town_construction_list_remove( Town *town, const uint32_t index )
-{
-	/* beginning at index, for each entry overwrite with next entry */
-	for (uint32_t i = index; i < town->construction_count; i++)
+	if (table == NULL)
+		return NULL;
+
+	crc = crc32c(buf->data, TOWN_FILE_HEADER_SIZE - sizeof(uint32_t));
+	crc = crc32c_update(crc, table, *section_count * TOWN_FILE_SECTION_ENTRY_SIZE);
+
+	if (crc != header_crc)
 	{
-		town->constructions[i] = town->constructions[i + 1];
+		buf->invalid = true;
+		return NULL;
 	}
 
-	/* decrement count */
-	town->construction_count--;
+	return table;
+}
+
+static bool Town_has_section(
+	const uint8_t *table,
+	const uint16_t section_count,
+	const TownSection id )
+{
+	for (uint32_t i = 0; i < section_count; i++)
+	{
+		if (Buffer_get_u16(&table[i * TOWN_FILE_SECTION_ENTRY_SIZE]) == id)
+			return true;
+	}
+
+	return false;
+}
+
+/* finds section in table, verifies its checksum and returns a view on it */
+static Buffer Town_find_section(
+	Buffer *buf,
+	const uint8_t *table,
+	const uint16_t section_count,
+	const TownSection id )
+{
+	Buffer result = Buffer_new(0);
+	const uint8_t *entry;
+	uint32_t offset, len;
+
+	result.invalid = true;
+
+	for (uint32_t i = 0; i < section_count; i++)
+	{
+		entry = &table[i * TOWN_FILE_SECTION_ENTRY_SIZE];
+
+		if (Buffer_get_u16(&entry[0]) != id)
+			continue;
+
+		offset = Buffer_get_u32(&entry[4]);
+		len = Buffer_get_u32(&entry[8]);
+		result = Buffer_slice(buf, offset, len);
+
+		if (result.invalid == false &&
+			crc32c(result.data, result.len) != Buffer_get_u32(&entry[12]))
+		{
+			result.invalid = true;
+		}
+
+		break;
+	}
+
+	return result;
+}
+
+/* grids of files written before chunks, as raw bytes or packed */
+static void Town_read_legacy_grids(
+	Town *town,
+	Buffer *buf,
+	const uint8_t *table,
+	const uint16_t section_count )
+{
+	const uint32_t cells = town->width * town->height;
+	uint8_t *field = malloc(cells);
+	bool *hidden = malloc(cells * sizeof(bool));
+	Buffer section;
+
+	if (field == NULL || hidden == NULL)
+	{
+		buf->invalid = true;
+		goto read_legacy_grids_clear;
+	}
+
+	if (Town_has_section(table, section_count, TS_HIDDEN_BITS))
+	{
+		section = Town_find_section(buf, table, section_count, TS_HIDDEN_BITS);
+		unpack_bits(hidden, cells, &section);
+	}
+	else
+	{
+		section = Town_find_section(buf, table, section_count, TS_HIDDEN);
+		read_hidden(hidden, cells, &section);
+	}
+	buf->invalid |= section.invalid;
+
+	if (Town_has_section(table, section_count, TS_FIELD_PACKED))
+	{
+		section = Town_find_section(buf, table, section_count, TS_FIELD_PACKED);
+		unpack_fields(field, cells, FIELD_LAST, &section);
+
+		/* nothing may follow */
+		if (section.pos != section.len)
+			section.invalid = true;
+	}
+	else
+	{
+		section = Town_find_section(buf, table, section_count, TS_FIELD);
+		read_field(field, cells, &section);
+	}
+	buf->invalid |= section.invalid;
+
+	if (buf->invalid == false)
+		Town_import_grids(town, field, hidden);
+
+	read_legacy_grids_clear:
+
+	free(field);
+	free(hidden);
+}
+
+/* migration path for flat version 1 files, which carry a checksum
+	of the whole file as trailer, sets buf->invalid on any inconsistency */
+static void Town_deserialize_v1( Town *town, Buffer *buf )
+{
+	const uint32_t cells = town->width * town->height;
+	uint8_t *field;
+	bool *hidden;
+
+	/* verify trailing checksum, the fixed header must be there too */
+	if (buf->len < TOWN_FILE_V1_HEADER_SIZE + sizeof(uint32_t))
+	{
+		buf->invalid = true;
+		return;
+	}
+
+	buf->len -= sizeof(uint32_t);
+
+	if (Buffer_get_u32(&buf->data[buf->len]) != crc32c(buf->data, buf->len))
+	{
+		buf->invalid = true;
+		return;
+	}
+
+	/* skip magic, file version and app version */
+	buf->pos = TOWN_FILE_V1_HEADER_SIZE;
+
+	town->admin_id = Buffer_read_u8(buf);
+	town->round = Buffer_read_u32(buf);
+	town->money = Buffer_read_u32(buf);
+
+	/* version 1 only knew the default size */
+	if (Buffer_read_u16(buf) != TOWN_DEFAULT_WIDTH ||
+		Buffer_read_u16(buf) != TOWN_DEFAULT_HEIGHT ||
+		town->admin_id >= (sizeof(DATA_ADMINS) / sizeof(DATA_ADMINS[0])))
+	{
+		buf->invalid = true;
+		return;
+	}
+
+	/* rest of the layout equals the sections of version 2 */
+	field = malloc(cells);
+	hidden = malloc(cells * sizeof(bool));
+
+	if (field == NULL || hidden == NULL)
+		buf->invalid = true;
+
+	if (buf->invalid == false)
+	{
+		read_hidden(hidden, cells, buf);
+		read_field(field, cells, buf);
+	}
+
+	if (buf->invalid == false)
+		Town_import_grids(town, field, hidden);
+
+	free(field);
+	free(hidden);
+
+	Town_read_constructions(town, buf, true);
+	Town_read_mercs(town, buf);
+
+	/* nothing may follow */
+	if (buf->pos != buf->len)
+		buf->invalid = true;
+}
+
+/* narrows a value of the version 0 layout, sets invalid if it does not fit */
+static uint32_t read_v0_value( Buffer *buf, const uint32_t max )
+{
+	const uint32_t value = Buffer_read_u32(buf);
+
+	if (value > max)
+		buf->invalid = true;
+
+	return value;
+}
+
+/* migration path for files of the original Town_save, a raw dump of
+	its structs as laid out on x86-64, grids indexed [x][y] with a four byte
+	Field each, '\n' between parts. Lists are handed on in the layout of
+	version 1, sets buf->invalid on any inconsistency. */
+static void Town_deserialize_v0( Town *town, Buffer *buf )
+{
+	const uint32_t cells = town->width * town->height;
+	uint8_t *field = malloc(cells);
+	bool *hidden = malloc(cells * sizeof(bool));
+	Buffer list = Buffer_new(TOWN_SAVE_BUFFER_SIZE);
+	uint32_t count;
+
+	if (field == NULL || hidden == NULL || list.invalid ||
+		buf->len < TOWN_FILE_V0_HEADER_SIZE)
+	{
+		buf->invalid = true;
+		goto deserialize_v0_clear;
+	}
+
+	/* skip app version */
+	buf->pos = 3 * sizeof(uint32_t);
+
+	town->admin_id = Buffer_read_u8(buf);
+	town->round = Buffer_read_u32(buf);
+	town->money = Buffer_read_u32(buf);
+
+	/* grids were of fixed size */
+	if (Buffer_read_u32(buf) != TOWN_DEFAULT_WIDTH ||
+		Buffer_read_u32(buf) != TOWN_DEFAULT_HEIGHT ||
+		Buffer_read_u8(buf) != '\n' ||
+		town->admin_id >= (sizeof(DATA_ADMINS) / sizeof(DATA_ADMINS[0])))
+	{
+		buf->invalid = true;
+		goto deserialize_v0_clear;
+	}
+
+	for (uint32_t x = 0; x < town->width; x++)
+	{
+		for (uint32_t y = 0; y < town->height; y++)
+			hidden[y * town->width + x] = (Buffer_read_u8(buf) != 0);
+	}
+
+	for (uint32_t x = 0; x < town->width; x++)
+	{
+		for (uint32_t y = 0; y < town->height; y++)
+			field[y * town->width + x] = read_v0_value(buf, FIELD_LAST);
+	}
+
+	if (Buffer_read_u8(buf) != '\n' || buf->invalid)
+	{
+		buf->invalid = true;
+		goto deserialize_v0_clear;
+	}
+
+	Town_import_grids(town, field, hidden);
+
+	/* constructions, progress counts up from their start */
+	count = read_v0_value(buf, cells);
+	Buffer_write_u16(&list, count);
+
+	if (Buffer_read_u8(buf) != '\n' || buf->invalid)
+	{
+		buf->invalid = true;
+		goto deserialize_v0_clear;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Buffer_write_u8(&list, read_v0_value(buf, FIELD_LAST));
+		Buffer_write_u16(&list, read_v0_value(buf, TOWN_DEFAULT_WIDTH - 1));
+		Buffer_write_u16(&list, read_v0_value(buf, TOWN_DEFAULT_HEIGHT - 1));
+		Buffer_write_u32(&list, Buffer_read_u32(buf));
+	}
+
+	/* mercs */
+	count = read_v0_value(buf, MERCENARY_COUNT);
+	Buffer_write_u8(&list, count);
+
+	if (Buffer_read_u8(buf) != '\n' || buf->invalid)
+	{
+		buf->invalid = true;
+		goto deserialize_v0_clear;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Buffer_write_u8(&list, read_v0_value(buf, MERCENARY_COUNT - 1));
+		Buffer_write_u16(&list, read_v0_value(buf, TOWN_DEFAULT_WIDTH - 1));
+		Buffer_write_u16(&list, read_v0_value(buf, TOWN_DEFAULT_HEIGHT - 1));
+		Buffer_write_u32(&list, Buffer_read_u32(buf));
+		Buffer_write_u8(&list, read_v0_value(buf, MF_PURPLE));
+
+		/* moved was an eight byte uint_fast32_t */
+		Buffer_write_u8(&list, read_v0_value(buf, UINT8_MAX));
+		read_v0_value(buf, 0);
+		Buffer_write_u8(&list, Buffer_read_u8(buf) != 0);
+	}
+
+	/* nothing may follow */
+	if (buf->pos != buf->len || list.invalid)
+		buf->invalid = true;
+
+	if (buf->invalid)
+		goto deserialize_v0_clear;
+
+	Town_read_constructions(town, &list, true);
+	Town_read_mercs(town, &list);
+	buf->invalid |= list.invalid;
+
+	deserialize_v0_clear:
+
+	free(field);
+	free(hidden);
+	Buffer_clear(&list);
+}
+
+/* flat files of versions before the section table */
+static void Town_deserialize_flat( Town *town, Buffer *buf, const uint16_t version )
+{
+	if (version == 0)
+		Town_deserialize_v0(town, buf);
+	else
+		Town_deserialize_v1(town, buf);
+}
+
+static TownHeader Town_get_header( const Town *town )
+{
+	TownHeader result = {
+		.invalid = town->invalid,
+		.admin_id = town->admin_id,
+		.round = town->round,
+		.money = town->money,
+		.width = town->width,
+		.height = town->height,
+		.merc_count = town->merc_count,
+		.generation = town->generation,
+		.backup_generations = town->backup_generations,
+		.seed = town->seed,
+		.rng = town->rng,
+	};
+
+	return result;
+}
+
+/* serializes town and replaces its file, cuts as for Town_serialize */
+static bool Town_write_file(
+	const Town *town,
+	const char *town_name,
+	Buffer *buf,
+	size_t cuts[TOWN_SECTION_COUNT + 1] )
+{
+	SM_String filepath_save = SM_String_new(16);
+	SM_String filepath_tmp = SM_String_new(16);
+	bool result = false;
+
+	/* get paths */
+	if (get_town_file_path(&filepath_save, town_name, FILETYPE_TOWN) != 0)
+		goto town_write_file_clear;
+
+	SM_String_copy(&filepath_tmp, &filepath_save);
+	SM_String_append_cstr(&filepath_tmp, ".");
+	SM_String_append_cstr(&filepath_tmp, FILETYPE_TEMP);
+
+	/* build whole image in memory */
+	Town_serialize(town, buf, cuts);
+
+	if (buf->invalid)
+	{
+		printf(MSG_ERR_FILE_TOWN_SAVE);
+		goto town_write_file_clear;
+	}
+
+	/* write temp file and rename over save */
+	if (Buffer_to_file(buf, filepath_save.str, filepath_tmp.str) == false)
+	{
+		printf(MSG_ERR_FILE_SAVE);
+		goto town_write_file_clear;
+	}
+
+	result = true;
+
+	town_write_file_clear:
+
+	SM_String_clear(&filepath_save);
+	SM_String_clear(&filepath_tmp);
+
+	return result;
+}
+
+static bool Town_fetch_chunk( void *ctx, const BackupPiece *piece, Buffer *out )
+{
+	return ChunkStore_read_record(ctx, piece->tag, out);
+}
+
+/* sections of the town file and records of the chunk log are the unit of sharing */
+static bool Town_store_backup(
+	Town *town,
+	const char *town_name,
+	const Buffer *image,
+	const size_t cuts[TOWN_SECTION_COUNT + 1] )
+{
+	const uint32_t chunk_count = town->chunks.chunks_w * town->chunks.chunks_h;
+	BackupPiece *pieces = malloc((TOWN_SECTION_COUNT + 2 + chunk_count) * sizeof(BackupPiece));
+	uint8_t log_header[CHUNK_LOG_HEADER_SIZE];
+	uint32_t count = 0;
+	bool result;
+
+	if (pieces == NULL)
+		return false;
+
+	for (uint32_t i = 0; i < TOWN_SECTION_COUNT + 1; i++, count++)
+	{
+		pieces[count].file = BF_TOWN;
+		pieces[count].data = &image->data[cuts[i]];
+		pieces[count].len = ((i < TOWN_SECTION_COUNT) ? cuts[i + 1] : image->len) - cuts[i];
+		pieces[count].hash = fnv1a64(pieces[count].data, pieces[count].len);
+	}
+
+	ChunkStore_log_header(log_header);
+	pieces[count].file = BF_CHUNKS;
+	pieces[count].data = log_header;
+	pieces[count].len = CHUNK_LOG_HEADER_SIZE;
+	pieces[count].hash = fnv1a64(log_header, CHUNK_LOG_HEADER_SIZE);
+	count++;
+
+	/* records are only read from the log if the backups lack them */
+	for (uint32_t i = 0; i < chunk_count; i++)
+	{
+		if (town->chunks.refs[i].len == 0)
+			continue;
+
+		pieces[count].file = BF_CHUNKS;
+		pieces[count].data = NULL;
+		pieces[count].len = town->chunks.refs[i].len;
+		pieces[count].hash = town->chunks.refs[i].hash;
+		pieces[count].tag = i;
+		count++;
+	}
+
+	result = Backup_store(town_name, pieces, count, Town_fetch_chunk, &town->chunks, (BackupInfo) {
+			.generation = town->generation,
+			.round = town->round,
+			.money = town->money,
+		}, town->backup_generations);
+
+	free(pieces);
+
+	return result;
+}
+
+void Town_save( Town *town, const char *town_name )
+{
+	Buffer buf = Buffer_new(TOWN_SAVE_BUFFER_SIZE);
+	size_t cuts[TOWN_SECTION_COUNT + 1];
+	Town *saved = town;
+	Town exported;
+	TownHeader header;
+
+	/* dirty chunks go to the log of town_name first, the town file refers to them */
+	if (town->chunks.bound == false)
+		ChunkStore_bind(&town->chunks, town_name);
+
+	if (ChunkStore_is_bound_to(&town->chunks, town_name))
+	{
+		ChunkStore_flush(&town->chunks);
+	}
+	else
+	{
+		/* saved under another name, the town keeps writing to its own log */
+		exported = *town;
+		exported.chunks = ChunkStore_export(&town->chunks, town_name);
+		saved = &exported;
+	}
+
+	if (town->chunks.invalid || saved->chunks.invalid)
+	{
+		town->invalid = true;
+		printf(MSG_ERR_FILE_TOWN_CHUNKS);
+		goto town_save_clear;
+	}
+
+	if (Town_write_file(saved, town_name, &buf, cuts) == false)
+	{
+		town->invalid = true;
+		goto town_save_clear;
+	}
+
+	/* keep listing of towns current */
+	header = Town_get_header(town);
+	Catalog_record(town_name, &header);
+
+	/* add to backup ring */
+	if (Town_store_backup(saved, town_name, &buf, cuts) == false)
+		printf(MSG_WARN_FILE_TOWN_BACKUP);
+
+	town_save_clear:
+
+	if (saved == &exported)
+		ChunkStore_clear(&exported.chunks);
+
+	Buffer_clear(&buf);
+}
+
+void Town_compact( Town *town, const char *town_name )
+{
+	Buffer buf;
+	size_t cuts[TOWN_SECTION_COUNT + 1];
+
+	if (ChunkStore_is_bound_to(&town->chunks, town_name) == false ||
+		ChunkStore_compact(&town->chunks) == false)
+	{
+		return;
+	}
+
+	/* until rewritten, the town file is repaired by scanning the log */
+	buf = Buffer_new(TOWN_SAVE_BUFFER_SIZE);
+
+	if (Town_write_file(town, town_name, &buf, cuts) == false)
+		town->invalid = true;
+
+	Buffer_clear(&buf);
+}
+
+void Town_load( Town *town, const char *town_name )
+{
+	SM_String filepath = SM_String_new(16);
+	Buffer buf;
+	Buffer section;
+	const uint8_t *table;
+	uint16_t version = 0;
+	uint16_t section_count = 0;
+	TownHeader header;
+
+	/* get path */
+	if (get_town_file_path(&filepath, town_name, FILETYPE_TOWN) != 0)
+	{
+		town->invalid = true;
+		SM_String_clear(&filepath);
+		return;
+	}
+
+	/* map whole file, everything below is a bounds-checked view on it */
+	buf = Buffer_map_file(filepath.str);
+	SM_String_clear(&filepath);
+
+	if (buf.invalid)
+	{
+		town->invalid = true;
+		printf(MSG_ERR_FILE_LOAD);
+		Buffer_clear(&buf);
+		return;
+	}
+
+	table = Town_read_file_header(&buf, &version, &section_count);
+
+	/* migrate old flat files */
+	if (buf.invalid == false && table == NULL)
+	{
+		Town_clear(town);
+		*town = Town_new(TOWN_DEFAULT_WIDTH, TOWN_DEFAULT_HEIGHT);
+		ChunkStore_bind(&town->chunks, town_name);
+		buf.invalid |= town->invalid;
+
+		if (buf.invalid == false)
+			Town_deserialize_flat(town, &buf, version);
+	}
+
+	/* read known sections, unknown ones are skipped */
+	else if (table != NULL)
+	{
+		section = Town_find_section(&buf, table, section_count, TS_META);
+		Town_read_meta(&header, &section);
+		buf.invalid |= section.invalid;
+
+		/* grids are sized by the file */
+		if (buf.invalid)
+			goto town_load_clear;
+
+		Town_clear(town);
+		*town = Town_new(header.width, header.height);
+
+		if (town->invalid)
+			goto town_load_clear;
+
+		town->admin_id = header.admin_id;
+		town->round = header.round;
+		town->money = header.money;
+		town->generation = header.generation;
+		town->backup_generations = header.backup_generations;
+		town->seed = header.seed;
+		town->rng = header.rng;
+
+		/* chunks are paged in from the log on demand */
+		ChunkStore_bind(&town->chunks, town_name);
+
+		if (Town_has_section(table, section_count, TS_CHUNK_DIR))
+		{
+			section = Town_find_section(&buf, table, section_count, TS_CHUNK_DIR);
+			ChunkStore_read_dir(&town->chunks, &section);
+			buf.invalid |= section.invalid;
+
+			/* grid comes from the log, hashing it would page in every chunk */
+			town->grid_hash_valid = false;
+		}
+		else
+		{
+			Town_read_legacy_grids(town, &buf, table, section_count);
+		}
+
+		/* files without counts get them from a full scan */
+		if (Town_has_section(table, section_count, TS_FIELD_COUNTS))
+		{
+			section = Town_find_section(&buf, table, section_count, TS_FIELD_COUNTS);
+			Town_read_field_counts(town, &section);
+			buf.invalid |= section.invalid;
+		}
+		else if (buf.invalid == false)
+		{
+			Town_count_fields(town, town->field_counts);
+		}
+
+		if (Town_has_section(table, section_count, TS_CONSTRUCTION_QUEUE))
+		{
+			section = Town_find_section(&buf, table, section_count, TS_CONSTRUCTION_QUEUE);
+			Town_read_constructions(town, &section, false);
+		}
+		else
+		{
+			section = Town_find_section(&buf, table, section_count, TS_CONSTRUCTIONS);
+			Town_read_constructions(town, &section, true);
+		}
+
+		buf.invalid |= section.invalid;
+
+		section = Town_find_section(&buf, table, section_count, TS_MERCS);
+		Town_read_mercs(town, &section);
+		buf.invalid |= section.invalid;
+	}
+
+	town_load_clear:
+
+	if (buf.invalid)
+	{
+		town->invalid = true;
+		printf(MSG_ERR_FILE_TOWN_CORRUPT);
+	}
+
+	Buffer_clear(&buf);
+}
+
+TownHeader Town_load_header( const char *town_name )
+{
+	TownHeader result = {
+		.invalid = false,
+	};
+	SM_String filepath = SM_String_new(16);
+	Buffer buf;
+	Buffer section;
+	const uint8_t *table;
+	uint16_t version = 0;
+	uint16_t section_count = 0;
+	Town town;
+
+	/* get path */
+	if (get_town_file_path(&filepath, town_name, FILETYPE_TOWN) != 0)
+	{
+		result.invalid = true;
+		SM_String_clear(&filepath);
+		return result;
+	}
+
+	/* only pages of header, section table and metadata get touched */
+	buf = Buffer_map_file(filepath.str);
+	SM_String_clear(&filepath);
+
+	table = Town_read_file_header(&buf, &version, &section_count);
+
+	if (table != NULL)
+	{
+		section = Town_find_section(&buf, table, section_count, TS_META);
+		Town_read_meta(&result, &section);
+		result.invalid = section.invalid;
+	}
+
+	/* old flat files need a full load */
+	else if (buf.invalid == false)
+	{
+		town = Town_new(TOWN_DEFAULT_WIDTH, TOWN_DEFAULT_HEIGHT);
+		buf.invalid |= town.invalid;
+
+		if (buf.invalid == false)
+			Town_deserialize_flat(&town, &buf, version);
+
+		result = Town_get_header(&town);
+		result.invalid = buf.invalid;
+		Town_clear(&town);
+	}
+	else
+	{
+		result.invalid = true;
+	}
+
+	Buffer_clear(&buf);
+	return result;
+}
+
+bool Town_exists( const char *town_name )
+{
+	SM_String filepath = SM_String_new(16);
+	FILE *f = NULL;
+
+	if (get_town_file_path(&filepath, town_name, FILETYPE_TOWN) == 0)
+		f = fopen(filepath.str, "r");
+
+	SM_String_clear(&filepath);
+
+	if (f == NULL)
+		return false;
+
+	fclose(f);
+	return true;
+}
+
+/* grids of the whole town, hidden bits then packed fields */
+static void Town_write_grids( Town *town, Buffer *buf )
+{
+	const uint32_t cells = town->width * town->height;
+	uint8_t *field = malloc(cells);
+	bool *hidden = malloc(cells * sizeof(bool));
+	SDL_Point coords;
+
+	if (field == NULL || hidden == NULL)
+	{
+		buf->invalid = true;
+		goto write_grids_clear;
+	}
+
+	for (coords.y = 0; (uint32_t) coords.y < town->height; coords.y++)
+	{
+		for (coords.x = 0; (uint32_t) coords.x < town->width; coords.x++)
+		{
+			field[coords.y * town->width + coords.x] = Town_get_field(town, coords);
+			hidden[coords.y * town->width + coords.x] = Town_get_hidden(town, coords);
+		}
+	}
+
+	pack_bits(hidden, cells, buf);
+	pack_fields(field, cells, buf);
+
+	write_grids_clear:
+
+	free(field);
+	free(hidden);
+}
+
+static void Town_read_grids( Town *town, Buffer *buf )
+{
+	const uint32_t cells = town->width * town->height;
+	uint8_t *field = malloc(cells);
+	bool *hidden = malloc(cells * sizeof(bool));
+
+	if (field == NULL || hidden == NULL)
+	{
+		buf->invalid = true;
+		goto read_grids_clear;
+	}
+
+	unpack_bits(hidden, cells, buf);
+	unpack_fields(field, cells, FIELD_LAST, buf);
+
+	if (buf->invalid == false)
+		Town_import_grids(town, field, hidden);
+
+	read_grids_clear:
+
+	free(field);
+	free(hidden);
+}
+
+/* length-prefixed part of a snapshot */
+static Buffer Town_read_part( Buffer *buf )
+{
+	const uint32_t len = Buffer_read_u32(buf);
+	Buffer result = Buffer_slice(buf, buf->pos, len);
+
+	if (result.invalid)
+		buf->invalid = true;
+	else
+		buf->pos += len;
+
+	return result;
+}
+
+void Town_write_snapshot( Town *town, Buffer *buf )
+{
+	size_t begin;
+
+	/* meta, grids, constructions, mercs, each prefixed by its length */
+	for (uint32_t i = 0; i < 4 && buf->invalid == false; i++)
+	{
+		begin = buf->len;
+		Buffer_write_u32(buf, 0);
+
+		switch (i)
+		{
+		case 0: Town_write_meta(town, buf); break;
+		case 1: Town_write_grids(town, buf); break;
+		case 2: Town_write_constructions(town, buf); break;
+		case 3: Town_write_mercs(town, buf); break;
+		}
+
+		if (buf->invalid == false)
+			Buffer_patch_u32(buf, begin, buf->len - begin - sizeof(uint32_t));
+	}
+}
+
+Town Town_read_snapshot( Buffer *buf )
+{
+	Town result = Town_new(TOWN_MIN_SIZE, TOWN_MIN_SIZE);
+	TownHeader header;
+	Buffer part;
+
+	part = Town_read_part(buf);
+	Town_read_meta(&header, &part);
+
+	if (buf->invalid || part.invalid)
+	{
+		result.invalid = true;
+		return result;
+	}
+
+	Town_clear(&result);
+	result = Town_new(header.width, header.height);
+
+	if (result.invalid)
+		return result;
+
+	result.admin_id = header.admin_id;
+	result.round = header.round;
+	result.money = header.money;
+	result.generation = header.generation;
+	result.backup_generations = header.backup_generations;
+	result.seed = header.seed;
+	result.rng = header.rng;
+
+	part = Town_read_part(buf);
+	Town_read_grids(&result, &part);
+	result.invalid |= part.invalid;
+
+	part = Town_read_part(buf);
+	Town_read_constructions(&result, &part, false);
+	result.invalid |= part.invalid;
+
+	part = Town_read_part(buf);
+	Town_read_mercs(&result, &part);
+	result.invalid |= part.invalid | buf->invalid;
+
+	return result;
+}
+
+uint32_t Construction_ready_round( const Construction *construction )
+{
+	return construction->start_round + DATA_FIELDS[construction->field].construction_time;
+}
+
+/* puts construction into slot index and tells the index about it,
+	slot of existing coords never needs to grow the index */
+static void Town_construction_place( Town *town, const uint32_t index, const Construction construction )
+{
+	town->constructions[index] = construction;
+	CoordMap_set(&town->construction_index, construction.coords, index);
+}
+
+static void Town_construction_sift_up( Town *town, uint32_t index )
+{
+	const Construction construction = town->constructions[index];
+	const uint32_t ready = Construction_ready_round(&construction);
+	uint32_t parent;
+
+	while (index > 0)
+	{
+		parent = (index - 1) / 2;
+
+		if (Construction_ready_round(&town->constructions[parent]) <= ready)
+			break;
+
+		Town_construction_place(town, index, town->constructions[parent]);
+		index = parent;
+	}
+
+	Town_construction_place(town, index, construction);
+}
+
+static void Town_construction_sift_down( Town *town, uint32_t index )
+{
+	const Construction construction = town->constructions[index];
+	const uint32_t ready = Construction_ready_round(&construction);
+	uint32_t child;
+
+	while ((child = index * 2 + 1) < town->construction_count)
+	{
+		/* take the earlier of both children */
+		if (child + 1 < town->construction_count &&
+			Construction_ready_round(&town->constructions[child + 1]) <
+			Construction_ready_round(&town->constructions[child]))
+			child++;
+
+		if (ready <= Construction_ready_round(&town->constructions[child]))
+			break;
+
+		Town_construction_place(town, index, town->constructions[child]);
+		index = child;
+	}
+
+	Town_construction_place(town, index, construction);
+}
+
+bool Town_construction_queue_add( Town *town, const Construction construction )
+{
+	Construction *constructions;
+	uint32_t index;
+	uint32_t size;
+
+	/* a site gets only one job, the newer order wins */
+	index = Town_construction_queue_find(town, construction.coords);
+
+	if (index != COORDMAP_NONE)
+		Town_construction_queue_remove(town, index);
+
+	/* count is stored as 16 bit */
+	if (town->construction_count >= UINT16_MAX)
+		return false;
+
+	/* grow by doubling */
+	if (town->construction_count == town->construction_size)
+	{
+		size = (town->construction_size == 0) ? 8 : town->construction_size * 2;
+		constructions = realloc(town->constructions, size * sizeof(Construction));
+
+		if (constructions == NULL)
+			return false;
+
+		town->constructions = constructions;
+		town->construction_size = size;
+	}
+
+	/* claim index entry first, the only step that may fail */
+	index = town->construction_count;
+
+	if (CoordMap_set(&town->construction_index, construction.coords, index) == false)
+		return false;
+
+	town->constructions[index] = construction;
+	town->construction_count++;
+	Town_construction_sift_up(town, index);
+
+	return true;
+}
+
+void Town_construction_queue_remove( Town *town, const uint32_t index )
+{
+	const uint32_t last = town->construction_count - 1;
+
+	CoordMap_remove(&town->construction_index, town->constructions[index].coords);
+	town->construction_count--;
+
+	if (index == last)
+		return;
+
+	/* fill gap with last entry, which may have to go either way */
+	Town_construction_place(town, index, town->constructions[last]);
+
+	if (index > 0 &&
+		Construction_ready_round(&town->constructions[(index - 1) / 2]) >
+		Construction_ready_round(&town->constructions[index]))
+		Town_construction_sift_up(town, index);
+	else
+		Town_construction_sift_down(town, index);
+}
+
+uint32_t Town_construction_queue_find( const Town *town, const SDL_Point coords )
+{
+	return CoordMap_get(&town->construction_index, coords);
+}
+
+uint32_t Town_merc_at( const Town *town, const SDL_Point coords )
+{
+	/* keys of the index only cover fields of the town */
+	if (Town_coords_valid(town, coords.x, coords.y) == false)
+		return COORDMAP_NONE;
+
+	return CoordMap_get(&town->merc_index, coords);
+}
+
+bool Town_merc_spawn( Town *town, const TownMerc merc )
+{
+	if (town->merc_count >= MERCENARY_COUNT ||
+		CoordMap_set(&town->merc_index, merc.coords, town->merc_count) == false)
+		return false;
+
+	town->mercs[town->merc_count] = merc;
+	town->merc_count++;
+	Town_set_field(town, merc.coords, FIELD_MERC);
+
+	return true;
+}
+
+void Town_merc_move( Town *town, const uint32_t slot, const SDL_Point dest_coords )
+{
+	const SDL_Point src_coords = town->mercs[slot].coords;
+
+	/* remove first, so the index never has to grow */
+	CoordMap_remove(&town->merc_index, src_coords);
+	CoordMap_set(&town->merc_index, dest_coords, slot);
+	town->mercs[slot].coords = dest_coords;
+
+	Town_set_field(town, src_coords, FIELD_EMPTY);
+	Town_set_field(town, dest_coords, FIELD_MERC);
+}
+
+void Town_merc_kill( Town *town, const uint32_t slot )
+{
+	/* dead mercs keep their slot, so they can not be spawned again */
+	town->mercs[slot].hp = 0;
+	CoordMap_remove(&town->merc_index, town->mercs[slot].coords);
+	Town_set_field(town, town->mercs[slot].coords, FIELD_EMPTY);
+}
+
+void Town_clear( Town *town )
+{
+	ChunkStore_clear(&town->chunks);
+	CoordMap_clear(&town->construction_index);
+	CoordMap_clear(&town->merc_index);
+	free(town->constructions);
+
+	town->constructions = NULL;
+	town->construction_count = 0;
+	town->construction_size = 0;
 }
@@ -20,26 +20,49 @@
 #define TOWN_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <SDL.h>
+#include "rng.h"
 #include "mercs.h"
+#include "chunks.h"
+#include "coordmap.h"
 
-#define TOWN_WIDTH	15
-#define TOWN_HEIGHT	15
-
-static const uint32_t TOWN_EXPOSURE_AREA_BEGIN_X =	4;
-static const uint32_t TOWN_EXPOSURE_AREA_BEGIN_Y =	4;
-static const uint32_t TOWN_EXPOSURE_AREA_END_X =	11;
-static const uint32_t TOWN_EXPOSURE_AREA_END_Y =	11;
-static const uint32_t TOWN_TREEFREE_AREA_BEGIN_X =	5;
-static const uint32_t TOWN_TREEFREE_AREA_BEGIN_Y =	5;
-static const uint32_t TOWN_TREEFREE_AREA_END_X =	10;
-static const uint32_t TOWN_TREEFREE_AREA_END_Y =	10;
-static const uint32_t TOWN_GEN_TREE_THRESHOLD =		40;		/* from 0 to 100 */
-static const uint32_t TOWN_HQ_SPAWN_X =				7;
-static const uint32_t TOWN_HQ_SPAWN_Y =				7;
+static const uint32_t TOWN_DEFAULT_WIDTH =			15;
+static const uint32_t TOWN_DEFAULT_HEIGHT =			15;
+static const uint32_t TOWN_MIN_SIZE =				15;		/* per side */
+static const uint32_t TOWN_MAX_SIZE =				1024;	/* per side */
+static const uint32_t TOWN_EXPOSURE_RADIUS =		3;		/* around the headquarter */
+static const uint32_t TOWN_TREEFREE_RADIUS =		2;		/* around the headquarter */
+static const uint32_t TOWN_GEN_TREE_THRESHOLD =		40;		/* from 0 to 100, share of land without trees */
 static const uint32_t TOWN_START_TIME =				6;		/* round 0 plays at 06:00 am */
 static const uint32_t TOWN_START_MONEY =			2000;
+static const size_t TOWN_SAVE_BUFFER_SIZE =			4096;
+static const uint8_t TOWN_BACKUP_GENERATIONS =		8;		/* default size of backup ring */
+
+static const char TOWN_FILE_MAGIC[4] = {'R', 'C', 'T', 'W'};
+static const uint16_t TOWN_FILE_VERSION =			2;
+#define TOWN_FILE_HEADER_SIZE			20
+#define TOWN_FILE_V1_HEADER_SIZE		12	/* magic, file and app version */
+#define TOWN_FILE_V0_HEADER_SIZE		30	/* app version, meta, size, '\n' */
+#define TOWN_FILE_SECTION_ENTRY_SIZE	16
+#define TOWN_FILE_MAX_SECTIONS			64
+
+/* section ids of the town file, never reuse or reorder */
+typedef enum TownSection
+{
+	TS_META = 1,
+	TS_HIDDEN,
+	TS_FIELD,
+	TS_CONSTRUCTIONS,
+	TS_MERCS,
+	TS_HIDDEN_BITS,		/* supersedes TS_HIDDEN */
+	TS_FIELD_PACKED,	/* supersedes TS_FIELD */
+	TS_CHUNK_DIR,		/* supersedes TS_HIDDEN_BITS and TS_FIELD_PACKED */
+	TS_FIELD_COUNTS,
+	TS_CONSTRUCTION_QUEUE,	/* supersedes TS_CONSTRUCTIONS */
+} TownSection ;
+#define TOWN_SECTION_COUNT 5
 
 typedef enum Field
 {
@@ -84,9 +107,12 @@ typedef struct Construction
 {
 	Field field;
 	SDL_Point coords;
-	uint32_t progress;
+	uint32_t start_round;
 } Construction ;
 
+/* round at whose beginning the construction stands */
+uint32_t Construction_ready_round( const Construction *construction );
+
 typedef struct TownMerc
 {
 	Mercenary id;
@@ -99,6 +125,8 @@ typedef struct TownMerc
 
 bool str_to_field( const char *str, Field *field );
 
+/* manhattan distance, ignoring whatever stands in between,
+	what a merc can actually walk to comes from Reach in pathfind.h */
 uint_fast32_t get_distance( const SDL_Point pt1, const SDL_Point pt2 );
 
 typedef struct Town
@@ -107,24 +135,123 @@ typedef struct Town
 	uint8_t admin_id;
 	uint32_t round;
 	uint32_t money;
-	Field field[TOWN_WIDTH][TOWN_HEIGHT];
-	bool hidden[TOWN_WIDTH][TOWN_HEIGHT];
+	uint32_t generation;	/* incremented with every checkpoint save */
+	uint8_t backup_generations;
+	uint64_t seed;			/* town was generated from */
+	Rng rng;				/* all randomness of this town */
+	uint32_t width;
+	uint32_t height;
+	ChunkStore chunks;		/* field and hidden grids */
+	uint32_t field_counts[FIELD_LAST + 1];	/* fields of each kind, kept by Town_set_field */
+	uint32_t map_version;	/* bumped by Town_set_field, not saved */
+
+	/* xor of all field hashes, kept by Town_set_field and Town_set_hidden
+		once Town_state_hash computed it, not saved */
+	bool grid_hash_valid;
+	uint64_t grid_hash;
 
+	/* min-heap by ready round, constructions[0] finishes first */
 	uint32_t construction_count;
-	Construction constructions[TOWN_WIDTH * TOWN_HEIGHT];
+	uint32_t construction_size;
+	Construction *constructions;
+	CoordMap construction_index;	/* coords to heap slot */
 
 	uint32_t merc_count;
 	TownMerc mercs[MERCENARY_COUNT];
+	CoordMap merc_index;	/* coords of living mercs to slot in mercs */
 } Town ;
 
-Town Town_new( void );
+/* summary of a town, readable without loading the grids */
+typedef struct TownHeader
+{
+	bool invalid;
+	uint8_t admin_id;
+	uint32_t round;
+	uint32_t money;
+	uint16_t width;
+	uint16_t height;
+	uint8_t merc_count;
+	uint32_t generation;
+	uint8_t backup_generations;
+	uint64_t seed;
+	Rng rng;
+} TownHeader ;
+
+/* grids are paged in by chunk, sets invalid if size is out of range */
+Town Town_new( const uint32_t width, const uint32_t height );
+
+Town Town_copy( const Town *town );
+
+bool Town_coords_valid( const Town *town, const int32_t x, const int32_t y );
+
+/* grid access may page in a chunk, hence no const */
+Field Town_get_field( Town *town, const SDL_Point coords );
+
+void Town_set_field( Town *town, const SDL_Point coords, const Field field );
+
+bool Town_get_hidden( Town *town, const SDL_Point coords );
+
+void Town_set_hidden( Town *town, const SDL_Point coords, const bool hidden );
+
+SDL_Point Town_get_hq_spawn( const Town *town );
 
-void Town_print( const Town *town, const char *town_name );
+/* sum of running costs of all fields, without touching the grid */
+uint32_t Town_running_cost( const Town *town );
 
+/* hash over everything the rules depend on, equal towns hash equal.
+	The first call scans the grid, later ones only look at what changed. */
+uint64_t Town_state_hash( Town *town );
+
+#ifdef _DEBUG
+/* rescans the whole grid, returns whether field_counts match it */
+bool Town_verify_field_counts( Town *town );
+
+/* returns whether merc_index, living mercs and FIELD_MERC markers agree */
+bool Town_verify_merc_index( Town *town );
+#endif
+
+void Town_generate( Town *town, const uint64_t seed );
+
+void Town_print( Town *town, const char *town_name );
+
+/* writes dirty chunks to the log of town_name, then the town file */
 void Town_save( Town *town, const char *town_name );
 
+/* drops stale records from the chunk log, only right after a save */
+void Town_compact( Town *town, const char *town_name );
+
+/* replaces grids of town with ones of the size found in the file */
 void Town_load( Town *town, const char *town_name );
 
-void Town_construction_list_remove( Town *town, const uint32_t index );
+TownHeader Town_load_header( const char *town_name );
+
+/* whether the file of town_name is there, without reading it */
+bool Town_exists( const char *town_name );
+
+/* whole town in one self-contained image, grids included, no chunk log needed */
+void Town_write_snapshot( Town *town, Buffer *buf );
+
+/* sets invalid if the image is broken, the town is not bound to any files */
+Town Town_read_snapshot( Buffer *buf );
+
+/* replaces a construction queued at the same coords */
+bool Town_construction_queue_add( Town *town, const Construction construction );
+
+void Town_construction_queue_remove( Town *town, const uint32_t index );
+
+/* returns heap slot or COORDMAP_NONE */
+uint32_t Town_construction_queue_find( const Town *town, const SDL_Point coords );
+
+/* returns slot of the living merc at coords or COORDMAP_NONE */
+uint32_t Town_merc_at( const Town *town, const SDL_Point coords );
+
+/* the following keep mercs, merc_index and the grid in sync */
+bool Town_merc_spawn( Town *town, const TownMerc merc );
+
+void Town_merc_move( Town *town, const uint32_t slot, const SDL_Point dest_coords );
+
+void Town_merc_kill( Town *town, const uint32_t slot );
+
+void Town_clear( Town *town );
 
 #endif /* TOWN_H */
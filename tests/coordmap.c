@@ -0,0 +1,109 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+#include "test.h"
+#include "coordmap.h"
+
+/* fills a map with every field of a rectangle and checks that lookups
+	stay short, returns the mean distance of an entry from its home slot */
+static double fill_rect( const int32_t x0, const int32_t y0, const int32_t w, const int32_t h )
+{
+	CoordMap map = CoordMap_new();
+	SDL_Point coords;
+	uint32_t value = 0;
+	double result;
+
+	for (coords.y = y0; coords.y < y0 + h; coords.y++)
+	{
+		for (coords.x = x0; coords.x < x0 + w; coords.x++)
+			CHECK(CoordMap_set(&map, coords, value++));
+	}
+
+	CHECK(map.count == (uint32_t) (w * h));
+
+	value = 0;
+
+	for (coords.y = y0; coords.y < y0 + h; coords.y++)
+	{
+		for (coords.x = x0; coords.x < x0 + w; coords.x++)
+			CHECK(CoordMap_get(&map, coords) == value++);
+	}
+
+	result = (double) CoordMap_displacement(&map) / map.count;
+	CoordMap_clear(&map);
+
+	return result;
+}
+
+/* the fog keeps a map per visible window, indices one per building or merc */
+static void test_dense_rects( void )
+{
+	CHECK(fill_rect(0, 0, 41, 41) < 1.0);
+	CHECK(fill_rect(300, 500, 41, 41) < 1.0);
+	CHECK(fill_rect(0, 0, 15, 15) < 1.0);
+	CHECK(fill_rect(7, 3, 128, 128) < 1.0);
+	CHECK(fill_rect(0, 0, 1024, 1) < 1.0);
+	CHECK(fill_rect(0, 0, 1, 1024) < 1.0);
+}
+
+/* removing shifts runs back, everything left must still be found */
+static void test_remove( void )
+{
+	CoordMap map = CoordMap_new();
+	SDL_Point coords;
+
+	for (coords.y = 0; coords.y < 64; coords.y++)
+	{
+		for (coords.x = 0; coords.x < 64; coords.x++)
+			CoordMap_set(&map, coords, coords.y * 64 + coords.x);
+	}
+
+	for (coords.y = 0; coords.y < 64; coords.y++)
+	{
+		for (coords.x = (coords.y % 2); coords.x < 64; coords.x += 2)
+			CoordMap_remove(&map, coords);
+	}
+
+	CHECK(map.count == 64 * 32);
+
+	for (coords.y = 0; coords.y < 64; coords.y++)
+	{
+		for (coords.x = 0; coords.x < 64; coords.x++)
+		{
+			if ((coords.x + coords.y) % 2 == 0)
+				CHECK(CoordMap_get(&map, coords) == COORDMAP_NONE);
+			else
+				CHECK(CoordMap_get(&map, coords) == (uint32_t) (coords.y * 64 + coords.x));
+		}
+	}
+
+	CoordMap_clear(&map);
+}
+
+int main( void )
+{
+	test_dense_rects();
+	test_remove();
+
+	return test_result("coordmap");
+}
@@ -0,0 +1,283 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL.h>
+#include "test.h"
+#include "config.h"
+#include "journal.h"
+#include "saver.h"
+#include "sim.h"
+#include "town.h"
+#include "game.h"
+
+static const uint32_t TEST_AI_TURN_MS = 20;
+static const uint32_t TEST_LONG_PASS = 200;	/* rounds the town can pay for */
+
+/* saves a town with a green merc and, if wanted, a purple one far off */
+static void create_town( const char *town_name, const bool purple )
+{
+	Town town = Town_new(30, 30);
+
+	town.money = 100000;
+	Town_merc_spawn(&town, (TownMerc) {
+		.id = MERC_SOLDIER,
+		.coords = {3, 3},
+		.hp = DATA_MERCENARIES[MERC_SOLDIER].max_hp,
+		.fraction = MF_GREEN,
+	});
+
+	if (purple)
+	{
+		Town_merc_spawn(&town, (TownMerc) {
+			.id = MERC_SOLDIER,
+			.coords = {25, 25},
+			.hp = DATA_MERCENARIES[MERC_SOLDIER].max_hp,
+			.fraction = GAME_AI_FRACTION,
+		});
+	}
+
+	Town_save(&town, town_name);
+	CHECK(town.invalid == false);
+	Town_clear(&town);
+}
+
+/* the same way cmd_connect sets up a game, without display,
+	resumed like the daemon does if wanted */
+static void open_game( Game *game, Town *town, Config *cfg, const char *town_name, const bool resume )
+{
+	*town = Town_new(TOWN_DEFAULT_WIDTH, TOWN_DEFAULT_HEIGHT);
+	Town_load(town, town_name);
+	CHECK(town->invalid == false);
+
+	*game = (Game) {
+		.town_name = town_name,
+		.town = town,
+		.cfg = cfg,
+		.sim = Sim_new(town),
+		.replaying = false,
+		.ai_turns = 0,
+		.game_state = GS_ACTIVE
+	};
+	game->journal = Journal_open(town_name);
+	Saver_new_inline(&game->saver, town_name);
+	Sim_subscribe(&game->sim, Game_on_event, game);
+	Sim_rebuild_fog(&game->sim);
+
+	if (resume)
+	{
+		game->defer_checkpoints = true;
+		Game_resume_journal(game);
+	}
+	else
+	{
+		Game_replay_journal(game);
+	}
+}
+
+static void close_game( Game *game )
+{
+	Journal_close(&game->journal);
+	Saver_clear(&game->saver);
+	Sim_clear(&game->sim);
+	Town_clear(game->town);
+}
+
+/* the ai acts before every round its mercs live through */
+static void test_ai_turn_per_round( void )
+{
+	Config cfg = Config_new();
+	Town town;
+	Game game;
+	uint32_t round;
+	uint32_t passed;
+	uint64_t hash;
+
+	cfg.ai_turn_ms = TEST_AI_TURN_MS;
+	create_town("ai_rounds", true);
+	open_game(&game, &town, &cfg, "ai_rounds", false);
+	round = town.round;
+
+	CHECK(Game_pass(&game, 2, SS_ROUNDS, 0, &passed) == SS_ROUNDS);
+	CHECK(passed == 2);
+	CHECK(town.round == round + 2);
+	CHECK(game.ai_turns == 2);
+
+	CHECK(Game_pass(&game, 1, SS_ROUNDS, 0, &passed) == SS_ROUNDS);
+	CHECK(game.ai_turns == 3);
+
+	/* the journal holds the ai moves between the rounds */
+	hash = Town_state_hash(&town);
+	close_game(&game);
+
+	open_game(&game, &town, &cfg, "ai_rounds", false);
+	CHECK(Town_state_hash(&town) == hash);
+	CHECK(game.ai_turns == 0);
+	close_game(&game);
+}
+
+/* a long pass stops thinking once its ai time is used up */
+static void test_ai_pass_capped( void )
+{
+	Config cfg = Config_new();
+	Town town;
+	Game game;
+	uint32_t start;
+	uint32_t passed;
+
+	cfg.ai_turn_ms = TEST_AI_TURN_MS;
+	create_town("ai_capped", true);
+	open_game(&game, &town, &cfg, "ai_capped", false);
+	game.ai_pass_ms = 3 * TEST_AI_TURN_MS;
+	game.ai_threads = 1;
+	start = SDL_GetTicks();
+
+	CHECK(Game_pass(&game, TEST_LONG_PASS, SS_ROUNDS, 0, &passed) == SS_ROUNDS);
+	CHECK(passed == TEST_LONG_PASS);
+	CHECK(game.ai_turns > 0);
+	CHECK(game.ai_turns < TEST_LONG_PASS);
+	CHECK(SDL_GetTicks() - start < GAME_PASS_AI_MS);
+
+	close_game(&game);
+}
+
+/* without purple mercs many rounds still pass in one go */
+static void test_no_ai_mercs( void )
+{
+	Config cfg = Config_new();
+	Town town;
+	Game game;
+	uint32_t round;
+	uint32_t passed;
+
+	cfg.ai_turn_ms = TEST_AI_TURN_MS;
+	create_town("ai_none", false);
+	open_game(&game, &town, &cfg, "ai_none", false);
+	round = town.round;
+
+	CHECK(Game_pass(&game, 100, SS_ROUNDS, 0, &passed) == SS_ROUNDS);
+	CHECK(passed == 100);
+	CHECK(town.round == round + 100);
+	CHECK(game.ai_turns == 0);
+
+	close_game(&game);
+}
+
+static void test_ai_off( void )
+{
+	Config cfg = Config_new();
+	Town town;
+	Game game;
+	uint32_t passed;
+
+	cfg.ai_turn_ms = 0;
+	create_town("ai_off", true);
+	open_game(&game, &town, &cfg, "ai_off", false);
+
+	CHECK(Game_pass(&game, 5, SS_ROUNDS, 0, &passed) == SS_ROUNDS);
+	CHECK(passed == 5);
+	CHECK(game.ai_turns == 0);
+
+	close_game(&game);
+}
+
+/* a stop ends the pass between ai turns */
+static void test_money_stop( void )
+{
+	Config cfg = Config_new();
+	Town town;
+	Game game;
+	uint32_t passed;
+	uint32_t cost;
+
+	cfg.ai_turn_ms = TEST_AI_TURN_MS;
+	create_town("ai_money", true);
+	open_game(&game, &town, &cfg, "ai_money", false);
+
+	/* upkeep of one round */
+	cost = town.money;
+	Game_pass(&game, 1, SS_ROUNDS, 0, &passed);
+	cost -= town.money;
+
+	CHECK(Game_pass(&game, 10, SS_MONEY_BELOW, town.money - 2 * cost, &passed) == SS_MONEY_BELOW);
+	CHECK(passed == 3);
+	CHECK(game.ai_turns == 4);
+
+	close_game(&game);
+}
+
+/* resuming keeps the journal, the save waits for the day to end */
+static void test_resume_journal( void )
+{
+	Config cfg = Config_new();
+	Town town;
+	Game game;
+	uint32_t generation;
+	uint32_t passed;
+	uint64_t hash;
+
+	cfg.ai_turn_ms = 0;
+	create_town("resume", false);
+	open_game(&game, &town, &cfg, "resume", true);
+	generation = town.generation;
+
+	Game_pass(&game, 1, SS_ROUNDS, 0, &passed);
+	CHECK(game.checkpoint_due == false);
+	close_game(&game);
+
+	/* the round is replayed, but not saved */
+	for (uint32_t i = 0; i < 2; i++)
+	{
+		open_game(&game, &town, &cfg, "resume", true);
+		CHECK(town.generation == generation);
+		Game_pass(&game, 1, SS_ROUNDS, 0, &passed);
+		hash = Town_state_hash(&town);
+		close_game(&game);
+	}
+
+	open_game(&game, &town, &cfg, "resume", true);
+	CHECK(Town_state_hash(&town) == hash);
+	Game_pass(&game, GAME_CHECKPOINT_ROUNDS - town.round % GAME_CHECKPOINT_ROUNDS, SS_ROUNDS, 0, &passed);
+	CHECK(game.checkpoint_due);
+	CHECK(town.generation == generation);
+	CHECK(Game_save(&game));
+	hash = Town_state_hash(&town);
+	close_game(&game);
+
+	open_game(&game, &town, &cfg, "resume", true);
+	CHECK(town.generation == generation + 1);
+	CHECK(Town_state_hash(&town) == hash);
+	close_game(&game);
+}
+
+int main( void )
+{
+	test_home();
+
+	test_ai_turn_per_round();
+	test_ai_pass_capped();
+	test_no_ai_mercs();
+	test_ai_off();
+	test_money_stop();
+	test_resume_journal();
+
+	return test_result("game_pass");
+}
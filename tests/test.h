@@ -0,0 +1,108 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* each test is a program of its own, it fails if any check did */
+static unsigned int test_failures = 0;
+
+#define CHECK(cond) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			printf("%s:%i: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			test_failures++; \
+		} \
+	} while (0)
+
+static char test_home_path[] = "/tmp/remote_control_test_XXXXXX";
+
+/* removes path and everything below it */
+static inline void test_remove_tree( const char *path )
+{
+	DIR *dir;
+	struct dirent *d_ent;
+	struct stat st;
+	char *child;
+
+	if (lstat(path, &st) != 0)
+		return;
+
+	if (S_ISDIR(st.st_mode) && (dir = opendir(path)) != NULL)
+	{
+		while ((d_ent = readdir(dir)) != NULL)
+		{
+			if (strcmp(d_ent->d_name, ".") == 0 || strcmp(d_ent->d_name, "..") == 0)
+				continue;
+
+			child = malloc(strlen(path) + strlen(d_ent->d_name) + 2);
+
+			if (child == NULL)
+				break;
+
+			sprintf(child, "%s/%s", path, d_ent->d_name);
+			test_remove_tree(child);
+			free(child);
+		}
+
+		closedir(dir);
+	}
+
+	remove(path);
+}
+
+static inline void test_home_clear( void )
+{
+	test_remove_tree(test_home_path);
+}
+
+/* towns are looked up under HOME, give every test a home of its own,
+	it is gone once the test exits */
+static inline void test_home( void )
+{
+	if (mkdtemp(test_home_path) == NULL || setenv("HOME", test_home_path, 1) != 0)
+	{
+		printf("can not create test home\n");
+		exit(1);
+	}
+
+	atexit(test_home_clear);
+}
+
+static inline int test_result( const char *name )
+{
+	if (test_failures > 0)
+	{
+		printf("%s: %u checks failed\n", name, test_failures);
+		return 1;
+	}
+
+	printf("%s: ok\n", name);
+	return 0;
+}
+
+#endif /* TEST_H */
@@ -0,0 +1,234 @@
+/*
+	remote_control
+	Copyright (C) 2021	Andy Frank Schoknecht
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SM_string.h>
+#include "test.h"
+#include "path.h"
+#include "buffer.h"
+#include "town.h"
+
+/* written by Town_save of the first release: admin 1, round 30, money 1234,
+	exposed square from 4 to 10, quarry at 6,7 one round into construction,
+	a green soldier at 5,9 that moved and a purple pyro at 9,5 that attacked */
+static const char FIXTURE_BASELINE[] = "tests/data/baseline.twn";
+
+/* puts the bytes of fixture, or its first len ones, where town_name is looked for */
+static void install( const char *fixture, const char *town_name, const size_t len )
+{
+	SM_String filepath = SM_String_new(16);
+	SM_String filepath_tmp = SM_String_new(16);
+	Buffer buf = Buffer_from_file(fixture);
+
+	if (buf.invalid)
+	{
+		printf("can not read %s\n", fixture);
+		exit(1);
+	}
+
+	if (len < buf.len)
+		buf.len = len;
+
+	get_town_file_path(&filepath, town_name, FILETYPE_TOWN);
+	get_town_file_path(&filepath_tmp, town_name, FILETYPE_TEMP);
+	CHECK(Buffer_to_file(&buf, filepath.str, filepath_tmp.str));
+
+	Buffer_clear(&buf);
+	SM_String_clear(&filepath);
+	SM_String_clear(&filepath_tmp);
+}
+
+static void test_load_baseline( void )
+{
+	Town town = Town_new(TOWN_DEFAULT_WIDTH, TOWN_DEFAULT_HEIGHT);
+
+	install(FIXTURE_BASELINE, "baseline", SIZE_MAX);
+	Town_load(&town, "baseline");
+
+	CHECK(town.invalid == false);
+
+	if (town.invalid)
+	{
+		Town_clear(&town);
+		return;
+	}
+
+	CHECK(town.width == 15 && town.height == 15);
+	CHECK(town.admin_id == 1);
+	CHECK(town.round == 30);
+	CHECK(town.money == 1234);
+
+	/* grids were indexed [x][y] */
+	CHECK(Town_get_field(&town, (SDL_Point) {0, 0}) == FIELD_TREE_0);
+	CHECK(Town_get_field(&town, (SDL_Point) {14, 0}) == FIELD_TREE_3);
+	CHECK(Town_get_field(&town, (SDL_Point) {0, 14}) == FIELD_TREE_4);
+	CHECK(Town_get_field(&town, (SDL_Point) {2, 1}) == FIELD_TREE_1);
+	CHECK(Town_get_field(&town, (SDL_Point) {1, 2}) == FIELD_EMPTY);
+	CHECK(Town_get_field(&town, (SDL_Point) {7, 7}) == FIELD_ADMINISTRATION);
+	CHECK(Town_get_field(&town, (SDL_Point) {8, 7}) == FIELD_QUARRY);
+	CHECK(Town_get_field(&town, (SDL_Point) {6, 7}) == FIELD_CONSTRUCTION);
+	CHECK(Town_get_hidden(&town, (SDL_Point) {0, 0}));
+	CHECK(Town_get_hidden(&town, (SDL_Point) {3, 7}));
+	CHECK(Town_get_hidden(&town, (SDL_Point) {4, 4}) == false);
+	CHECK(Town_get_hidden(&town, (SDL_Point) {10, 10}) == false);
+	CHECK(Town_get_hidden(&town, (SDL_Point) {11, 10}));
+	CHECK(town.field_counts[FIELD_MERC] == 2);
+	CHECK(town.field_counts[FIELD_EMPTY] == 15 * 15 - 9);
+
+	/* progress became the round it started in */
+	CHECK(town.construction_count == 1);
+	CHECK(town.constructions[0].field == FIELD_QUARRY);
+	CHECK(town.constructions[0].coords.x == 6 && town.constructions[0].coords.y == 7);
+	CHECK(town.constructions[0].start_round == 29);
+	CHECK(Town_construction_queue_find(&town, (SDL_Point) {6, 7}) == 0);
+
+	CHECK(town.merc_count == 2);
+	CHECK(town.mercs[0].id == MERC_SOLDIER);
+	CHECK(town.mercs[0].hp == 125);
+	CHECK(town.mercs[0].fraction == MF_GREEN);
+	CHECK(town.mercs[0].moved == 1);
+	CHECK(town.mercs[0].attacked == false);
+	CHECK(town.mercs[1].id == MERC_PYRO);
+	CHECK(town.mercs[1].hp == 60);
+	CHECK(town.mercs[1].fraction == MF_PURPLE);
+	CHECK(town.mercs[1].moved == 0);
+	CHECK(town.mercs[1].attacked);
+	CHECK(Town_merc_at(&town, (SDL_Point) {5, 9}) == 0);
+	CHECK(Town_merc_at(&town, (SDL_Point) {9, 5}) == 1);
+
+#ifdef _DEBUG
+	CHECK(Town_verify_field_counts(&town));
+	CHECK(Town_verify_merc_index(&town));
+#endif
+
+	Town_clear(&town);
+}
+
+static void test_load_header_baseline( void )
+{
+	TownHeader header;
+
+	install(FIXTURE_BASELINE, "baseline_header", SIZE_MAX);
+	header = Town_load_header("baseline_header");
+
+	CHECK(header.invalid == false);
+	CHECK(header.admin_id == 1);
+	CHECK(header.round == 30);
+	CHECK(header.money == 1234);
+	CHECK(header.width == 15 && header.height == 15);
+	CHECK(header.merc_count == 2);
+}
+
+/* a migrated town is saved in the current layout and loads again */
+static void test_resave_baseline( void )
+{
+	Town town = Town_new(TOWN_DEFAULT_WIDTH, TOWN_DEFAULT_HEIGHT);
+	Town reloaded = Town_new(TOWN_DEFAULT_WIDTH, TOWN_DEFAULT_HEIGHT);
+
+	install(FIXTURE_BASELINE, "baseline_resave", SIZE_MAX);
+	Town_load(&town, "baseline_resave");
+	CHECK(town.invalid == false);
+
+	if (town.invalid)
+	{
+		Town_clear(&town);
+		Town_clear(&reloaded);
+		return;
+	}
+
+	Town_save(&town, "baseline_resave");
+	CHECK(town.invalid == false);
+
+	Town_load(&reloaded, "baseline_resave");
+	CHECK(reloaded.invalid == false);
+	CHECK(Town_state_hash(&reloaded) == Town_state_hash(&town));
+	CHECK(reloaded.constructions[0].start_round == 29);
+
+	Town_clear(&town);
+	Town_clear(&reloaded);
+}
+
+static void test_truncated_baseline( void )
+{
+	Town town = Town_new(TOWN_DEFAULT_WIDTH, TOWN_DEFAULT_HEIGHT);
+
+	/* cut into the merc list */
+	install(FIXTURE_BASELINE, "baseline_cut", 1200);
+	Town_load(&town, "baseline_cut");
+	CHECK(town.invalid);
+	CHECK(Town_load_header("baseline_cut").invalid);
+
+	Town_clear(&town);
+}
+
+/* files too short for their header must not be read past their end */
+static void test_short_files( void )
+{
+	static const uint8_t short_v1[] = {'R', 'C', 'T', 'W', 1, 0, 0, 0};
+	SM_String filepath = SM_String_new(16);
+	SM_String filepath_tmp = SM_String_new(16);
+	Buffer buf = Buffer_new(sizeof(short_v1));
+	Town town = Town_new(TOWN_DEFAULT_WIDTH, TOWN_DEFAULT_HEIGHT);
+
+	for (size_t len = 1; len < 30; len++)
+	{
+		install(FIXTURE_BASELINE, "baseline_short", len);
+		Town_load(&town, "baseline_short");
+		CHECK(town.invalid);
+		CHECK(Town_load_header("baseline_short").invalid);
+		town.invalid = false;
+	}
+
+	Buffer_write(&buf, short_v1, sizeof(short_v1));
+
+	/* what the readers do when they skip a header the file lacks */
+	buf.pos = 12;
+	CHECK(Buffer_view(&buf, 1) == NULL);
+	CHECK(buf.invalid);
+	buf.invalid = false;
+	buf.pos = 0;
+
+	get_town_file_path(&filepath, "short_v1", FILETYPE_TOWN);
+	get_town_file_path(&filepath_tmp, "short_v1", FILETYPE_TEMP);
+	CHECK(Buffer_to_file(&buf, filepath.str, filepath_tmp.str));
+
+	Town_load(&town, "short_v1");
+	CHECK(town.invalid);
+	CHECK(Town_load_header("short_v1").invalid);
+
+	Town_clear(&town);
+	Buffer_clear(&buf);
+	SM_String_clear(&filepath);
+	SM_String_clear(&filepath_tmp);
+}
+
+int main( void )
+{
+	test_home();
+
+	test_load_baseline();
+	test_load_header_baseline();
+	test_resave_baseline();
+	test_truncated_baseline();
+	test_short_files();
+
+	return test_result("town_legacy");
+}